@@ -0,0 +1,41 @@
+import argparse
+
+import torch
+
+from model import SixDRepNet
+
+
+# SixDRepNet without the final compute_rotation_matrix_from_ortho6d, which the C++ extraction
+# (Video Extraction/src/HeadPose.cpp) computes itself. Returns the 6D pose, batch*6
+class SixDRepNetOrtho6d(torch.nn.Module):
+    def __init__(self, model):
+        super(SixDRepNetOrtho6d, self).__init__()
+        self.model = model
+
+    def forward(self, x):
+        m = self.model
+        x = m.layer4(m.layer3(m.layer2(m.layer1(m.layer0(x)))))
+        x = torch.flatten(m.gap(x), 1)
+        return m.linear_reg(x)
+
+
+parser = argparse.ArgumentParser(description='Export 6DRepNet to ONNX for the head pose stage of the extraction.')
+parser.add_argument('--snapshot', default='./6DRepNet_300W_LP_AFLW2000.pth')
+parser.add_argument('--output', default='./6DRepNet_300W_LP_AFLW2000.onnx')
+parser.add_argument('--opset', type=int, default=13)
+args = parser.parse_args()
+
+model = SixDRepNet(backbone_name='RepVGG-B1g2',
+                   backbone_file='',
+                   deploy=True,
+                   pretrained=False)
+model.load_state_dict(torch.load(args.snapshot, map_location='cpu'))
+model.eval()
+
+# The batch size is left dynamic, the extraction batches the faces of several frames and devices
+dummy = torch.randn(1, 3, 224, 224)
+torch.onnx.export(SixDRepNetOrtho6d(model), dummy, args.output,
+                  input_names=['input'], output_names=['ortho6d'],
+                  dynamic_axes={'input': {0: 'batch'}, 'ortho6d': {0: 'batch'}},
+                  opset_version=args.opset)
+print('Exported', args.output)
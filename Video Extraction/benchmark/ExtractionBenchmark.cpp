@@ -0,0 +1,267 @@
+// Benchmarks of the extraction stages on synthetic captures, no device or recording needed.
+//
+//      ExtractionBenchmark --benchmark_filter=PointCloud
+//
+// The arguments of every benchmark are listed in its name, e.g. BM_GetMatColor/0/2 is MJPG at 1080P. The color
+// format is 0 for MJPG and 3 for BGRA32, the resolutions and depth modes are the values of the k4a enums.
+
+#include <filesystem>
+#include <benchmark/benchmark.h>
+
+#include "../include/SyntheticCapture.hpp"
+#include "../include/PointCloud.hpp"
+#include "../include/FrameTransform.hpp"
+#include "../include/Reprojection.hpp"
+#include "../include/Pipeline.hpp"
+#include "../include/PlaybackExtraction.hpp"
+#include "../include/utils.hpp"
+
+namespace fs = std::filesystem;
+
+static const std::vector<int64_t> COLOR_FORMATS = { K4A_IMAGE_FORMAT_COLOR_MJPG, K4A_IMAGE_FORMAT_COLOR_BGRA32 };
+static const std::vector<int64_t> COLOR_RESOLUTIONS = { K4A_COLOR_RESOLUTION_720P, K4A_COLOR_RESOLUTION_1080P,
+    K4A_COLOR_RESOLUTION_2160P };
+static const std::vector<int64_t> DEPTH_MODES = { K4A_DEPTH_MODE_NFOV_UNBINNED, K4A_DEPTH_MODE_WFOV_2X2BINNED };
+
+static SyntheticCaptureConfig synthetic_config(int64_t color_format, int64_t color_resolution,
+    int64_t depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED)
+{
+    SyntheticCaptureConfig config;
+    config.color_format = (k4a_image_format_t)color_format;
+    config.color_resolution = (k4a_color_resolution_t)color_resolution;
+    config.depth_mode = (k4a_depth_mode_t)depth_mode;
+    return config;
+}
+
+// Depth and IR of a capture mapped into the color camera, the input of the point clouds
+struct TransformedCapture
+{
+    k4a::calibration calibration;
+    k4a::image depth_image;
+    k4a::image ir_image;
+};
+
+static TransformedCapture transformed_capture(int64_t color_resolution, int64_t depth_mode, FramePool& pool)
+{
+    SyntheticCaptureGenerator generator(synthetic_config(K4A_IMAGE_FORMAT_COLOR_BGRA32, color_resolution, depth_mode));
+    k4a::capture capture = generator.next_capture();
+    k4a::image color_image = capture.get_color_image();
+
+    TransformedCapture transformed;
+    transformed.calibration = generator.get_calibration();
+    k4a::transformation transformation(transformed.calibration);
+    transform_depth_and_ir(transformation, capture.get_depth_image(), capture.get_ir_image(),
+        color_image.get_width_pixels(), color_image.get_height_pixels(), pool,
+        transformed.depth_image, transformed.ir_image);
+    transformation.destroy();
+    return transformed;
+}
+
+// Color image to cv::Mat, the MJPG decode of the transform stage
+static void BM_GetMatColor(benchmark::State& state)
+{
+    SyntheticCaptureGenerator generator(synthetic_config(state.range(0), state.range(1)));
+    k4a::image color_image = generator.next_capture().get_color_image();
+    FramePool pool;
+    for (auto _ : state)
+    {
+        k4a::image backing;
+        cv::Mat mat = get_mat(color_image, pool, backing);
+        benchmark::DoNotOptimize(mat.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * (int64_t)color_image.get_size());
+}
+BENCHMARK(BM_GetMatColor)->ArgsProduct({ COLOR_FORMATS, COLOR_RESOLUTIONS })->Unit(benchmark::kMillisecond);
+
+static void BM_CreateXyTable(benchmark::State& state)
+{
+    k4a::calibration calibration = create_synthetic_calibration(K4A_DEPTH_MODE_NFOV_UNBINNED,
+        (k4a_color_resolution_t)state.range(0));
+    for (auto _ : state)
+    {
+        XYTable xy_table = create_xy_table(calibration, K4A_CALIBRATION_TYPE_COLOR);
+        benchmark::DoNotOptimize(xy_table.x.data());
+    }
+}
+BENCHMARK(BM_CreateXyTable)->ArgsProduct({ COLOR_RESOLUTIONS })->Unit(benchmark::kMillisecond);
+
+// Depth and IR into the color camera in one pass
+static void BM_TransformDepthAndIr(benchmark::State& state)
+{
+    SyntheticCaptureGenerator generator(synthetic_config(K4A_IMAGE_FORMAT_COLOR_BGRA32, state.range(0), state.range(1)));
+    k4a::capture capture = generator.next_capture();
+    k4a::image depth_image = capture.get_depth_image();
+    k4a::image ir_image = capture.get_ir_image();
+    k4a::image color_image = capture.get_color_image();
+    k4a::transformation transformation(generator.get_calibration());
+    FramePool pool;
+    for (auto _ : state)
+    {
+        k4a::image transformed_depth_image;
+        k4a::image transformed_ir_image;
+        transform_depth_and_ir(transformation, depth_image, ir_image, color_image.get_width_pixels(),
+            color_image.get_height_pixels(), pool, transformed_depth_image, transformed_ir_image);
+        benchmark::DoNotOptimize(transformed_depth_image.get_buffer());
+    }
+    transformation.destroy();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TransformDepthAndIr)->ArgsProduct({ COLOR_RESOLUTIONS, DEPTH_MODES })->Unit(benchmark::kMillisecond);
+
+// The same with the reprojection table, on one thread like in the pipeline (0) and on the OpenCV threads (1)
+static void BM_ReprojectDepthAndIr(benchmark::State& state)
+{
+    SyntheticCaptureGenerator generator(synthetic_config(K4A_IMAGE_FORMAT_COLOR_BGRA32, state.range(0), state.range(1)));
+    k4a::capture capture = generator.next_capture();
+    k4a::image depth_image = capture.get_depth_image();
+    k4a::image ir_image = capture.get_ir_image();
+    std::shared_ptr<const ReprojectionTable> table = get_reprojection_table(generator.get_calibration());
+    FramePool pool;
+    for (auto _ : state)
+    {
+        k4a::image transformed_depth_image;
+        k4a::image transformed_ir_image;
+        reproject_depth_and_ir(*table, depth_image, ir_image, pool, transformed_depth_image, transformed_ir_image,
+            state.range(2) != 0);
+        benchmark::DoNotOptimize(transformed_depth_image.get_buffer());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReprojectDepthAndIr)->ArgsProduct({ COLOR_RESOLUTIONS, DEPTH_MODES, { 0, 1 } })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Decoded color into the depth camera of ImageGeometry::Depth, with the SDK (0) and the reprojection table (1)
+static void BM_TransformColor(benchmark::State& state)
+{
+    SyntheticCaptureGenerator generator(synthetic_config(K4A_IMAGE_FORMAT_COLOR_BGRA32, state.range(0)));
+    k4a::capture capture = generator.next_capture();
+    k4a::image depth_image = capture.get_depth_image();
+    cv::Mat color_image = get_mat(capture.get_color_image());
+    k4a::transformation transformation(generator.get_calibration());
+    std::shared_ptr<const ReprojectionTable> table = get_reprojection_table(generator.get_calibration());
+    FramePool pool;
+    for (auto _ : state)
+    {
+        k4a::image transformed_color_image;
+        if (state.range(1) != 0)
+        {
+            cv::Mat transformed_color = reproject_color(*table, depth_image, color_image, pool, transformed_color_image);
+            benchmark::DoNotOptimize(transformed_color.data);
+        }
+        else
+        {
+            transform_color(transformation, depth_image, color_image, pool, transformed_color_image);
+            benchmark::DoNotOptimize(transformed_color_image.get_buffer());
+        }
+    }
+    transformation.destroy();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TransformColor)->ArgsProduct({ COLOR_RESOLUTIONS, { 0, 1 } })->Unit(benchmark::kMillisecond);
+
+// Items are points
+static void BM_GeneratePointCloud(benchmark::State& state)
+{
+    FramePool pool;
+    TransformedCapture transformed = transformed_capture(state.range(0), K4A_DEPTH_MODE_NFOV_UNBINNED, pool);
+    std::shared_ptr<const XYTable> xy_table = get_xy_table(transformed.calibration, K4A_CALIBRATION_TYPE_COLOR);
+    PointCloud point_cloud;
+    for (auto _ : state)
+    {
+        generate_point_cloud(transformed.depth_image, *xy_table, point_cloud, state.range(1) != 0);
+        benchmark::DoNotOptimize(point_cloud.x.data());
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)point_cloud.size());
+}
+BENCHMARK(BM_GeneratePointCloud)->ArgsProduct({ COLOR_RESOLUTIONS, { 0, 1 } })->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static PointCloud synthetic_point_cloud(bool color, bool ir)
+{
+    FramePool pool;
+    TransformedCapture transformed = transformed_capture(K4A_COLOR_RESOLUTION_1080P, K4A_DEPTH_MODE_NFOV_UNBINNED, pool);
+    PointCloud point_cloud;
+    generate_point_cloud(transformed.depth_image, *get_xy_table(transformed.calibration, K4A_CALIBRATION_TYPE_COLOR),
+        point_cloud);
+    cv::Mat color_mat;
+    if (color)
+    {
+        color_mat = cv::Mat(transformed.depth_image.get_height_pixels(), transformed.depth_image.get_width_pixels(),
+            CV_8UC3, cv::Scalar(40, 60, 200));
+    }
+    add_point_attributes(point_cloud, color_mat, ir ? get_mat(transformed.ir_image, false) : cv::Mat());
+    return point_cloud;
+}
+
+// Encoding into memory, by PointCloudFormat
+static void BM_EncodePointCloud(benchmark::State& state)
+{
+    PointCloud point_cloud = synthetic_point_cloud(true, true);
+    std::vector<uchar> buffer;
+    for (auto _ : state)
+    {
+        encode_point_cloud(point_cloud, (PointCloudFormat)state.range(0), buffer);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)buffer.size());
+}
+BENCHMARK(BM_EncodePointCloud)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+
+// Encoding and writing the file, by PointCloudFormat
+static void BM_WritePointCloud(benchmark::State& state)
+{
+    PointCloud point_cloud = synthetic_point_cloud(false, false);
+    PointCloudFormat format = (PointCloudFormat)state.range(0);
+    std::string path = (fs::temp_directory_path() / ("benchmark_point_cloud" + point_cloud_extension(format))).string();
+    for (auto _ : state)
+    {
+        write_point_cloud(path, point_cloud, format);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)fs::file_size(path));
+    fs::remove(path);
+}
+BENCHMARK(BM_WritePointCloud)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+
+// Every stage of the extraction of a frame: transformation, decoding, encoding and writing the files. Each
+// iteration extracts one second of frames into a temporary directory. Items are frames
+static void BM_Pipeline(benchmark::State& state)
+{
+    SyntheticCaptureGenerator generator(synthetic_config(K4A_IMAGE_FORMAT_COLOR_MJPG, state.range(0)));
+    std::vector<k4a::capture> captures;
+    for (int i = 0; i < 30; i++)
+    {
+        captures.push_back(generator.next_capture());
+    }
+
+    PipelineConfig config;
+    config.show_progress = false;
+    config.point_clouds = state.range(1) != 0;
+    fs::path root = fs::temp_directory_path() / "extraction_benchmark";
+
+    uint64_t bytes = 0;
+    int run = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        fs::remove_all(root);
+        fs::create_directories(root);
+        std::string base_path = (root / std::to_string(run++)).string();
+        create_output_directories(OutputLayout(base_path));
+        state.ResumeTiming();
+
+        ExtractionPipeline pipeline(generator.get_calibration(), base_path, config);
+        for (const k4a::capture& capture : captures)
+        {
+            pipeline.push(capture);
+        }
+        pipeline.finish();
+        bytes += pipeline.get_stats().bytes_written;
+    }
+    fs::remove_all(root);
+    state.SetItemsProcessed(state.iterations() * (int64_t)captures.size());
+    state.SetBytesProcessed((int64_t)bytes);
+}
+BENCHMARK(BM_Pipeline)->ArgsProduct({ COLOR_RESOLUTIONS, { 0, 1 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,36 @@
+#ifndef BATCHEXTRACTION_HPP
+#define BATCHEXTRACTION_HPP
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+#include "Pipeline.hpp"
+#include "PlaybackExtraction.hpp"
+
+// Settings of a batch of playback extractions
+struct BatchConfig
+{
+    // Recordings extracted at the same time. Each one adds a reader, its transform threads and a writer
+    unsigned int concurrent_recordings = 2;
+
+    // Global IO budget: writer threads saving files at the same time across all recordings
+    unsigned int io_threads = 2;
+
+    // Settings of every recording's pipeline. encode_threads is the size of the worker pool shared by all
+    // recordings, which is the CPU budget of the batch
+    PipelineConfig pipeline;
+
+    // File listing the recordings already started and completed. Empty disables resuming
+    std::string manifest_path;
+};
+
+int batchExtraction(const std::vector<std::string>& input_paths, const BatchConfig& config = BatchConfig());
+
+#endif // BATCHEXTRACTION_HPP
@@ -0,0 +1,175 @@
+#ifndef CAPTURESOURCE_HPP
+#define CAPTURESOURCE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <k4a/k4a.hpp>
+#include <k4arecord/playback.hpp>
+
+#include "SyntheticCapture.hpp"
+
+// Captures a paced source holds for a reader that falls behind before it drops the oldest, like the queue of the
+// SDK
+constexpr int64_t PACED_SOURCE_QUEUE_FRAMES = 2;
+
+// IMU rate of the Azure Kinect, about 1.6 kHz
+constexpr std::chrono::microseconds SYNTHETIC_IMU_PERIOD(600);
+
+// A device, or what behaves like one, could not be set up or stopped delivering synchronized captures
+class CaptureError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Where MultiDeviceCapturer gets its captures and IMU samples from: a device, a recording replayed at its
+// recorded frame rate or synthetic captures at the configured frame rate. The sync cables of the paced sources are
+// derived from the recording or given, so several of them form a master and subordinates like devices do.
+//
+// A timeout below zero waits forever. get_capture and get_imu_sample are called from one reader thread each.
+class CaptureSource
+{
+public:
+
+    virtual ~CaptureSource() = default;
+
+    // Device index, recording path or synthetic device number, for messages
+    virtual std::string get_name() const = 0;
+
+    virtual bool is_sync_in_connected() const = 0;
+    virtual bool is_sync_out_connected() const = 0;
+
+    virtual k4a::calibration get_calibration(k4a_depth_mode_t depth_mode, k4a_color_resolution_t color_resolution) const = 0;
+
+    virtual void start_cameras(const k4a_device_configuration_t& config) = 0;
+    virtual void stop_cameras() = 0;
+
+    // False on timeout, or once a recording has no more captures
+    virtual bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) = 0;
+
+    virtual void start_imu() = 0;
+    virtual void stop_imu() = 0;
+    virtual bool get_imu_sample(k4a_imu_sample_t* imu_sample, std::chrono::milliseconds timeout) = 0;
+
+    // True once a recording has no more captures. Devices and synthetic sources never finish
+    virtual bool is_finished() const;
+};
+
+// Azure Kinect connected to this computer
+class DeviceCaptureSource : public CaptureSource
+{
+public:
+
+    // Opens the device and sets its color exposure and powerline frequency manually, which synchronized devices
+    // need
+    DeviceCaptureSource(uint32_t device_index, int32_t color_exposure_usec, int32_t powerline_freq);
+
+    std::string get_name() const override;
+    bool is_sync_in_connected() const override;
+    bool is_sync_out_connected() const override;
+    k4a::calibration get_calibration(k4a_depth_mode_t depth_mode, k4a_color_resolution_t color_resolution) const override;
+    void start_cameras(const k4a_device_configuration_t& config) override;
+    void stop_cameras() override;
+    bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) override;
+    void start_imu() override;
+    void stop_imu() override;
+    bool get_imu_sample(k4a_imu_sample_t* imu_sample, std::chrono::milliseconds timeout) override;
+
+private:
+
+    uint32_t device_index;
+    k4a::device device;
+};
+
+// Recording replayed in real time: a capture is returned once as much time has passed since start_cameras as
+// lies between its timestamp and the first one. The configuration passed to start_cameras is ignored, the
+// recording has its own. The sync cables are those of the recording's wired sync mode.
+class PlaybackCaptureSource : public CaptureSource
+{
+public:
+
+    explicit PlaybackCaptureSource(const std::string& path);
+
+    std::string get_name() const override;
+    bool is_sync_in_connected() const override;
+    bool is_sync_out_connected() const override;
+    k4a::calibration get_calibration(k4a_depth_mode_t depth_mode, k4a_color_resolution_t color_resolution) const override;
+    void start_cameras(const k4a_device_configuration_t& config) override;
+    void stop_cameras() override;
+    bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) override;
+    void start_imu() override;
+    void stop_imu() override;
+    bool get_imu_sample(k4a_imu_sample_t* imu_sample, std::chrono::milliseconds timeout) override;
+    bool is_finished() const override;
+
+private:
+
+    // Sleeps until the host time of timestamp_usec, false if that is more than timeout away
+    bool wait_for(int64_t timestamp_usec, std::chrono::milliseconds timeout) const;
+
+    std::string path;
+    k4a::playback playback;
+    k4a_record_configuration_t record_config;
+    std::chrono::microseconds frame_period;
+
+    // The IMU samples are read with a handle of their own, the two readers run on different threads
+    k4a::playback imu_playback;
+    k4a_imu_sample_t pending_imu_sample{};
+    bool has_pending_imu_sample = false;
+
+    k4a::capture pending_capture;
+    int64_t first_timestamp_usec = 0;
+    std::chrono::steady_clock::time_point start_time;
+    bool started = false;
+    bool finished = false;
+};
+
+// Synthetic device producing SyntheticCaptureGenerator captures at the frame rate of the configuration passed to
+// start_cameras, and IMU samples of a device at rest. A reader more than PACED_SOURCE_QUEUE_FRAMES frames late
+// loses the oldest frames, so the frames the host cannot keep up with show up as gaps in the timestamps.
+class SyntheticCaptureSource : public CaptureSource
+{
+public:
+
+    // wired_sync_mode sets the sync cables. A subordinate's timestamps are delayed by the
+    // subordinate_delay_off_master_usec of its configuration
+    SyntheticCaptureSource(uint32_t index, k4a_wired_sync_mode_t wired_sync_mode);
+
+    std::string get_name() const override;
+    bool is_sync_in_connected() const override;
+    bool is_sync_out_connected() const override;
+    k4a::calibration get_calibration(k4a_depth_mode_t depth_mode, k4a_color_resolution_t color_resolution) const override;
+    void start_cameras(const k4a_device_configuration_t& config) override;
+    void stop_cameras() override;
+    bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) override;
+    void start_imu() override;
+    void stop_imu() override;
+    bool get_imu_sample(k4a_imu_sample_t* imu_sample, std::chrono::milliseconds timeout) override;
+
+private:
+
+    uint32_t index;
+    k4a_wired_sync_mode_t wired_sync_mode;
+    std::unique_ptr<SyntheticCaptureGenerator> generator;
+    std::chrono::microseconds frame_period{ 0 };
+    std::chrono::microseconds start_timestamp{ 0 };
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t imu_sample_count = 0;
+};
+
+// Sources of the devices connected to this computer
+std::vector<std::unique_ptr<CaptureSource>> open_device_sources(uint32_t num_devices, int32_t color_exposure_usec,
+    int32_t powerline_freq);
+
+// Sources replaying the recordings of a session in real time
+std::vector<std::unique_ptr<CaptureSource>> open_playback_sources(const std::vector<std::string>& paths);
+
+// A synthetic master followed by num_devices - 1 synthetic subordinates
+std::vector<std::unique_ptr<CaptureSource>> open_synthetic_sources(uint32_t num_devices);
+
+#endif // CAPTURESOURCE_HPP
@@ -0,0 +1,114 @@
+#ifndef CAPTURESYNCHRONIZER_HPP
+#define CAPTURESYNCHRONIZER_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <k4a/k4a.hpp>
+#include <k4arecord/playback.hpp>
+
+// This is the maximum difference between when we expected an image's timestamp to be and when it actually occurred.
+constexpr std::chrono::microseconds MAX_ALLOWABLE_TIME_OFFSET_ERROR_FOR_IMAGE_TIMESTAMP(100);
+
+// Captures kept per device while waiting for the other devices, about half a second at 15 fps
+constexpr size_t SYNCHRONIZER_WINDOW_SIZE = 8;
+
+// Captures of the devices taken at the same time. Index 0 is the master
+struct SynchronizedSet
+{
+    std::vector<k4a::capture> captures;
+
+    // Device timestamp of the image each device was matched with
+    std::vector<int64_t> timestamps_usec;
+
+    // Difference between the timestamp of a device and the timestamp expected from the master, 0 for the master
+    std::vector<int64_t> errors_usec;
+
+    int64_t max_error_usec() const;
+};
+
+// Counters per device, index 0 is the master
+struct SynchronizerStats
+{
+    uint64_t sets = 0;
+    std::vector<uint64_t> captures;             // added with add_capture
+    std::vector<uint64_t> discarded;            // could not be part of any set, or pushed out of a full window
+    std::vector<int64_t> max_abs_error_usec;
+    std::vector<double> mean_abs_error_usec;
+
+    // Fraction of the master captures that ended up in a set
+    double frame_yield() const;
+};
+
+// Matches the captures of several synchronized devices. Every device has a window of its most recent captures
+// sorted by timestamp, kept across calls. pop_synchronized_set looks at all windows at once: for every master
+// capture, oldest first, it picks the capture of each subordinate closest to the expected timestamp, so a set is
+// found in one pass however far the devices drifted apart. Captures older than a set can no longer be matched and
+// are discarded.
+//
+// The master is compared by its color image. The subordinates by their color image, or by their depth image with
+// compare_depth, which the offsets have to account for.
+class CaptureSynchronizer
+{
+public:
+
+    // expected_offsets_usec holds, for every subordinate, how much later than the master color image its compared
+    // image is taken: subordinate_delay_off_master_usec, plus depth_delay_off_color_usec when comparing depth
+    CaptureSynchronizer(const std::vector<int64_t>& expected_offsets_usec, bool compare_depth = false,
+        std::chrono::microseconds tolerance = MAX_ALLOWABLE_TIME_OFFSET_ERROR_FOR_IMAGE_TIMESTAMP,
+        size_t window_size = SYNCHRONIZER_WINDOW_SIZE);
+
+    size_t device_count() const;
+
+    // Captures without the compared image are discarded. The oldest capture is dropped when the window is full
+    void add_capture(size_t device_index, k4a::capture capture);
+
+    // False if no set can be completed with the captures added so far
+    bool pop_synchronized_set(SynchronizedSet& set);
+
+    // Discards the captures left in the windows
+    void clear();
+
+    SynchronizerStats get_stats() const;
+
+private:
+
+    struct WindowEntry
+    {
+        int64_t timestamp_usec;
+        k4a::capture capture;
+    };
+
+    void discard_front(size_t device_index);
+
+    std::vector<int64_t> offsets_usec;
+    bool compare_depth;
+    int64_t tolerance_usec;
+    size_t window_size;
+    std::vector<std::deque<WindowEntry>> windows;
+
+    SynchronizerStats stats;
+    std::vector<int64_t> error_sums_usec;
+};
+
+// Expected offsets of the subordinate recordings, read from the record configurations of the playbacks with the
+// master playback first
+std::vector<int64_t> recording_offsets(std::vector<k4a::playback>& playbacks, bool compare_depth);
+
+// Opens the recordings of a session and orders them master first. Returns false if there is not exactly one
+// master among several recordings
+bool open_session_recordings(const std::vector<std::string>& input_paths, std::vector<k4a::playback>& playbacks,
+    std::vector<std::string>& ordered_paths);
+
+// Feeds the captures of recordings made with --external-sync through a synchronizer in timestamp order, and prints
+// the frame yield, the sync error per device and the time needed per set. No device is needed
+void benchmarkSynchronization(const std::vector<std::string>& input_paths, bool compare_depth = false,
+    size_t window_size = SYNCHRONIZER_WINDOW_SIZE);
+
+#endif // CAPTURESYNCHRONIZER_HPP
@@ -0,0 +1,57 @@
+#ifndef COMMANDLINE_HPP
+#define COMMANDLINE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <stdexcept>
+
+#include "Pipeline.hpp"
+#include "BatchExtraction.hpp"
+#include "SessionExtraction.hpp"
+#include "OnlineExtraction.hpp"
+
+// What the executable does with its inputs
+enum class ExtractionMode
+{
+    Playback,   // every recording into the folder of its name, see batchExtraction
+    Session,    // the recordings of one session into --output, see sessionExtraction
+    Online,     // the connected devices into --output, see onlineExtraction
+    Replay,     // the recordings of one session replayed in real time as if they were devices
+    Synthetic   // synthetic devices, to load-test the online extraction
+};
+
+struct CommandLineOptions
+{
+    ExtractionMode mode = ExtractionMode::Playback;
+
+    // Recordings, given as arguments or listed in --input-list
+    std::vector<std::string> input_paths;
+
+    // Output directory of every mode but playback
+    std::string output_path;
+
+    // Seconds to record and number of devices of the online, replay and synthetic modes
+    int duration = 15;
+    int num_devices = 1;
+
+    // Settings of the batch and, in batch.pipeline, of the extraction in every mode
+    BatchConfig batch;
+
+    bool help = false;
+};
+
+// Reads the options from the arguments. --config <file> reads more from a file with one "option = value" or
+// "option" per line, the option without its dashes; lines starting with # are comments. Later options override
+// earlier ones. False, after printing the reason, on an unknown option or invalid value
+bool parse_command_line(int argc, char** argv, CommandLineOptions& options);
+
+// Runs the extraction of the mode, returns the exit code
+int run_command_line(const CommandLineOptions& options);
+
+void printUsage(const char* program);
+
+#endif // COMMANDLINE_HPP
@@ -0,0 +1,80 @@
+#ifndef EXTRACTIONJOURNAL_HPP
+#define EXTRACTIONJOURNAL_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <filesystem>
+
+// A checkpoint is appended once this many frames were written since the last one or the last one is this old,
+// whichever comes first
+constexpr uint64_t JOURNAL_CHECKPOINT_FRAMES = 64;
+constexpr std::chrono::milliseconds JOURNAL_CHECKPOINT_INTERVAL(1000);
+
+// Output of an extraction that is complete on disk: the frames written in capture order, the device timestamps of
+// the last written image of every stream (-1 before the first one) and the size of every file the extraction
+// appends to, by path relative to the output directory
+struct JournalCheckpoint
+{
+    uint64_t frames = 0;
+    int64_t depth_timestamp_usec = -1;
+    int64_t color_timestamp_usec = -1;
+    int64_t ir_timestamp_usec = -1;
+    std::map<std::string, uintmax_t> file_sizes;
+};
+
+// What a journal says about its extraction
+struct JournalState
+{
+    bool exists = false;
+    bool done = false;              // the extraction finished, its outputs are complete
+    bool has_checkpoint = false;
+    JournalCheckpoint checkpoint;   // the last checkpoint
+};
+
+// extraction.journal of a playback extraction, one record per line, each ending with the CRC-32 of the rest of
+// its line:
+//
+//      checkpoint frames=<n> depth=<usec> color=<usec> ir=<usec> <relative path>=<bytes>... crc32=<8 hex digits>
+//      done crc32=<8 hex digits>
+//
+// A checkpoint is only appended once everything it covers has been handed to the operating system, so after a
+// crash the output up to the last checkpoint is complete: the image files, and the timestamps, metadata, head pose
+// and point cloud stream files up to the recorded sizes. Whatever follows the last checkpoint is discarded on
+// resume. A record cut short by the crash fails its checksum and is ignored with everything after it.
+class ExtractionJournal
+{
+public:
+
+    ~ExtractionJournal();
+
+    // Starts a new journal, replacing any existing one, whose first record is the checkpoint resumed from
+    bool open(const std::filesystem::path& path, const JournalCheckpoint* resumed = nullptr);
+
+    bool append_checkpoint(const JournalCheckpoint& checkpoint);
+
+    // Appends to an existing journal that the extraction it describes finished
+    static bool mark_done(const std::filesystem::path& path);
+
+    void close();
+
+    bool is_open() const;
+
+private:
+
+    bool append_record(const std::string& record);
+
+    std::ofstream file;
+};
+
+// Reads the last valid checkpoint and whether the extraction finished. A missing journal has exists = false
+JournalState read_journal(const std::filesystem::path& path);
+
+// CRC-32 (IEEE 802.3, the one of zlib and PNG)
+uint32_t crc32(const void* data, size_t size);
+
+#endif // EXTRACTIONJOURNAL_HPP
@@ -0,0 +1,125 @@
+#ifndef FRAMECONTAINER_HPP
+#define FRAMECONTAINER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <algorithm>
+#include <opencv2/highgui.hpp>
+
+#include "RawFrameWriter.hpp"
+
+// Single file holding every stream of a recording. Layout, all integers little endian:
+//
+//      "K4FC" uint32 version                               file header
+//      encoded images, back to back                        one chunk per frame, streams in any order
+//      FrameContainerEntry[frame_count][stream_count]      frame table
+//      char[stream_count][CONTAINER_STREAM_NAME_SIZE]      stream names, e.g. "depth/raw_matrices.png"
+//      FrameContainerFooter                                last 32 bytes of the file
+//
+// The frame table is only written by close(), so a container of an interrupted extraction cannot be read.
+constexpr uint32_t CONTAINER_VERSION = 1;
+constexpr size_t CONTAINER_STREAM_NAME_SIZE = 32;
+
+struct FrameContainerEntry
+{
+    uint64_t offset;            // 0 and size 0 if the frame has no image of the stream
+    uint64_t size;
+    int64_t timestamp_usec;     // device timestamp of the image
+};
+
+struct FrameContainerFooter
+{
+    uint64_t table_offset;
+    uint64_t frame_count;
+    uint32_t stream_count;
+    uint32_t version;
+    char magic[4];              // "K4FI"
+    uint32_t reserved;
+};
+
+// Encoded image of one stream of a frame
+struct ContainerImage
+{
+    std::string stream;
+    int64_t timestamp_usec = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// Appends frames to a container. Frames should be appended in timestamp order, find_frame relies on it
+class FrameContainerWriter
+{
+public:
+
+    ~FrameContainerWriter();
+
+    bool open(const std::string& path);
+
+    // Streams seen for the first time are added to the container
+    bool append_frame(const std::vector<ContainerImage>& images);
+
+    // Writes the frame table. Without it the container cannot be read
+    bool close();
+
+    bool is_open() const;
+
+private:
+
+    std::ofstream file;
+    uint64_t position = 0;
+    std::map<std::string, uint32_t> stream_indices;
+    std::vector<std::string> stream_names;
+    std::vector<std::vector<FrameContainerEntry>> frame_table;
+};
+
+// Memory maps a container and returns frames without reading the rest of the file
+class FrameContainerReader
+{
+public:
+
+    ~FrameContainerReader();
+
+    bool open(const std::string& path);
+
+    void close();
+
+    size_t frame_count() const;
+
+    const std::vector<std::string>& get_stream_names() const;
+
+    // Returns -1 if the container has no such stream
+    int get_stream_index(const std::string& stream) const;
+
+    // Images of every stream of the frame. The pointers are valid until close()
+    bool get_frame(size_t index, std::vector<ContainerImage>& images) const;
+
+    // Index of the frame whose image of the stream is closest in time to timestamp_usec. Frames without an image
+    // of the stream are skipped, false if no frame has one
+    bool find_frame(int64_t timestamp_usec, size_t& index, size_t stream = 0) const;
+
+    // Decodes the image of a stream: raw_matrices through decode_raw_frame, other streams through cv::imdecode
+    cv::Mat get_image(size_t index, size_t stream) const;
+
+private:
+
+    FrameContainerEntry entry(size_t index, size_t stream) const;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const uint8_t* frame_table = nullptr;
+    FrameContainerFooter footer = {};
+    std::vector<std::string> stream_names;
+
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int file_descriptor = -1;
+#endif
+};
+
+#endif // FRAMECONTAINER_HPP
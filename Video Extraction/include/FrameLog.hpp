@@ -0,0 +1,65 @@
+#ifndef FRAMELOG_HPP
+#define FRAMELOG_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <k4a/k4a.hpp>
+
+// A batch of records is written once it holds this many records or is this old, whichever comes first
+constexpr size_t FRAME_LOG_FLUSH_RECORDS = 64;
+constexpr std::chrono::milliseconds FRAME_LOG_FLUSH_INTERVAL(1000);
+
+// Timestamps and settings of one image
+struct FrameMetadata
+{
+    int64_t device_timestamp_usec = 0;  // clock of the device, names the files of the image
+    int64_t system_timestamp_nsec = 0;  // host clock when the SDK received the image, 0 in recordings
+    int64_t host_timestamp_usec = 0;    // host wall clock when the capture entered the extraction
+    int64_t exposure_usec = 0;          // color images only, 0 for depth and IR
+};
+
+// Metadata of the images read from the k4a image, host_timestamp_usec is taken now
+FrameMetadata get_frame_metadata(const k4a::image& image);
+
+// Per-stream log of the extracted images, in the stream folder:
+//
+//      timestamps.txt      device timestamp of every image, one per line
+//      metadata.csv        device_timestamp_usec,system_timestamp_nsec,host_timestamp_usec,exposure_usec
+//
+// Both files are appended to. The records are buffered in memory and written in batches of
+// FRAME_LOG_FLUSH_RECORDS records, or when the oldest buffered record is older than FRAME_LOG_FLUSH_INTERVAL at
+// the next append, and by close(). Crash safety: if the process dies, the records of the last unwritten batch
+// are lost, so up to FRAME_LOG_FLUSH_RECORDS images or FRAME_LOG_FLUSH_INTERVAL of images may already be on disk
+// without their line. Their device timestamps are still in their file names. Every batch ends with a complete
+// line, only a crash of the operating system can leave a partial last line.
+class FrameLog
+{
+public:
+
+    ~FrameLog();
+
+    bool open(const std::filesystem::path& directory);
+
+    void append(const FrameMetadata& metadata);
+
+    // Writes the buffered records to the files and flushes the streams
+    void flush();
+
+    void close();
+
+    bool is_open() const;
+
+private:
+
+    std::ofstream timestamps_file;
+    std::ofstream metadata_file;
+    std::string timestamps_buffer;
+    std::string metadata_buffer;
+    size_t pending_records = 0;
+    std::chrono::steady_clock::time_point oldest_pending;
+};
+
+#endif // FRAMELOG_HPP
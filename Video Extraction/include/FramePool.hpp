@@ -0,0 +1,60 @@
+#ifndef FRAMEPOOL_HPP
+#define FRAMEPOOL_HPP
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <memory>
+#include <k4a/k4a.hpp>
+#include <opencv2/highgui.hpp>
+
+struct FramePoolStats
+{
+    uint64_t hits = 0;      // images served from a recycled buffer
+    uint64_t misses = 0;    // images that needed a new buffer
+
+    double hit_rate() const;
+};
+
+struct FramePoolState;
+
+// Buffer owned by the pool. While handed out, state keeps the pool alive so the buffer can find its way back
+struct FramePoolBuffer
+{
+    std::tuple<int, int, int, int> key;     // format, width, height, stride
+    std::vector<uint8_t> storage;
+    std::shared_ptr<FramePoolState> state;
+};
+
+struct FramePoolState
+{
+    std::mutex mutex;
+    std::map<std::tuple<int, int, int, int>, std::vector<std::unique_ptr<FramePoolBuffer>>> free_buffers;
+    FramePoolStats stats;
+};
+
+// Recycles the buffers of the images created for every frame (transformed depth and IR, decoded color), keyed
+// by format and resolution. Once every key has been seen, extraction runs without allocating image buffers.
+// One pool should be used per device, it is safe to share between the threads processing that device.
+class FramePool
+{
+public:
+
+    FramePool();
+
+    // Image backed by a pooled buffer, which returns to the pool when the last reference to the image is released
+    k4a::image create_image(k4a_image_format_t format, int width_pixels, int height_pixels, int stride_bytes);
+
+    // Matrix header over a pooled buffer. backing owns the buffer and must outlive the matrix
+    cv::Mat create_mat(int rows, int cols, int type, k4a::image& backing);
+
+    FramePoolStats get_stats() const;
+
+private:
+
+    std::shared_ptr<FramePoolState> state;
+};
+
+#endif // FRAMEPOOL_HPP
@@ -0,0 +1,52 @@
+#ifndef FRAMETRANSFORM_HPP
+#define FRAMETRANSFORM_HPP
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <k4a/k4a.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "FramePool.hpp"
+
+// Map depth and IR into the color camera geometry in a single pass. depth_image_to_color_camera_custom
+// reprojects the depth image once and carries the IR values along, so its transformed depth is the same image
+// depth_image_to_color_camera produces. The output images come from the pool.
+void transform_depth_and_ir(
+    const k4a::transformation& transformation,
+    const k4a::image& depth_image,
+    const k4a::image& ir_image,
+    int color_image_width_pixels,
+    int color_image_height_pixels,
+    FramePool& pool,
+    k4a::image& transformed_depth_image,
+    k4a::image& transformed_ir_image);
+
+// Map only the depth image into the color camera geometry, for extractions without IR outputs
+void transform_depth(
+    const k4a::transformation& transformation,
+    const k4a::image& depth_image,
+    int color_image_width_pixels,
+    int color_image_height_pixels,
+    FramePool& pool,
+    k4a::image& transformed_depth_image);
+
+// Map the color image into the depth camera geometry with color_image_to_depth_camera. color_image is BGR or BGRA,
+// BGR images are converted to the BGRA32 the transformation takes. The output image is BGRA32 with the resolution
+// of the depth image and comes from the pool
+void transform_color(
+    const k4a::transformation& transformation,
+    const k4a::image& depth_image,
+    const cv::Mat& color_image,
+    FramePool& pool,
+    k4a::image& transformed_color_image);
+
+// Copy of a depth or IR image in a pooled buffer, for stages that modify the pixels
+k4a::image copy_image(const k4a::image& image, FramePool& pool);
+
+// Time the separate depth and depth + IR transformations against the fused one for a capture, and check that
+// both produce the same transformed depth
+void benchmarkColorTransformation(const k4a::calibration& calibration, const k4a::capture& capture, int iterations = 20);
+
+#endif // FRAMETRANSFORM_HPP
@@ -0,0 +1,172 @@
+#ifndef HEADPOSE_HPP
+#define HEADPOSE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <filesystem>
+#include <opencv2/core.hpp>
+
+#include "Profiler.hpp"
+
+// Side of the square face crops 6DRepNet takes, the Resize(224) and CenterCrop(224) of demo.py
+constexpr int HEAD_POSE_INPUT_SIZE = 224;
+
+// Face crops waiting for inference per crop of a full batch. estimate blocks beyond, so a slow model stalls the
+// encode workers instead of buffering the crops of a whole recording
+constexpr size_t HEAD_POSE_QUEUED_BATCHES = 4;
+
+struct HeadPoseConfig
+{
+    // Estimate the head orientation of the faces in the color images into color/head_pose.csv. Needs a build with
+    // -DVIDEO_EXTRACTION_HEAD_POSE=ON, and decodes the MJPG color images
+    bool enabled = false;
+
+    // SixDRepNet RepVGG-B1g2 with deploy=True, exported by 6dRepnet/export_onnx.py. Its output is either the 6D
+    // pose or the rotation matrix of every crop
+    std::string model_path = "6DRepNet_300W_LP_AFLW2000.onnx";
+
+    // YuNet face detector of the OpenCV model zoo, see cv::FaceDetectorYN
+    std::string detector_path = "face_detection_yunet_2023mar.onnx";
+
+    // Faces detected with a lower score are skipped, like in demo.py
+    float score_threshold = 0.95f;
+
+    // Width the color image is scaled down to for the face detection, 0 detects at full resolution. The crops are
+    // taken from the full resolution image either way
+    int detection_width = 640;
+
+    // Crops run through the model at once, gathered from every frame and device sharing the estimator
+    size_t batch_size = 16;
+
+    // Time the oldest crop of an incomplete batch waits for more crops
+    std::chrono::milliseconds batch_timeout{ 20 };
+
+    // ONNX Runtime threads of one inference
+    int inference_threads = 4;
+};
+
+// Orientation of one face. The angles are those demo.py draws, in degrees: the x, y and z angles of
+// compute_euler_angles_from_rotation_matrices
+struct HeadPose
+{
+    cv::Rect box;               // crop of the face in the color image, with the margin of demo.py
+    float score = 0.0f;         // face detection score
+    float pitch = 0.0f;
+    float yaw = 0.0f;
+    float roll = 0.0f;
+    float rotation[9] = {};     // rotation matrix, row major
+};
+
+// utils.compute_rotation_matrix_from_ortho6d of one pose. The columns are x, the normalized first vector, z x x
+// and z, the normalized cross product of x and the second vector
+void ortho6d_to_rotation_matrix(const float* ortho6d, float* rotation);
+
+// utils.compute_euler_angles_from_rotation_matrices of one matrix, the x, y and z angles in radians
+void rotation_matrix_to_euler_angles(const float* rotation, float* euler);
+
+// Face crop of demo.py around a detected face: 20 % of the face height added left and right, 20 % of its width
+// above and below, clipped to the image
+cv::Rect get_face_crop(const cv::Rect& face, const cv::Size& image_size);
+
+// Head pose estimation shared by the pipelines of every recording or device extracted at the same time.
+//
+// estimate detects the faces of a color image on the calling thread and queues their crops, already normalized
+// into the input tensor layout. One inference thread runs the crops of all callers through the model in batches of
+// HeadPoseConfig::batch_size, or what arrived within batch_timeout, and completes the frame once all of its faces
+// are known. Frames without faces complete right away.
+class HeadPoseEstimator
+{
+public:
+
+    HeadPoseEstimator();
+
+    ~HeadPoseEstimator();
+
+    // Loads both models and starts the inference thread. False, after printing the reason, if a model cannot be
+    // loaded or the build has no head pose support. The profiler times the inference, the detection is timed by
+    // the caller of estimate
+    bool open(const HeadPoseConfig& config, Profiler* profiler = nullptr);
+
+    bool is_open() const;
+
+    // Thread safe. color_image is BGR or BGRA and can be released once this returns
+    std::future<std::vector<HeadPose>> estimate(const cv::Mat& color_image);
+
+    // Runs the queued crops and stops the inference thread
+    void close();
+
+private:
+
+    // Poses of one frame, complete when remaining reaches 0
+    struct FrameRequest
+    {
+        std::vector<HeadPose> poses;
+        size_t remaining = 0;
+        std::promise<std::vector<HeadPose>> promise;
+    };
+
+    struct FaceCrop
+    {
+        std::shared_ptr<FrameRequest> frame;
+        HeadPose pose;
+        std::vector<float> tensor;  // 3 x HEAD_POSE_INPUT_SIZE x HEAD_POSE_INPUT_SIZE, normalized RGB
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // ONNX Runtime session and face detectors, defined in HeadPose.cpp so the ONNX Runtime headers stay out of
+    // the pipeline
+    struct Models;
+
+    std::vector<HeadPose> detect_faces(const cv::Mat& color_image);
+
+    void inference_worker();
+
+    void run_batch(std::vector<FaceCrop>& crops, std::vector<float>& batch);
+
+    HeadPoseConfig config;
+    Profiler* profiler = nullptr;
+    std::unique_ptr<Models> models;
+
+    std::deque<FaceCrop> pending_crops;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable crops_available;
+    std::condition_variable space_available;
+    std::thread inference_thread;
+};
+
+// color/head_pose.csv, one line per face:
+//
+//      device_timestamp_usec,face,score,x,y,width,height,pitch,yaw,roll,r00,r01,r02,r10,r11,r12,r20,r21,r22
+//
+// device_timestamp_usec names the color image, x to height is the face crop in it. Frames without faces have no
+// line
+class HeadPoseLog
+{
+public:
+
+    bool open(const std::filesystem::path& path);
+
+    void append(int64_t device_timestamp_usec, const std::vector<HeadPose>& poses);
+
+    void flush();
+
+    void close();
+
+    bool is_open() const;
+
+private:
+
+    std::ofstream file;
+};
+
+#endif // HEADPOSE_HPP
@@ -0,0 +1,148 @@
+#ifndef IMUWRITER_HPP
+#define IMUWRITER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <k4a/k4a.hpp>
+#include <k4arecord/playback.hpp>
+
+#include "SpscRing.hpp"
+
+// Bytes of samples buffered before they are written, about 20 seconds of the 1.6 kHz stream in NDJSON
+constexpr size_t IMU_WRITER_BUFFER_BYTES = 1 << 20;
+
+// Size of one record of ImuFormat::Bin, and with the int64 frame index of a tagged file
+constexpr size_t IMU_BIN_RECORD_SIZE = 44;
+constexpr size_t IMU_BIN_TAGGED_RECORD_SIZE = 52;
+
+// IMU samples of a live device buffered between its reader thread and its ImuStreamWriter, 2.5 seconds at 1.6 kHz
+constexpr size_t IMU_RING_CAPACITY = 4096;
+
+// Frames announced to an ImuStreamWriter and not yet used for tagging, 8 seconds at 30 fps
+constexpr size_t IMU_FRAME_RING_CAPACITY = 256;
+
+// File formats of the IMU samples. Every format is written sample by sample, so the memory needed does not
+// depend on the length of the recording
+enum class ImuFormat
+{
+    Ndjson,     // .ndjson, one json object per line with the fields of the old imu.json entries
+    Csv,        // .csv, header and one line per sample
+    Bin         // .bin, fixed records of IMU_BIN_RECORD_SIZE bytes without header, little endian:
+                // float32 acc_x acc_y acc_z, uint64 acc_timestamp_usec, float32 gyro_x gyro_y gyro_z,
+                // uint64 gyro_timestamp_usec, float32 temperature [int64 frame_index]
+};
+
+struct ImuConfig
+{
+    // Write the IMU samples of every recording or device
+    bool enabled = true;
+
+    ImuFormat format = ImuFormat::Ndjson;
+
+    // Read the IMU samples on their own thread, with a second handle of the recording, while the frames are
+    // extracted. Otherwise they are read after the frames
+    bool thread = true;
+};
+
+// Extension of the files of the format, with the dot
+std::string imu_extension(ImuFormat format);
+
+// Appends IMU samples to a file in one of the ImuFormat formats
+class ImuWriter
+{
+public:
+
+    ~ImuWriter();
+
+    // Truncates the file and writes the header of the format, if any. With frame_index every sample is written
+    // with the index of a frame: a frame_index field, column or trailing int64
+    bool open(const std::string& path, ImuFormat format, bool frame_index = false);
+
+    // frame_index is ignored unless the file was opened with frame_index, -1 when the sample has no frame
+    void append(const k4a_imu_sample_t& sample, int64_t frame_index = -1);
+
+    // Writes the buffered samples to the file
+    void flush();
+
+    void close();
+
+    bool is_open() const;
+
+    uint64_t get_sample_count() const;
+
+private:
+
+    std::ofstream file;
+    ImuFormat format = ImuFormat::Ndjson;
+    bool tagged = false;
+    std::string buffer;
+    uint64_t samples = 0;
+};
+
+// Frame of a live device an IMU sample can be tagged with
+struct ImuFrameTag
+{
+    int64_t index = -1;             // line of the frame in the timestamps.txt of the device
+    int64_t timestamp_usec = 0;     // device timestamp of the frame, same clock as the IMU timestamps
+};
+
+// Writes the IMU samples of one live device on a thread of its own, each tagged with the index of the frame whose
+// timestamp is closest to the accelerometer timestamp of the sample. The device's IMU reader thread pushes the
+// samples and the frame loop announces every frame it extracts, both through lock-free rings, so neither of them
+// ever waits for the disk. A sample is written once a frame at or after it is known, or at close, which delays it
+// by at most a frame period. When the sample ring is full the sample is dropped and counted, a frame that does not
+// fit only makes its samples point to a neighbouring frame.
+class ImuStreamWriter
+{
+public:
+
+    ImuStreamWriter(size_t sample_capacity = IMU_RING_CAPACITY, size_t frame_capacity = IMU_FRAME_RING_CAPACITY);
+
+    ~ImuStreamWriter();
+
+    // Opens the tagged file and starts the writer thread
+    bool open(const std::string& path, ImuFormat format);
+
+    // IMU reader thread only
+    void push_sample(const k4a_imu_sample_t& sample);
+
+    // Frame loop only. Frames have to be announced in timestamp order
+    void push_frame(const ImuFrameTag& frame);
+
+    // Writes the samples left with the last frame and stops the thread
+    void close();
+
+    uint64_t get_sample_count() const;
+    uint64_t get_dropped_sample_count() const;
+
+private:
+
+    void run();
+
+    // Writes the oldest pending samples whose closest frame is known, all of them when final
+    void write_pending(bool final);
+
+    SpscRing<k4a_imu_sample_t> sample_ring;
+    SpscRing<ImuFrameTag> frame_ring;
+    std::deque<k4a_imu_sample_t> pending_samples;
+    std::deque<ImuFrameTag> frames;
+    ImuWriter writer;
+    std::thread thread;
+    std::atomic<bool> running = false;
+    std::atomic<uint64_t> dropped_samples = 0;
+};
+
+// Write the IMU samples of the playback into imu_path, reading them as they are written
+bool extract_imu(k4a::playback& playback, const std::string& imu_path, ImuFormat format = ImuFormat::Ndjson);
+
+// Same with a handle of its own to the recording, so it can run on another thread than the one reading the
+// captures: a k4a::playback must not be used by two threads at once
+bool extract_imu(const std::string& input_path, const std::string& imu_path, ImuFormat format = ImuFormat::Ndjson);
+
+#endif // IMUWRITER_HPP
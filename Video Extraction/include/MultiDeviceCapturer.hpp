@@ -2,38 +2,119 @@
 #define MULTIDEVICECAPTURER_HPP
 
 #include <iostream>
+#include <iomanip>
 #include <chrono>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
 #include <k4a/k4a.hpp>
 
+#include "SpscRing.hpp"
+#include "CaptureSource.hpp"
+#include "CaptureSynchronizer.hpp"
+#include "ImuWriter.hpp"
+#include "Profiler.hpp"
+
 // Allowing at least 160 microseconds between depth cameras should ensure they do not interfere with one another.
 constexpr uint32_t MIN_TIME_BETWEEN_DEPTH_CAMERA_PICTURES_USEC = 160;
 
-// This is the maximum difference between when we expected an image's timestamp to be and when it actually occurred.
-constexpr std::chrono::microseconds MAX_ALLOWABLE_TIME_OFFSET_ERROR_FOR_IMAGE_TIMESTAMP(100);
-
 constexpr int64_t WAIT_FOR_SYNCHRONIZED_CAPTURE_TIMEOUT = 60000;
 
+// Captures a reader thread buffers for its device before dropping new ones, 2 seconds at 15 fps
+constexpr size_t CAPTURE_RING_CAPACITY = 30;
+
+// Counters of the reader thread of a device
+struct CaptureDeviceStats
+{
+    uint64_t captures = 0;      // read from the device
+    uint64_t ring_drops = 0;    // dropped because the consumer fell behind and the ring buffer was full
+    uint64_t sdk_drops = 0;     // frames missing between consecutive captures, estimated from the timestamps
+    uint64_t unmatched = 0;     // discarded by the synchronizer, no capture of another device matched them
+};
+
 class MultiDeviceCapturer
 {
 public:
 
+    // Opens the devices of device_indices. Throws CaptureError, or k4a::error when a device cannot be opened
     MultiDeviceCapturer(const std::vector<uint32_t>& device_indices, int32_t color_exposure_usec, int32_t powerline_freq);
 
+    // Takes devices, recordings or synthetic devices, picked as master and subordinates by their sync cables.
+    // Throws CaptureError when they cannot be synchronized
+    explicit MultiDeviceCapturer(std::vector<std::unique_ptr<CaptureSource>> sources);
+
+    ~MultiDeviceCapturer();
+
     void start_devices(const k4a_device_configuration_t& master_config, const k4a_device_configuration_t& sub_config);
 
+    // Starts one thread per device that moves its captures into a ring buffer, so the queue of the SDK is drained
+    // at full frame rate however slow the consumer is. get_synchronized_captures then matches the buffered captures
+    void start_reader_threads(size_t ring_capacity = CAPTURE_RING_CAPACITY);
+
+    void stop_reader_threads();
+
+    // Starts the IMU of every device, after start_devices, and one thread per device that moves its IMU samples
+    // into the ImuStreamWriter of the same index, the master first
+    void start_imu_threads(const std::vector<ImuStreamWriter*>& imu_writers);
+
+    void stop_imu_threads();
+
+    // One entry per device, the master first. Only counted while the reader threads run. Call from the thread
+    // calling get_synchronized_captures
+    std::vector<CaptureDeviceStats> get_device_stats() const;
+
+    // Returns an empty vector once the reader threads are stopped, or a source has no more captures. Throws
+    // CaptureError when no synchronized captures arrive for WAIT_FOR_SYNCHRONIZED_CAPTURE_TIMEOUT milliseconds
     std::vector<k4a::capture> get_synchronized_captures(const k4a_device_configuration_t& sub_config,
         bool compare_sub_depth_instead_of_color = false);
 
-    const k4a::device& get_master_device() const;
+    // Times the matching of the captures buffered by the reader threads as ProfileStage::SyncMatch
+    void set_profiler(Profiler* profiler);
+
+    const CaptureSource& get_master_source() const;
 
-    const k4a::device& get_subordinate_device_by_index(size_t i) const;
+    const CaptureSource& get_subordinate_source_by_index(size_t i) const;
 
 private:
 
+    struct DeviceReader
+    {
+        explicit DeviceReader(size_t ring_capacity) : ring(ring_capacity) {}
+
+        CaptureSource* source = nullptr;
+        SpscRing<k4a::capture> ring;
+        std::thread thread;
+        std::atomic<bool> finished = false;     // the source has no more captures
+        int64_t last_timestamp = -1;
+        std::atomic<uint64_t> captures = 0;
+        std::atomic<uint64_t> ring_drops = 0;
+        std::atomic<uint64_t> sdk_drops = 0;
+    };
+
+    void reader(DeviceReader& device_reader);
+
+    void imu_reader(CaptureSource& source, ImuStreamWriter& imu_writer);
+
+    // Matches the captures buffered by the reader threads
+    std::vector<k4a::capture> get_synchronized_captures_from_rings(const k4a_device_configuration_t& sub_config,
+        bool compare_sub_depth_instead_of_color);
+
     // Once the constuctor finishes, devices[0] will always be the master
-    k4a::device master_device;
-    std::vector<k4a::device> subordinate_devices;
+    std::unique_ptr<CaptureSource> master_source;
+    std::vector<std::unique_ptr<CaptureSource>> subordinate_sources;
+
+    std::vector<std::unique_ptr<DeviceReader>> readers;
+    std::atomic<bool> readers_running = false;
+    std::chrono::microseconds frame_period{ 0 };
+
+    std::vector<std::thread> imu_threads;
+    std::atomic<bool> imu_running = false;
+
+    // Keeps the captures that were not matched yet across calls
+    std::unique_ptr<CaptureSynchronizer> synchronizer;
+
+    Profiler* profiler = nullptr;
 };
 
 k4a_device_configuration_t get_default_config();
@@ -46,4 +127,4 @@ void log_lagging_time(const char* lagger, k4a::capture& master, k4a::capture& su
 
 void log_synced_image_time(k4a::capture& master, k4a::capture& sub);
 
-#endif MULTIDEVICECAPTURER_HPP
\ No newline at end of file
+#endif // MULTIDEVICECAPTURER_HPP
\ No newline at end of file
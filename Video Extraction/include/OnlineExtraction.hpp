@@ -9,7 +9,18 @@
 
 #include "utils.hpp"
 #include "MultiDeviceCapturer.hpp"
+#include "Pipeline.hpp"
 
-int onlineExtraction(int recording_duration, std::string base_path, int num_devices);
+// Records num_devices synchronized devices for recording_duration seconds into base_path/<device index>, with one
+// ExtractionPipeline per device
+int onlineExtraction(int recording_duration, std::string base_path, int num_devices,
+    const PipelineConfig& config = PipelineConfig());
 
-#endif ONLINEEXTRACTION_HPP
\ No newline at end of file
+// Same with other sources than the connected devices, e.g. open_playback_sources to replay a session at its frame
+// rate or open_synthetic_sources to load-test the extraction with any number of devices. base_path/<i> is the i-th
+// device after the master is picked. Recordings are expected to have the configurations of get_master_config and
+// get_subordinate_config
+int onlineExtraction(int recording_duration, std::string base_path, std::vector<std::unique_ptr<CaptureSource>> sources,
+    const PipelineConfig& config = PipelineConfig());
+
+#endif // ONLINEEXTRACTION_HPP
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef OUTPUTLAYOUT_HPP
+#define OUTPUTLAYOUT_HPP
+
+#include <iostream>
+#include <string>
+#include <filesystem>
+
+// Output tree of one recording or device, shared by every extraction:
+//
+//      <base>/depth/images, depth/raw_matrices, depth/point_clouds
+//      <base>/color/images
+//      <base>/ir/images, ir/raw_matrices
+//      <base>/geometry.json
+//
+// The paths are joined with std::filesystem, so the tree is the same on Windows and Linux
+struct OutputLayout
+{
+    explicit OutputLayout(const std::filesystem::path& base);
+
+    std::filesystem::path base;
+    std::filesystem::path depth;
+    std::filesystem::path depth_images;
+    std::filesystem::path depth_raw_matrices;
+    std::filesystem::path depth_point_clouds;
+    std::filesystem::path color;
+    std::filesystem::path color_images;
+    std::filesystem::path ir;
+    std::filesystem::path ir_images;
+    std::filesystem::path ir_raw_matrices;
+
+    // geometry.json of PipelineConfig::geometry. Empty in the layout of a time range, the recording's is written
+    // once before its ranges start
+    std::filesystem::path geometry;
+
+    // frames.k4fc of OutputMode::Container
+    std::filesystem::path container() const;
+
+    // depth/point_clouds.k4ps of PointCloudConfig::stream
+    std::filesystem::path point_cloud_stream() const;
+
+    // extraction.journal of PipelineConfig::journal
+    std::filesystem::path journal() const;
+
+    // color/head_pose.csv of HeadPoseConfig
+    std::filesystem::path head_pose() const;
+
+    // imu<extension>, e.g. imu.ndjson
+    std::filesystem::path imu(const std::string& extension) const;
+};
+
+// Create every directory of the layout. Directories that already exist are kept, with their files
+bool create_output_directories(const OutputLayout& layout);
+
+// Directory the recording at input_path is extracted into, the recording path without its extension
+std::filesystem::path get_output_path(const std::filesystem::path& input_path);
+
+// Directory of one device of a session or online extraction, base/<device index>
+std::filesystem::path get_device_output_path(const std::filesystem::path& base, size_t device_index);
+
+// Layout of one time range of a recording extracted in parallel: the images go into the folders of the layout,
+// the files that are appended to (timestamps, metadata, journal, point cloud stream, head poses) into
+// base/ranges/<range index> until they are stitched together. geometry.json is not part of it
+OutputLayout get_range_layout(const OutputLayout& layout, size_t range_index);
+
+// base/ranges, the files of every time range
+std::filesystem::path get_ranges_path(const OutputLayout& layout);
+
+#endif // OUTPUTLAYOUT_HPP
@@ -0,0 +1,457 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <map>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <semaphore>
+#include <functional>
+#include <k4a/k4a.hpp>
+#include <opencv2/highgui.hpp>
+
+#include "utils.hpp"
+#include "FramePool.hpp"
+#include "FrameTransform.hpp"
+#include "Reprojection.hpp"
+#include "RawFrameWriter.hpp"
+#include "FrameContainer.hpp"
+#include "PointCloud.hpp"
+#include "FrameLog.hpp"
+#include "ImuWriter.hpp"
+#include "Profiler.hpp"
+#include "OutputLayout.hpp"
+#include "HeadPose.hpp"
+#include "ExtractionJournal.hpp"
+
+// Where the encoded images of a recording are written
+enum class OutputMode
+{
+    Files,      // one file per image in the images and raw_matrices folders
+    Container   // every image appended to a single frames.k4fc container, see FrameContainer.hpp
+};
+
+// Encoders of the 8 bit images: the color images and the depth and IR visualizations
+enum class ImageFormat
+{
+    Jpeg,       // .jpg
+    Png,        // .png, lossless
+    Webp        // .webp, lossless with a quality above 100
+};
+
+// File extension, including the dot, of the images written with the format
+std::string image_extension(ImageFormat format);
+
+struct ImageEncoderConfig
+{
+    ImageFormat format = ImageFormat::Jpeg;
+
+    // JPEG and WebP quality, 0 to 100. 95 is the default of cv::imwrite
+    int quality = 95;
+
+    // 0 (fastest) to 9 (smallest)
+    int png_compression = 1;
+};
+
+// Camera whose geometry the depth, IR and color images are written in
+enum class ImageGeometry
+{
+    Color,  // depth and IR mapped into the color camera, at the color resolution
+    Depth   // color mapped into the depth camera, at the depth resolution. 5 times fewer pixels with 1080P color
+};
+
+// Name of the geometry in geometry.json, "color" or "depth"
+std::string image_geometry_name(ImageGeometry geometry);
+
+// Writes geometry.json at path, the camera of the calibration whose geometry the images are written in and its
+// intrinsics. False if the file could not be written
+bool write_geometry(const std::filesystem::path& path, const k4a::calibration& calibration, ImageGeometry geometry);
+
+// Outputs written for every capture. A stream that is not written is neither transformed, decoded nor encoded,
+// and gets no timestamps.txt and metadata.csv. Point clouds and IMU samples are enabled by PipelineConfig
+struct StreamConfig
+{
+    bool color = true;          // color/images
+    bool depth_images = true;   // depth/images, the depth scaled to 8 bits
+    bool depth_raw = true;      // depth/raw_matrices
+    bool ir_images = true;      // ir/images, the IR scaled to 8 bits
+    bool ir_raw = true;         // ir/raw_matrices
+};
+
+// Thread counts and queue depths of the extraction pipeline
+struct PipelineConfig
+{
+    // Captures waiting for the transformation stage and encoded frames waiting for the writer
+    size_t queue_depth = 8;
+
+    // Threads running the MJPG decode and the depth/IR transformations, each with its own k4a::transformation
+    unsigned int transform_threads = 2;
+
+    // Implementation of the depth/IR transformations, and of the color transformation with ImageGeometry::Depth.
+    // DepthTransform::Table falls back to the SDK when the reprojection table of the calibration does not match
+    // convert_3d_to_2d
+    DepthTransform depth_transform = DepthTransform::Sdk;
+
+    // Geometry the images and point clouds are aligned in, recorded in geometry.json. With ImageGeometry::Depth
+    // depth and IR are written as captured and the color images are decoded, mapped into the depth camera and
+    // encoded again, so color_passthrough does not apply
+    ImageGeometry geometry = ImageGeometry::Color;
+
+    // Threads of the worker pool encoding the images
+    unsigned int encode_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Codec of the depth and IR raw_matrices
+    RawCodecConfig raw_codec;
+
+    StreamConfig streams;
+
+    ImageEncoderConfig color_encoder;
+    ImageEncoderConfig depth_ir_encoder;
+
+    // Depth in millimeters and IR value drawn white in depth/images and ir/images. 3860 mm is the max range of the
+    // depth sensor with NFOV_UNBINNED, 1000 the max range of the IR sensor
+    double depth_image_max_mm = 3860.0;
+    double ir_image_max = 1000.0;
+
+    // Save MJPG color images as recorded instead of decoding and encoding them again, when color_encoder is JPEG.
+    // The color images are still decoded when a later stage needs the pixels, e.g. for point cloud colors
+    bool color_passthrough = true;
+
+    OutputMode output_mode = OutputMode::Files;
+
+    // Keep extraction.journal in the output directory, see ExtractionJournal.hpp. With OutputMode::Files the
+    // pipeline resumes from its last checkpoint: the files it appends to are cut back to the checkpoint and
+    // get_resume_checkpoint tells the reader where to continue. With OutputMode::Container the journal has no
+    // checkpoints, the container of an interrupted extraction cannot be resumed
+    bool journal = false;
+
+    // Write a point cloud of every transformed depth image into depth/point_clouds
+    bool point_clouds = false;
+
+    // Format and attributes of the point clouds. With OutputMode::Container the point clouds are container
+    // streams and PointCloudConfig::stream is ignored
+    PointCloudConfig point_cloud;
+
+    // Format of the IMU samples of recordings, and whether they are read while the frames are extracted
+    ImuConfig imu;
+
+    // Time ranges playbackExtraction splits a recording into, each read by its own playback handle with its own
+    // transform threads and writer. The ranges share the encode pool. Ignored with OutputMode::Container
+    unsigned int playback_ranges = 1;
+
+    // Head orientation of the faces in the color images, see HeadPose.hpp
+    HeadPoseConfig head_pose;
+
+    // Time the stages of the extraction, see Profiler.hpp
+    ProfileConfig profile;
+
+    // Print the progress bar while writing. Disabled when several recordings share the console
+    bool show_progress = true;
+};
+
+// Frames and bytes written by a pipeline
+struct ExtractionStats
+{
+    uint64_t frames = 0;
+    uint64_t bytes_written = 0;
+    double seconds = 0.0;
+};
+
+// Fixed capacity FIFO shared between two pipeline stages. push blocks while the queue is full, which gives
+// the back-pressure that keeps a fast producer from buffering a whole recording in memory.
+template <typename T>
+class BoundedQueue
+{
+public:
+
+    explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    // Blocks while the queue is full. Returns false if the queue was closed
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity || closed; });
+        if (closed)
+        {
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty. Returns false once the queue is closed and drained
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty())
+        {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    // Wakes up every waiting thread. Items already queued can still be popped
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+
+    size_t capacity;
+    bool closed = false;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+// Counts tasks in flight so a stage can wait for everything it submitted to the worker pool
+class WaitGroup
+{
+public:
+
+    void add(size_t count = 1);
+
+    void done();
+
+    void wait();
+
+private:
+
+    size_t pending = 0;
+    std::mutex mutex;
+    std::condition_variable all_done;
+};
+
+// Fixed set of threads executing submitted tasks in FIFO order
+class WorkerPool
+{
+public:
+
+    WorkerPool(unsigned int num_threads, size_t queue_depth);
+
+    ~WorkerPool();
+
+    // Blocks while the task queue is full
+    void submit(std::function<void()> task);
+
+    unsigned int size() const;
+
+private:
+
+    BoundedQueue<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+};
+
+// Resources shared by the pipelines of recordings extracted at the same time. A pipeline creates its own
+// encode pool when none is given, and writes without limit when io_slots is null.
+struct PipelineResources
+{
+    WorkerPool* encode_pool = nullptr;
+
+    // Each writer thread holds one slot while saving the files of a frame
+    std::counting_semaphore<>* io_slots = nullptr;
+
+    // Collects the stage durations of the pipelines, nothing is timed when null
+    Profiler* profiler = nullptr;
+
+    // Batches the face crops of every pipeline with HeadPoseConfig::enabled. A pipeline opens its own when null
+    HeadPoseEstimator* head_pose = nullptr;
+};
+
+// Encode pool, profiler and head pose model owned for the pipelines of one extraction, see open_shared_resources
+struct SharedPipelineResources
+{
+    // Points at the objects below, or at the ones handed in to open_shared_resources
+    PipelineResources resources;
+
+    std::unique_ptr<WorkerPool> encode_pool;
+    std::unique_ptr<Profiler> profiler;
+    std::unique_ptr<HeadPoseEstimator> head_pose;
+};
+
+// Fills in what given leaves null: an encode pool, a profiler with ProfileConfig::enabled and a head pose model with
+// HeadPoseConfig::enabled, so the pipelines of the devices or time ranges share them and their faces fill the same
+// batches. False, after printing the reason, if the head pose model cannot be loaded
+bool open_shared_resources(const PipelineConfig& config, SharedPipelineResources& shared,
+    const PipelineResources& given = PipelineResources());
+
+// Encoded image and the file or container stream it is written to
+struct EncodedFile
+{
+    std::string stream;         // container stream, e.g. "depth/raw_matrices.png"
+    std::string path;           // file in the output tree
+    int64_t timestamp = 0;
+    std::vector<uchar> buffer;
+};
+
+// Images of one capture as they travel through the pipeline. index is the order in which the capture was
+// pushed, so the writer can emit the timestamps in recording order even though frames are encoded out of order.
+// With color passthrough color_image is kept until encoding and color_image_opencv stays empty.
+struct PipelineFrame
+{
+    uint64_t index = 0;
+
+    k4a::image depth_image;
+    k4a::image color_image;
+    k4a::image ir_image;
+
+    // Pooled images the matrices below point into
+    k4a::image transformed_depth_image;
+    k4a::image transformed_ir_image;
+    k4a::image color_image_backing;
+
+    int64_t depth_image_timestamp = 0;
+    int64_t color_image_timestamp = 0;
+    int64_t ir_image_timestamp = 0;
+
+    // Read when the capture is pushed, the host timestamp is the time of the push
+    FrameMetadata depth_metadata;
+    FrameMetadata color_metadata;
+    FrameMetadata ir_metadata;
+
+    cv::Mat depth_image_opencv;
+    cv::Mat color_image_opencv;
+    cv::Mat ir_image_opencv;
+
+    std::vector<EncodedFile> files;
+
+    // Encoded point cloud waiting to be appended to the point cloud stream in capture order
+    std::vector<uchar> point_cloud_stream_buffer;
+
+    // Faces of the color image, completed by the head pose estimator while the frame waits for the writer
+    std::future<std::vector<HeadPose>> head_poses;
+};
+
+// Extracts captures of one recording into the output tree with four stages connected by bounded queues:
+//
+//      push() (capture reading) -> transform threads -> encode worker pool -> writer thread
+//
+// The transform threads decode the color image and map depth and IR into the color camera, or the color image
+// into the depth camera with ImageGeometry::Depth. The worker pool
+// encodes the images into memory, and the writer thread saves them and appends the timestamps in the order
+// the captures were pushed. The files are identical to the ones written by encoding each image with cv::imwrite,
+// except for the MJPG color images saved as recorded with PipelineConfig::color_passthrough.
+// With OutputMode::Container the images are appended to a single container in capture order instead.
+class ExtractionPipeline
+{
+public:
+
+    ExtractionPipeline(const k4a::calibration& calibration, const std::string& base_path,
+        const PipelineConfig& config = PipelineConfig(), double recording_length = 0.0,
+        const PipelineResources& resources = PipelineResources());
+
+    // Writes into the folders of the layout, which need not share one base directory, see get_range_layout
+    ExtractionPipeline(const k4a::calibration& calibration, const OutputLayout& layout,
+        const PipelineConfig& config = PipelineConfig(), double recording_length = 0.0,
+        const PipelineResources& resources = PipelineResources());
+
+    ~ExtractionPipeline();
+
+    // False if one of the timestamp or metadata files or geometry.json could not be opened
+    bool is_open() const;
+
+    // Captures without depth, color or IR image are skipped. Blocks while the pipeline is full
+    bool push(const k4a::capture& capture);
+
+    // Waits until every pushed capture has been written
+    void finish();
+
+    // Frames and bytes written so far. seconds is left to the caller
+    ExtractionStats get_stats() const;
+
+    FramePoolStats get_frame_pool_stats() const;
+
+    // Checkpoint of the interrupted extraction this pipeline continues, frames = 0 when it starts from the
+    // beginning. The captures up to its color timestamp are already extracted
+    JournalCheckpoint get_resume_checkpoint() const;
+
+private:
+
+    // Cuts the appended files back to the last checkpoint of the journal and starts a new journal from it
+    void open_journal();
+
+    // Flushes the appended files and records their sizes, called by the writer thread
+    void write_checkpoint();
+
+    void transform_worker();
+
+    bool needs_color_pixels() const;
+
+    bool needs_ir_pixels() const;
+
+    // True if an output of the stream is written, for the depth including the point clouds
+    bool writes_depth() const;
+    bool writes_ir() const;
+
+    void encode_frame(PipelineFrame& frame);
+
+    void add_file(PipelineFrame& frame, const std::string& stream, const std::filesystem::path& directory,
+        int64_t timestamp, const std::string& extension, std::vector<uchar>& buffer);
+
+    void write_files(PipelineFrame& frame);
+
+    void writer();
+
+    k4a::calibration calibration;
+    PipelineConfig config;
+    double recording_length;
+
+    OutputLayout layout;
+
+    FrameLog depth_log;
+    FrameLog color_log;
+    FrameLog ir_log;
+    HeadPoseLog head_pose_log;
+    ExtractionJournal journal;
+    FrameContainerWriter container;
+    PointCloudStreamWriter point_cloud_stream;
+    FramePool frame_pool;
+    std::shared_ptr<const XYTable> xy_table;
+    std::shared_ptr<const ReprojectionTable> reprojection_table;
+
+    // Files the pipeline appends to, relative to the output directory
+    std::vector<std::string> appended_files;
+    JournalCheckpoint resume_checkpoint;
+    JournalCheckpoint checkpoint;
+    uint64_t frames_since_checkpoint = 0;
+    std::chrono::steady_clock::time_point last_checkpoint;
+
+    bool geometry_written = false;
+
+    uint64_t next_index = 0;
+    bool finished = false;
+    std::atomic<uint64_t> frames_written = 0;
+    std::atomic<uint64_t> bytes_written = 0;
+
+    BoundedQueue<PipelineFrame> capture_queue;
+    BoundedQueue<PipelineFrame> write_queue;
+    std::unique_ptr<WorkerPool> own_encode_pool;
+    WorkerPool* encode_pool;
+    std::counting_semaphore<>* io_slots;
+    Profiler* profiler;
+    std::unique_ptr<HeadPoseEstimator> own_head_pose;
+    HeadPoseEstimator* head_pose;
+    WaitGroup encode_tasks;
+    std::vector<std::thread> transform_threads;
+    std::thread writer_thread;
+};
+
+#endif // PIPELINE_HPP
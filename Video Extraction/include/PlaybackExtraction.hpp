@@ -7,10 +7,21 @@
 #include <k4a/k4a.hpp>
 #include <k4arecord/playback.hpp>
 #include <opencv2/highgui.hpp>
-#include <nlohmann/json.hpp>
+#include <thread>
+#include <set>
+#include <limits>
 
 #include "utils.hpp"
+#include "Pipeline.hpp"
+#include "ImuWriter.hpp"
+#include "OutputLayout.hpp"
+#include "ExtractionJournal.hpp"
 
-int playbackExtraction(std::string input_path);
+// Extracts the recording into the folder of its name. The folder's extraction.journal makes a second run skip a
+// finished extraction and continue an interrupted one from its last checkpoint, see PipelineConfig::journal.
+// With PipelineConfig::playback_ranges above 1 the recording is split into time ranges, each read by its own
+// playback handle and pipeline, whose timestamps and metadata are stitched in order at the end
+int playbackExtraction(std::string input_path, const PipelineConfig& config = PipelineConfig(),
+    const PipelineResources& resources = PipelineResources(), ExtractionStats* stats = nullptr);
 
-#endif PLAYBACKEXTRACTION_HPP
\ No newline at end of file
+#endif // PLAYBACKEXTRACTION_HPP
\ No newline at end of file
@@ -0,0 +1,142 @@
+#ifndef POINTCLOUD_HPP
+#define POINTCLOUD_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <k4a/k4a.hpp>
+#include <opencv2/core.hpp>
+
+// File formats of the point clouds. Every binary format is little endian
+enum class PointCloudFormat
+{
+    AsciiPly,   // .ply, one line of text per point, for debugging
+    BinaryPly,  // .ply, binary_little_endian 1.0
+    Bin,        // .bin, the binary ply records without header: float32 x y z [uint8 red green blue] [uint16 ir]
+    Pcd         // .pcd, PCL binary format, color packed into one uint32 rgb field
+};
+
+struct PointCloudConfig
+{
+    PointCloudFormat format = PointCloudFormat::BinaryPly;
+
+    // Add the color and IR value of the pixel of every point, from the images aligned with the depth image
+    bool color = false;
+    bool ir = false;
+
+    // Append the point clouds of all frames to depth/point_clouds.k4ps instead of writing one file per frame,
+    // see PointCloudStreamWriter
+    bool stream = false;
+};
+
+// Lookup table of x- and y-scale factors for every pixel of a camera. The factors are kept in separate arrays
+// (structure of arrays) so the point cloud kernel vectorizes. Pixels without a valid ray have a zero mask and
+// zero factors, so the NaN checks are done once when the table is built instead of for every frame.
+struct XYTable
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<uint8_t> valid;
+};
+
+// Valid points of a depth image, in millimeters. pixel_index is the index of the depth pixel each point comes
+// from, to look up attributes such as color in images aligned with the depth image.
+struct PointCloud
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<uint32_t> pixel_index;
+
+    // Optional attributes, empty unless added by add_point_attributes
+    std::vector<uint8_t> red;
+    std::vector<uint8_t> green;
+    std::vector<uint8_t> blue;
+    std::vector<uint16_t> ir;
+    bool has_color = false;
+    bool has_ir = false;
+
+    size_t size() const;
+
+    // Resizes the coordinates and drops the attributes
+    void resize(size_t point_count);
+};
+
+// Appends the point clouds of a recording to one file. Every frame is written as
+//
+//      "K4PF" int64 timestamp_usec uint64 size     frame header
+//      point cloud of the frame                    size bytes, encoded with encode_point_cloud
+//
+// so a stream cut short by an interrupted extraction can be read up to its last complete frame.
+class PointCloudStreamWriter
+{
+public:
+
+    // append continues an existing stream instead of replacing it
+    bool open(const std::string& path, bool append = false);
+
+    bool append(int64_t timestamp_usec, const std::vector<uchar>& encoded_point_cloud);
+
+    void flush();
+
+    void close();
+
+    bool is_open() const;
+
+private:
+
+    std::ofstream file;
+};
+
+// Reads the frames of a point cloud stream in order
+class PointCloudStreamReader
+{
+public:
+
+    bool open(const std::string& path);
+
+    // False at the end of the stream or at an incomplete frame
+    bool next(int64_t& timestamp_usec, std::vector<uchar>& encoded_point_cloud);
+
+private:
+
+    std::ifstream file;
+};
+
+// Precomputes the lookup table of a camera with one convert_2d_to_3d call per pixel
+XYTable create_xy_table(const k4a::calibration& calibration, k4a_calibration_type_t camera);
+
+// The table of the calibration and camera, computed on first use and cached afterwards
+std::shared_ptr<const XYTable> get_xy_table(const k4a::calibration& calibration, k4a_calibration_type_t camera);
+
+// 3d coordinates of the valid pixels of a DEPTH16 image with the resolution of the table. With parallel the rows
+// are split among the OpenCV threads, callers already running one frame per thread should pass false.
+bool generate_point_cloud(const k4a::image& depth_image, const XYTable& xy_table, PointCloud& point_cloud,
+    bool parallel = true);
+
+// Copies the color (CV_8UC3 or CV_8UC4, BGR order) and IR (CV_16UC1) values of every point from images aligned
+// with the depth image the point cloud was generated from. Empty matrices are skipped
+void add_point_attributes(PointCloud& point_cloud, const cv::Mat& color_image, const cv::Mat& ir_image);
+
+// File extension, including the dot, of the point clouds written in the format
+std::string point_cloud_extension(PointCloudFormat format);
+
+// File contents of the point cloud in the format, with the attributes the point cloud has
+void encode_point_cloud(const PointCloud& point_cloud, PointCloudFormat format, std::vector<uchar>& buffer);
+
+// Create point cloud file, written with a single write
+bool write_point_cloud(const std::string& file_name, const PointCloud& point_cloud,
+    PointCloudFormat format = PointCloudFormat::BinaryPly);
+
+#endif // POINTCLOUD_HPP
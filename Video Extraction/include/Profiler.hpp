@@ -0,0 +1,152 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <cstdio>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// Stages timed during an extraction
+enum class ProfileStage
+{
+    CaptureRead,        // get_next_capture of the playback
+    PipelinePush,       // reader blocked on a full pipeline, the back-pressure of the later stages
+    ColorDecode,        // MJPG, NV12 or YUY2 color image to cv::Mat
+    DepthIrTransform,   // depth and IR into the color camera, one fused call
+    ColorTransform,     // color into the depth camera with ImageGeometry::Depth
+    PointCloud,         // point cloud generation and encoding
+    RawEncode,          // depth and IR raw_matrices
+    JpegEncode,         // every cv::imencode
+    FileWrite,          // every file written, or the frame appended to the container
+    TimestampWrite,     // timestamps.txt and metadata.csv of a frame
+    SyncMatch,          // matching synchronized captures of several devices
+    FaceDetect,         // face detection and crops of the head pose estimation
+    HeadPoseInference,  // one batch through the head pose model
+    Count
+};
+
+// Name of the stage in the summary and the trace, e.g. "depth_ir_transform"
+const char* profile_stage_name(ProfileStage stage);
+
+struct ProfileConfig
+{
+    // Time every stage and write profile.json into the output directory
+    bool enabled = false;
+
+    // Also write every timed interval to profile_trace.json, which chrome://tracing and https://ui.perfetto.dev
+    // open. Needs memory for every interval, up to PROFILER_MAX_TRACE_EVENTS
+    bool trace = false;
+};
+
+// Intervals kept for the trace, about 24 MB. Later intervals are only counted in the histograms
+constexpr size_t PROFILER_MAX_TRACE_EVENTS = 1000000;
+
+// Sub-buckets per power of two of the histograms, the percentiles are within 1/16 of the true value
+constexpr size_t PROFILER_SUB_BUCKETS = 16;
+constexpr size_t PROFILER_BUCKETS = 40 * PROFILER_SUB_BUCKETS;
+
+// Durations of one stage
+struct StageSummary
+{
+    uint64_t count = 0;
+    double total_ms = 0.0;
+    double mean_us = 0.0;
+    double p50_us = 0.0;
+    double p95_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+// Collects the durations of the stages of one or several pipelines from any number of threads. Every duration
+// goes into a log-scaled histogram of the stage with a few atomic increments, no lock is taken unless the trace
+// is enabled. The durations are rounded down to whole microseconds.
+class Profiler
+{
+public:
+
+    explicit Profiler(bool trace = false);
+
+    void record(ProfileStage stage, std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end);
+
+    // Output of the extraction, for the frames/s and MB/s of the summary
+    void add_output(uint64_t frames, uint64_t bytes);
+
+    StageSummary get_stage_summary(ProfileStage stage) const;
+
+    double get_elapsed_seconds() const;
+
+    // Stage durations, frames/s and MB/s since the profiler was created
+    bool write_summary(const std::string& path) const;
+
+    // Chrome trace event format, one complete event per interval and one row per thread
+    bool write_trace(const std::string& path) const;
+
+    void print_summary() const;
+
+private:
+
+    struct StageHistogram
+    {
+        std::array<std::atomic<uint64_t>, PROFILER_BUCKETS> buckets{};
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> total_usec = 0;
+        std::atomic<uint64_t> max_usec = 0;
+    };
+
+    struct TraceEvent
+    {
+        ProfileStage stage;
+        uint32_t thread;
+        int64_t start_usec;
+        int64_t duration_usec;
+    };
+
+    static size_t bucket_index(uint64_t usec);
+    static uint64_t bucket_lower_bound(size_t index);
+    double percentile(const StageHistogram& histogram, double fraction) const;
+
+    std::chrono::steady_clock::time_point start_time;
+    bool trace;
+    std::array<StageHistogram, (size_t)ProfileStage::Count> stages;
+    std::atomic<uint64_t> frames = 0;
+    std::atomic<uint64_t> bytes = 0;
+
+    mutable std::mutex trace_mutex;
+    std::vector<TraceEvent> trace_events;
+};
+
+// Prints the summary and writes profile.json, and profile_trace.json with trace, into directory
+void write_profile(const Profiler& profiler, const std::string& directory, bool trace);
+
+// Times the scope it lives in as one interval of a stage. Does nothing, not even read the clock, without a
+// profiler
+class ScopedTimer
+{
+public:
+
+    ScopedTimer(Profiler* profiler, ProfileStage stage);
+
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+
+    Profiler* profiler;
+    ProfileStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // PROFILER_HPP
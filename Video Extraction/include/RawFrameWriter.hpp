@@ -0,0 +1,58 @@
+#ifndef RAWFRAMEWRITER_HPP
+#define RAWFRAMEWRITER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <zstd.h>
+#include <opencv2/highgui.hpp>
+
+// Lossless codecs for the 16 bit depth (millimeters) and IR matrices
+enum class RawCodec
+{
+    Uncompressed,   // .raw: header followed by the pixels
+    Png,            // .png: 16 bit grayscale PNG, readable with cv::imread(path, cv::IMREAD_ANYDEPTH)
+    DeltaZstd       // .rawz: header followed by the zstd compressed row deltas, split in low and high bytes
+};
+
+struct RawCodecConfig
+{
+    RawCodec codec = RawCodec::Png;
+
+    // 0 (fastest) to 9 (smallest)
+    int png_compression = 1;
+
+    // 1 (fastest) to 19 (smallest)
+    int zstd_level = 1;
+};
+
+// Header of the .raw and .rawz files. All fields are little endian
+struct RawFrameHeader
+{
+    char magic[4];      // "K4RF"
+    uint32_t codec;     // RawCodec
+    uint32_t width;
+    uint32_t height;
+};
+
+// File extension, including the dot, of the files written with the codec
+std::string raw_frame_extension(RawCodec codec);
+
+// Encode a CV_16UC1 matrix into buffer. Returns false if the matrix has another type
+bool encode_raw_frame(const cv::Mat& frame, const RawCodecConfig& config, std::vector<uchar>& buffer);
+
+// Decode a buffer written by encode_raw_frame with any codec. Returns an empty matrix on failure
+cv::Mat decode_raw_frame(const std::vector<uchar>& buffer);
+
+bool write_raw_frame(const std::string& path, const cv::Mat& frame, const RawCodecConfig& config);
+
+cv::Mat read_raw_frame(const std::string& path);
+
+// Print encode/decode speed and size of every codec for the given frame
+void benchmarkRawCodecs(const cv::Mat& frame, int iterations = 10);
+
+#endif // RAWFRAMEWRITER_HPP
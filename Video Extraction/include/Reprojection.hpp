@@ -0,0 +1,115 @@
+#ifndef REPROJECTION_HPP
+#define REPROJECTION_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <k4a/k4a.hpp>
+#include <opencv2/core.hpp>
+
+#include "FramePool.hpp"
+#include "FrameTransform.hpp"
+#include "PointCloud.hpp"
+
+// Largest distance in color pixels between the projection of the table and convert_3d_to_2d, over the depth
+// pixels sampled when the table is built, for the table to be used. Above it the calibration has a lens model
+// the table does not reproduce and the pipeline keeps depth_image_to_color_camera
+constexpr float REPROJECTION_MAX_ERROR_PIXELS = 0.05f;
+
+// Which implementation maps depth and IR into the color camera
+enum class DepthTransform
+{
+    Sdk,    // k4a::transformation, see FrameTransform.hpp
+    Table   // the reprojection table of the calibration, see ReprojectionTable
+};
+
+// Precomputed depth to color reprojection of one calibration. The color camera point of a depth pixel with depth d
+// is d * ray + translation, so a frame only needs the color camera projection of every pixel and no unprojection.
+// The rays and the footprints are kept in separate arrays (structure of arrays) so the projection vectorizes.
+//
+// Every depth pixel is splatted onto the color pixels whose centers lie in its footprint, the box around its
+// projection that the depth pixel covers in the color image. Where several depth pixels land on the same color
+// pixel the nearest one is kept, like depth_image_to_color_camera does.
+struct ReprojectionTable
+{
+    int depth_width = 0;
+    int depth_height = 0;
+    int color_width = 0;
+    int color_height = 0;
+
+    // Ray of every depth pixel, z = 1 in the depth camera, rotated into the color camera
+    std::vector<float> ray_x;
+    std::vector<float> ray_y;
+    std::vector<float> ray_z;
+
+    // Half width and height of the footprint in color pixels
+    std::vector<float> half_width;
+    std::vector<float> half_height;
+
+    // Zero for depth pixels without a valid ray
+    std::vector<uint8_t> valid;
+
+    // Depth camera origin in the color camera, in millimeters
+    float translation[3] = {};
+
+    // Brown-Conrady intrinsics of the color camera as k4a_calibration_intrinsic_parameters_t has them
+    float cx = 0.f, cy = 0.f, fx = 0.f, fy = 0.f;
+    float k1 = 0.f, k2 = 0.f, k3 = 0.f, k4 = 0.f, k5 = 0.f, k6 = 0.f;
+    float codx = 0.f, cody = 0.f, p1 = 0.f, p2 = 0.f;
+
+    // 2 with K4A_CALIBRATION_LENS_DISTORTION_MODEL_BROWN_CONRADY, 1 with RATIONAL_6KT
+    float tangential_scale = 2.f;
+
+    // Square of the metric radius beyond which the lens model is not valid, infinite without one
+    float max_radius_squared = std::numeric_limits<float>::infinity();
+
+    // See REPROJECTION_MAX_ERROR_PIXELS
+    float max_projection_error = 0.f;
+
+    bool usable() const;
+};
+
+// Builds the table of a calibration from the depth camera rays of get_xy_table. The projection is checked against
+// convert_3d_to_2d on a grid of depth pixels at several depths
+ReprojectionTable create_reprojection_table(const k4a::calibration& calibration);
+
+// The table of the calibration, computed on first use and cached afterwards
+std::shared_ptr<const ReprojectionTable> get_reprojection_table(const k4a::calibration& calibration);
+
+// Maps depth, and IR unless ir_image is invalid, into the color camera geometry in one pass. The transformed depth
+// is the z coordinate in the color camera like with depth_image_to_color_camera, color pixels no depth pixel
+// lands on are 0. The output images come from the pool. With parallel the depth rows are split among the OpenCV
+// threads, callers already running one frame per thread should pass false.
+bool reproject_depth_and_ir(
+    const ReprojectionTable& table,
+    const k4a::image& depth_image,
+    const k4a::image& ir_image,
+    FramePool& pool,
+    k4a::image& transformed_depth_image,
+    k4a::image& transformed_ir_image,
+    bool parallel = true);
+
+// Maps the color image (CV_8UC3 or CV_8UC4) into the depth camera geometry, the counterpart of
+// color_image_to_depth_camera: every depth pixel takes the color, interpolated bilinearly, at the projection of its
+// depth. Depth pixels without depth or outside the color image are 0. The output has the resolution of the depth
+// image and the type of color_image, backing owns its pooled buffer. Empty if the resolutions do not match the table
+cv::Mat reproject_color(
+    const ReprojectionTable& table,
+    const k4a::image& depth_image,
+    const cv::Mat& color_image,
+    FramePool& pool,
+    k4a::image& backing);
+
+// Time depth_image_to_color_camera_custom against the reprojection table for a capture, and compare their
+// transformed depth: the pixels only one of them fills and the depth difference where both do
+void benchmarkReprojection(const k4a::calibration& calibration, const k4a::capture& capture, int iterations = 20);
+
+#endif // REPROJECTION_HPP
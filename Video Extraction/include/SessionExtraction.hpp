@@ -0,0 +1,29 @@
+#ifndef SESSIONEXTRACTION_HPP
+#define SESSIONEXTRACTION_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <filesystem>
+#include <k4a/k4a.hpp>
+#include <k4arecord/playback.hpp>
+
+#include "utils.hpp"
+#include "Pipeline.hpp"
+#include "CaptureSynchronizer.hpp"
+#include "PlaybackExtraction.hpp"
+
+// Captures read ahead from every recording of a session
+constexpr size_t SESSION_READ_AHEAD = 16;
+
+// Extracts the recordings of one session, made on several devices with k4arecorder --external-sync, into the
+// tree onlineExtraction writes: base_path/<device index>, index 0 being the master. The captures are matched by
+// device timestamp and subordinate_delay_off_master_usec, and only synchronized sets are extracted. Every set is
+// listed in base_path/sync_index.csv with the color and depth timestamps of every device, which name its files.
+int sessionExtraction(const std::vector<std::string>& input_paths, const std::string& base_path,
+    const PipelineConfig& config = PipelineConfig());
+
+#endif // SESSIONEXTRACTION_HPP
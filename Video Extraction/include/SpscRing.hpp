@@ -0,0 +1,70 @@
+#ifndef SPSCRING_HPP
+#define SPSCRING_HPP
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// Fixed capacity ring buffer between exactly one producer and one consumer thread. Neither side ever blocks or
+// takes a lock: try_push fails when the ring is full and try_pop when it is empty, the caller decides whether to
+// drop, retry or wait.
+template <typename T>
+class SpscRing
+{
+public:
+
+    // One slot stays empty to tell a full ring from an empty one
+    explicit SpscRing(size_t capacity) : slots(capacity + 1) {}
+
+    // Producer only. Returns false if the ring is full
+    bool try_push(T item)
+    {
+        size_t tail = tail_index.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % slots.size();
+        if (next == head_index.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        slots[tail] = std::move(item);
+        tail_index.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the ring is empty
+    bool try_pop(T& item)
+    {
+        size_t head = head_index.load(std::memory_order_relaxed);
+        if (head == tail_index.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = std::move(slots[head]);
+        // Release what the slot holds now rather than when it is overwritten, e.g. the memory of a k4a::capture
+        slots[head] = T();
+        head_index.store((head + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called while the other thread is active
+    size_t size() const
+    {
+        size_t head = head_index.load(std::memory_order_acquire);
+        size_t tail = tail_index.load(std::memory_order_acquire);
+        return (tail + slots.size() - head) % slots.size();
+    }
+
+    size_t capacity() const
+    {
+        return slots.size() - 1;
+    }
+
+private:
+
+    std::vector<T> slots;
+
+    // On separate cache lines, so the producer and the consumer do not invalidate each other's index
+    alignas(64) std::atomic<size_t> head_index = 0;
+    alignas(64) std::atomic<size_t> tail_index = 0;
+};
+
+#endif // SPSCRING_HPP
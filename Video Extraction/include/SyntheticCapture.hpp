@@ -0,0 +1,88 @@
+#ifndef SYNTHETICCAPTURE_HPP
+#define SYNTHETICCAPTURE_HPP
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <k4a/k4a.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+// Different scenes a generator renders, the captures cycle through them
+constexpr size_t SYNTHETIC_SCENE_COUNT = 8;
+
+struct SyntheticCaptureConfig
+{
+    // K4A_IMAGE_FORMAT_COLOR_MJPG or K4A_IMAGE_FORMAT_COLOR_BGRA32
+    k4a_image_format_t color_format = K4A_IMAGE_FORMAT_COLOR_MJPG;
+    k4a_color_resolution_t color_resolution = K4A_COLOR_RESOLUTION_1080P;
+    k4a_depth_mode_t depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED;
+
+    // Spacing of the device timestamps
+    k4a_fps_t camera_fps = K4A_FRAMES_PER_SECOND_30;
+
+    // Device timestamp of the color image of the first frame. Devices start counting a little before it
+    std::chrono::microseconds start_timestamp{ 200000 };
+
+    // Depth and IR timestamps relative to the color timestamp, as k4a_device_configuration_t sets them
+    int32_t depth_delay_off_color_usec = 0;
+
+    int jpeg_quality = 90;
+};
+
+// Width and height of the images of a mode, 0 x 0 when off
+void get_color_resolution_size(k4a_color_resolution_t resolution, int& width, int& height);
+void get_depth_mode_size(k4a_depth_mode_t depth_mode, int& width, int& height);
+
+std::chrono::microseconds get_frame_period(k4a_fps_t camera_fps);
+
+// Calibration of an ideal device: pinhole cameras without distortion with about the fields of view of the Azure
+// Kinect, the color camera 32 mm beside the depth camera. k4a::transformation accepts it like a device calibration
+k4a::calibration create_synthetic_calibration(k4a_depth_mode_t depth_mode, k4a_color_resolution_t color_resolution);
+
+// Produces captures with color, DEPTH16 and IR16 images like a device would, without one. The scene is a tilted
+// wall with a sphere moving in front of it, with invalid depth pixels in the corners as in the NFOV modes. The
+// scenes are rendered, and the color images encoded, once in the constructor, so next_capture only copies them
+// into new images. Every capture owns its images and has the device timestamps of the next frame.
+class SyntheticCaptureGenerator
+{
+public:
+
+    explicit SyntheticCaptureGenerator(const SyntheticCaptureConfig& config = SyntheticCaptureConfig());
+
+    const k4a::calibration& get_calibration() const;
+
+    const SyntheticCaptureConfig& get_config() const;
+
+    k4a::capture next_capture();
+
+    // Leaves out the next frames, as a device dropping them would
+    void skip(uint64_t frames);
+
+    // Frames returned or skipped so far
+    uint64_t get_frame_count() const;
+
+private:
+
+    struct Scene
+    {
+        std::vector<uint8_t> color;
+        std::vector<uint16_t> depth;
+        std::vector<uint16_t> ir;
+    };
+
+    SyntheticCaptureConfig config;
+    k4a::calibration calibration;
+    int color_width = 0;
+    int color_height = 0;
+    int depth_width = 0;
+    int depth_height = 0;
+    std::chrono::microseconds frame_period;
+    std::vector<Scene> scenes;
+    uint64_t frame_count = 0;
+};
+
+#endif // SYNTHETICCAPTURE_HPP
@@ -0,0 +1,166 @@
+#include "../include/BatchExtraction.hpp"
+
+namespace fs = std::filesystem;
+
+// Print frame and byte throughput of an extraction
+static void printThroughput(const std::string& name, const ExtractionStats& stats)
+{
+    double seconds = std::max(stats.seconds, 1e-9);
+    std::cout << name << ": " << stats.frames << " frames, " << stats.bytes_written / 1e6 << " MB in "
+        << stats.seconds << " seconds (" << stats.frames / seconds << " frames/s, "
+        << stats.bytes_written / 1e6 / seconds << " MB/s)" << std::endl;
+}
+
+// Extract several recordings at the same time. All recordings share one encode worker pool and a fixed number
+// of writer slots, so a short recording finishing early hands its cores to the ones still running.
+//
+// The manifest gets a "started <path>" line before and a "done <path>" line after each recording. When a batch
+// is restarted, recordings marked as done are skipped and recordings that were started but not finished continue
+// from the last checkpoint of their extraction.journal, see playbackExtraction.
+int batchExtraction(const std::vector<std::string>& input_paths, const BatchConfig& config)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::set<std::string> started_paths;
+    std::set<std::string> completed_paths;
+    std::ofstream manifest_file;
+    if (!config.manifest_path.empty())
+    {
+        std::ifstream manifest_in(config.manifest_path);
+        for (std::string line; std::getline(manifest_in, line); )
+        {
+            if (line.rfind("started ", 0) == 0)
+            {
+                started_paths.insert(line.substr(8));
+            }
+            else if (line.rfind("done ", 0) == 0)
+            {
+                completed_paths.insert(line.substr(5));
+            }
+        }
+        manifest_in.close();
+
+        manifest_file.open(config.manifest_path, std::ios::app);
+        if (!manifest_file.is_open()) {
+            std::cerr << "Error opening file: " << config.manifest_path << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> pending_paths;
+    for (const std::string& input_path : input_paths)
+    {
+        if (input_path.empty())
+        {
+            continue;
+        }
+        if (completed_paths.count(input_path))
+        {
+            std::cout << "Skipping " << input_path << ", already extracted." << std::endl;
+            continue;
+        }
+        // Interrupted extractions with a journal are resumed by playbackExtraction, the output of the others was
+        // written by this batch and is extracted again
+        OutputLayout layout(get_output_path(input_path));
+        if (started_paths.count(input_path) && fs::exists(layout.base) && !fs::exists(layout.journal()))
+        {
+            std::string output_path = layout.base.string();
+            std::cout << "Removing partial output of interrupted extraction: " << output_path << std::endl;
+            std::error_code error;
+            fs::remove_all(output_path, error);
+            if (error) {
+                std::cerr << "Error removing directory: " << output_path << std::endl;
+                continue;
+            }
+        }
+        pending_paths.push_back(input_path);
+    }
+
+    WorkerPool encode_pool(config.pipeline.encode_threads, config.pipeline.queue_depth);
+    std::counting_semaphore<> io_slots(std::max(config.io_threads, 1u));
+
+    PipelineResources resources;
+    resources.encode_pool = &encode_pool;
+    resources.io_slots = &io_slots;
+
+    // The recordings share one head pose model, so their faces fill the same batches. The profilers are per
+    // recording, the inference is not timed
+    HeadPoseEstimator head_pose;
+    if (config.pipeline.head_pose.enabled)
+    {
+        if (!head_pose.open(config.pipeline.head_pose))
+        {
+            return 1;
+        }
+        resources.head_pose = &head_pose;
+    }
+
+    unsigned int num_threads = std::max(1u, std::min(config.concurrent_recordings, (unsigned int)pending_paths.size()));
+
+    // Progress bars of concurrent recordings would overwrite each other
+    PipelineConfig pipeline_config = config.pipeline;
+    pipeline_config.show_progress = pipeline_config.show_progress && num_threads == 1;
+
+    std::mutex mutex;
+    std::atomic<size_t> next_path = 0;
+    ExtractionStats total_stats;
+    int failures = 0;
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        threads.emplace_back([&] {
+            for (size_t index = next_path++; index < pending_paths.size(); index = next_path++)
+            {
+                const std::string& input_path = pending_paths[index];
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (manifest_file.is_open())
+                    {
+                        manifest_file << "started " << input_path << std::endl;
+                    }
+                }
+
+                ExtractionStats stats;
+                int result = 1;
+                try
+                {
+                    result = playbackExtraction(input_path, pipeline_config, resources, &stats);
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << "Error extracting " << input_path << ": " << e.what() << std::endl;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (result != 0)
+                {
+                    failures++;
+                    continue;
+                }
+                if (manifest_file.is_open())
+                {
+                    manifest_file << "done " << input_path << std::endl;
+                }
+                printThroughput(input_path, stats);
+                total_stats.frames += stats.frames;
+                total_stats.bytes_written += stats.bytes_written;
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    total_stats.seconds = std::chrono::duration<double>(end - start).count();
+    printThroughput("Batch of " + std::to_string(pending_paths.size()) + " recordings", total_stats);
+    if (failures > 0)
+    {
+        std::cerr << failures << " recordings failed." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+#include "../include/CaptureSource.hpp"
+
+bool CaptureSource::is_finished() const
+{
+    return false;
+}
+
+DeviceCaptureSource::DeviceCaptureSource(uint32_t device_index, int32_t color_exposure_usec, int32_t powerline_freq)
+    : device_index(device_index), device(k4a::device::open(device_index))
+{
+    // If you want to synchronize cameras, you need to manually set both their exposures
+    device.set_color_control(K4A_COLOR_CONTROL_EXPOSURE_TIME_ABSOLUTE,
+        K4A_COLOR_CONTROL_MODE_MANUAL,
+        color_exposure_usec);
+    // This setting compensates for the flicker of lights due to the frequency of AC power in your region. If
+    // you are in an area with 50 Hz power, this may need to be updated (check the docs for
+    // k4a_color_control_command_t)
+    device.set_color_control(K4A_COLOR_CONTROL_POWERLINE_FREQUENCY,
+        K4A_COLOR_CONTROL_MODE_MANUAL,
+        powerline_freq);
+}
+
+std::string DeviceCaptureSource::get_name() const
+{
+    return "device " + std::to_string(device_index);
+}
+
+bool DeviceCaptureSource::is_sync_in_connected() const
+{
+    return device.is_sync_in_connected();
+}
+
+bool DeviceCaptureSource::is_sync_out_connected() const
+{
+    return device.is_sync_out_connected();
+}
+
+k4a::calibration DeviceCaptureSource::get_calibration(k4a_depth_mode_t depth_mode,
+    k4a_color_resolution_t color_resolution) const
+{
+    return device.get_calibration(depth_mode, color_resolution);
+}
+
+void DeviceCaptureSource::start_cameras(const k4a_device_configuration_t& config)
+{
+    device.start_cameras(&config);
+}
+
+void DeviceCaptureSource::stop_cameras()
+{
+    device.stop_cameras();
+}
+
+// Any negative timeout waits forever, as K4A_WAIT_INFINITE
+bool DeviceCaptureSource::get_capture(k4a::capture* capture, std::chrono::milliseconds timeout)
+{
+    return device.get_capture(capture, timeout.count() < 0 ? std::chrono::milliseconds{ K4A_WAIT_INFINITE } : timeout);
+}
+
+void DeviceCaptureSource::start_imu()
+{
+    device.start_imu();
+}
+
+void DeviceCaptureSource::stop_imu()
+{
+    device.stop_imu();
+}
+
+bool DeviceCaptureSource::get_imu_sample(k4a_imu_sample_t* imu_sample, std::chrono::milliseconds timeout)
+{
+    return device.get_imu_sample(imu_sample,
+        timeout.count() < 0 ? std::chrono::milliseconds{ K4A_WAIT_INFINITE } : timeout);
+}
+
+// Device timestamp of a capture, of the color image if there is one
+static int64_t capture_timestamp(const k4a::capture& capture)
+{
+    k4a::image image = capture.get_color_image();
+    if (!image)
+    {
+        image = capture.get_depth_image();
+    }
+    if (!image)
+    {
+        image = capture.get_ir_image();
+    }
+    return image ? image.get_device_timestamp().count() : 0;
+}
+
+PlaybackCaptureSource::PlaybackCaptureSource(const std::string& path)
+    : path(path), playback(k4a::playback::open(path.c_str()))
+{
+    record_config = playback.get_record_configuration();
+    frame_period = get_frame_period(record_config.camera_fps);
+}
+
+std::string PlaybackCaptureSource::get_name() const
+{
+    return path;
+}
+
+bool PlaybackCaptureSource::is_sync_in_connected() const
+{
+    return record_config.wired_sync_mode == K4A_WIRED_SYNC_MODE_SUBORDINATE;
+}
+
+bool PlaybackCaptureSource::is_sync_out_connected() const
+{
+    return record_config.wired_sync_mode == K4A_WIRED_SYNC_MODE_MASTER;
+}
+
+k4a::calibration PlaybackCaptureSource::get_calibration(k4a_depth_mode_t, k4a_color_resolution_t) const
+{
+    return playback.get_calibration();
+}
+
+void PlaybackCaptureSource::start_cameras(const k4a_device_configuration_t&)
+{
+    started = true;
+    finished = !playback.get_next_capture(&pending_capture);
+    first_timestamp_usec = finished ? 0 : capture_timestamp(pending_capture);
+    start_time = std::chrono::steady_clock::now();
+}
+
+void PlaybackCaptureSource::stop_cameras()
+{
+    started = false;
+    pending_capture.reset();
+}
+
+bool PlaybackCaptureSource::wait_for(int64_t timestamp_usec, std::chrono::milliseconds timeout) const
+{
+    std::chrono::steady_clock::time_point due = start_time + std::chrono::microseconds{ timestamp_usec - first_timestamp_usec };
+    if (timeout.count() >= 0 && due - std::chrono::steady_clock::now() > timeout)
+    {
+        std::this_thread::sleep_for(timeout);
+        return false;
+    }
+    std::this_thread::sleep_until(due);
+    return true;
+}
+
+bool PlaybackCaptureSource::get_capture(k4a::capture* capture, std::chrono::milliseconds timeout)
+{
+    if (!started || finished)
+    {
+        return false;
+    }
+    if (!pending_capture && !playback.get_next_capture(&pending_capture))
+    {
+        finished = true;
+        return false;
+    }
+
+    // A reader that fell behind gets the capture that is due now, the older ones are dropped as the queue of a
+    // device would drop them
+    std::chrono::microseconds max_lateness = PACED_SOURCE_QUEUE_FRAMES * frame_period;
+    k4a::capture next_capture;
+    while (std::chrono::steady_clock::now() - (start_time + std::chrono::microseconds{
+        capture_timestamp(pending_capture) - first_timestamp_usec }) > max_lateness &&
+        playback.get_next_capture(&next_capture))
+    {
+        pending_capture = std::move(next_capture);
+    }
+
+    if (!wait_for(capture_timestamp(pending_capture), timeout))
+    {
+        return false;
+    }
+    *capture = std::move(pending_capture);
+    pending_capture.reset();
+    return true;
+}
+
+void PlaybackCaptureSource::start_imu()
+{
+    imu_playback = k4a::playback::open(path.c_str());
+    has_pending_imu_sample = false;
+}
+
+void PlaybackCaptureSource::stop_imu()
+{
+    imu_playback.close();
+}
+
+// The IMU samples are paced like the captures, relative to the first capture, so start_cameras comes first
+bool PlaybackCaptureSource::get_imu_sample(k4a_imu_sample_t* imu_sample, std::chrono::milliseconds timeout)
+{
+    if (!has_pending_imu_sample)
+    {
+        if (!imu_playback.get_next_imu_sample(&pending_imu_sample))
+        {
+            // No more samples, wait like a device without any would
+            if (timeout.count() >= 0)
+            {
+                std::this_thread::sleep_for(timeout);
+            }
+            return false;
+        }
+        has_pending_imu_sample = true;
+    }
+    if (!wait_for((int64_t)pending_imu_sample.acc_timestamp_usec, timeout))
+    {
+        return false;
+    }
+    *imu_sample = pending_imu_sample;
+    has_pending_imu_sample = false;
+    return true;
+}
+
+bool PlaybackCaptureSource::is_finished() const
+{
+    return finished;
+}
+
+SyntheticCaptureSource::SyntheticCaptureSource(uint32_t index, k4a_wired_sync_mode_t wired_sync_mode)
+    : index(index), wired_sync_mode(wired_sync_mode)
+{
+}
+
+std::string SyntheticCaptureSource::get_name() const
+{
+    return "synthetic device " + std::to_string(index);
+}
+
+bool SyntheticCaptureSource::is_sync_in_connected() const
+{
+    return wired_sync_mode == K4A_WIRED_SYNC_MODE_SUBORDINATE;
+}
+
+bool SyntheticCaptureSource::is_sync_out_connected() const
+{
+    return wired_sync_mode == K4A_WIRED_SYNC_MODE_MASTER;
+}
+
+k4a::calibration SyntheticCaptureSource::get_calibration(k4a_depth_mode_t depth_mode,
+    k4a_color_resolution_t color_resolution) const
+{
+    return create_synthetic_calibration(depth_mode, color_resolution);
+}
+
+// Renders the scenes of the generator, which takes a moment at high resolutions
+void SyntheticCaptureSource::start_cameras(const k4a_device_configuration_t& config)
+{
+    SyntheticCaptureConfig synthetic_config;
+    synthetic_config.color_format = config.color_format == K4A_IMAGE_FORMAT_COLOR_BGRA32 ?
+        K4A_IMAGE_FORMAT_COLOR_BGRA32 : K4A_IMAGE_FORMAT_COLOR_MJPG;
+    synthetic_config.color_resolution = config.color_resolution;
+    synthetic_config.depth_mode = config.depth_mode;
+    synthetic_config.camera_fps = config.camera_fps;
+    synthetic_config.depth_delay_off_color_usec = config.depth_delay_off_color_usec;
+    if (wired_sync_mode == K4A_WIRED_SYNC_MODE_SUBORDINATE)
+    {
+        synthetic_config.start_timestamp += std::chrono::microseconds{ config.subordinate_delay_off_master_usec };
+    }
+
+    generator = std::make_unique<SyntheticCaptureGenerator>(synthetic_config);
+    frame_period = get_frame_period(config.camera_fps);
+    start_timestamp = synthetic_config.start_timestamp;
+    start_time = std::chrono::steady_clock::now();
+}
+
+void SyntheticCaptureSource::stop_cameras()
+{
+    generator.reset();
+}
+
+bool SyntheticCaptureSource::get_capture(k4a::capture* capture, std::chrono::milliseconds timeout)
+{
+    if (!generator)
+    {
+        return false;
+    }
+
+    // Frame n is due n frame periods after start_cameras. A reader further behind than the queue loses the
+    // oldest frames
+    int64_t elapsed_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time).count();
+    int64_t due_frames = elapsed_usec / frame_period.count() + 1;
+    int64_t next_frame = (int64_t)generator->get_frame_count();
+    if (due_frames - next_frame > PACED_SOURCE_QUEUE_FRAMES)
+    {
+        generator->skip(due_frames - next_frame - PACED_SOURCE_QUEUE_FRAMES);
+        next_frame = (int64_t)generator->get_frame_count();
+    }
+
+    std::chrono::steady_clock::time_point due = start_time + next_frame * frame_period;
+    if (timeout.count() >= 0 && due - std::chrono::steady_clock::now() > timeout)
+    {
+        std::this_thread::sleep_for(timeout);
+        return false;
+    }
+    std::this_thread::sleep_until(due);
+    *capture = generator->next_capture();
+    return true;
+}
+
+void SyntheticCaptureSource::start_imu()
+{
+    imu_sample_count = 0;
+}
+
+void SyntheticCaptureSource::stop_imu()
+{
+}
+
+// A device lying flat and still: gravity along the z axis of the accelerometer, no rotation. The samples are paced
+// from start_cameras, which comes first
+bool SyntheticCaptureSource::get_imu_sample(k4a_imu_sample_t* imu_sample, std::chrono::milliseconds timeout)
+{
+    std::chrono::steady_clock::time_point due = start_time + (int64_t)imu_sample_count * SYNTHETIC_IMU_PERIOD;
+    if (timeout.count() >= 0 && due - std::chrono::steady_clock::now() > timeout)
+    {
+        std::this_thread::sleep_for(timeout);
+        return false;
+    }
+    std::this_thread::sleep_until(due);
+
+    uint64_t timestamp_usec = (uint64_t)(start_timestamp + (int64_t)imu_sample_count * SYNTHETIC_IMU_PERIOD).count();
+    imu_sample_count++;
+    *imu_sample = k4a_imu_sample_t{};
+    imu_sample->temperature = 30.0f;
+    imu_sample->acc_sample.xyz.z = -9.81f;
+    imu_sample->acc_timestamp_usec = timestamp_usec;
+    imu_sample->gyro_timestamp_usec = timestamp_usec;
+    return true;
+}
+
+std::vector<std::unique_ptr<CaptureSource>> open_device_sources(uint32_t num_devices, int32_t color_exposure_usec,
+    int32_t powerline_freq)
+{
+    std::vector<std::unique_ptr<CaptureSource>> sources;
+    for (uint32_t i = 0; i < num_devices; i++)
+    {
+        sources.push_back(std::make_unique<DeviceCaptureSource>(i, color_exposure_usec, powerline_freq));
+    }
+    return sources;
+}
+
+std::vector<std::unique_ptr<CaptureSource>> open_playback_sources(const std::vector<std::string>& paths)
+{
+    std::vector<std::unique_ptr<CaptureSource>> sources;
+    for (const std::string& path : paths)
+    {
+        sources.push_back(std::make_unique<PlaybackCaptureSource>(path));
+    }
+    return sources;
+}
+
+std::vector<std::unique_ptr<CaptureSource>> open_synthetic_sources(uint32_t num_devices)
+{
+    std::vector<std::unique_ptr<CaptureSource>> sources;
+    for (uint32_t i = 0; i < num_devices; i++)
+    {
+        k4a_wired_sync_mode_t wired_sync_mode = i > 0 ? K4A_WIRED_SYNC_MODE_SUBORDINATE :
+            num_devices > 1 ? K4A_WIRED_SYNC_MODE_MASTER : K4A_WIRED_SYNC_MODE_STANDALONE;
+        sources.push_back(std::make_unique<SyntheticCaptureSource>(i, wired_sync_mode));
+    }
+    return sources;
+}
@@ -0,0 +1,301 @@
+#include "../include/CaptureSynchronizer.hpp"
+
+int64_t SynchronizedSet::max_error_usec() const
+{
+    int64_t max_error = 0;
+    for (int64_t error : errors_usec)
+    {
+        max_error = std::max(max_error, std::abs(error));
+    }
+    return max_error;
+}
+
+double SynchronizerStats::frame_yield() const
+{
+    return captures.empty() || captures[0] == 0 ? 0.0 : (double)sets / captures[0];
+}
+
+CaptureSynchronizer::CaptureSynchronizer(const std::vector<int64_t>& expected_offsets_usec, bool compare_depth,
+    std::chrono::microseconds tolerance, size_t window_size)
+    : offsets_usec(expected_offsets_usec),
+    compare_depth(compare_depth),
+    tolerance_usec(tolerance.count()),
+    window_size(std::max<size_t>(window_size, 1)),
+    windows(expected_offsets_usec.size() + 1)
+{
+    size_t devices = windows.size();
+    stats.captures.assign(devices, 0);
+    stats.discarded.assign(devices, 0);
+    stats.max_abs_error_usec.assign(devices, 0);
+    stats.mean_abs_error_usec.assign(devices, 0.0);
+    error_sums_usec.assign(devices, 0);
+}
+
+size_t CaptureSynchronizer::device_count() const
+{
+    return windows.size();
+}
+
+void CaptureSynchronizer::add_capture(size_t device_index, k4a::capture capture)
+{
+    stats.captures[device_index]++;
+
+    k4a::image image = device_index == 0 || !compare_depth ? capture.get_color_image() : capture.get_depth_image();
+    if (!image)
+    {
+        stats.discarded[device_index]++;
+        return;
+    }
+    int64_t timestamp = image.get_device_timestamp().count();
+    image.reset();
+
+    // Captures arrive in order, the search only matters for recordings with timestamps out of order
+    std::deque<WindowEntry>& window = windows[device_index];
+    auto position = std::upper_bound(window.begin(), window.end(), timestamp,
+        [](int64_t value, const WindowEntry& entry) { return value < entry.timestamp_usec; });
+    window.insert(position, WindowEntry{ timestamp, std::move(capture) });
+
+    if (window.size() > window_size)
+    {
+        discard_front(device_index);
+    }
+}
+
+void CaptureSynchronizer::discard_front(size_t device_index)
+{
+    windows[device_index].pop_front();
+    stats.discarded[device_index]++;
+}
+
+bool CaptureSynchronizer::pop_synchronized_set(SynchronizedSet& set)
+{
+    size_t devices = windows.size();
+    std::vector<size_t> picks(devices, 0);
+
+    while (!windows[0].empty())
+    {
+        int64_t master_timestamp = windows[0].front().timestamp_usec;
+        bool incomplete = false;
+        bool unmatched = false;
+
+        for (size_t device = 1; device < devices && !incomplete && !unmatched; device++)
+        {
+            const std::deque<WindowEntry>& window = windows[device];
+            int64_t expected = master_timestamp + offsets_usec[device - 1];
+
+            // First capture that is not too early, then the closest one of those that are not too late
+            auto candidate = std::lower_bound(window.begin(), window.end(), expected - tolerance_usec,
+                [](const WindowEntry& entry, int64_t value) { return entry.timestamp_usec < value; });
+            if (candidate == window.end())
+            {
+                // The device has not delivered this frame yet
+                incomplete = true;
+                break;
+            }
+            if (candidate->timestamp_usec > expected + tolerance_usec)
+            {
+                // The device skipped this frame, the master capture will never be matched
+                unmatched = true;
+                break;
+            }
+            auto best = candidate;
+            for (auto next = candidate + 1; next != window.end() && next->timestamp_usec <= expected + tolerance_usec; ++next)
+            {
+                if (std::abs(next->timestamp_usec - expected) < std::abs(best->timestamp_usec - expected))
+                {
+                    best = next;
+                }
+            }
+            picks[device] = (size_t)(best - window.begin());
+        }
+
+        if (incomplete)
+        {
+            return false;
+        }
+        if (unmatched)
+        {
+            discard_front(0);
+            continue;
+        }
+
+        set.captures.assign(devices, k4a::capture());
+        set.timestamps_usec.assign(devices, 0);
+        set.errors_usec.assign(devices, 0);
+        for (size_t device = 0; device < devices; device++)
+        {
+            // Captures older than the pick cannot be matched with any later master capture
+            for (size_t i = 0; i < picks[device]; i++)
+            {
+                discard_front(device);
+            }
+            WindowEntry& entry = windows[device].front();
+            set.captures[device] = std::move(entry.capture);
+            set.timestamps_usec[device] = entry.timestamp_usec;
+            if (device > 0)
+            {
+                set.errors_usec[device] = entry.timestamp_usec - (master_timestamp + offsets_usec[device - 1]);
+            }
+            windows[device].pop_front();
+
+            int64_t abs_error = std::abs(set.errors_usec[device]);
+            error_sums_usec[device] += abs_error;
+            stats.max_abs_error_usec[device] = std::max(stats.max_abs_error_usec[device], abs_error);
+        }
+        stats.sets++;
+        return true;
+    }
+    return false;
+}
+
+void CaptureSynchronizer::clear()
+{
+    for (size_t device = 0; device < windows.size(); device++)
+    {
+        while (!windows[device].empty())
+        {
+            discard_front(device);
+        }
+    }
+}
+
+SynchronizerStats CaptureSynchronizer::get_stats() const
+{
+    SynchronizerStats current = stats;
+    for (size_t device = 0; device < windows.size(); device++)
+    {
+        current.mean_abs_error_usec[device] = stats.sets == 0 ? 0.0 : (double)error_sums_usec[device] / stats.sets;
+    }
+    return current;
+}
+
+std::vector<int64_t> recording_offsets(std::vector<k4a::playback>& playbacks, bool compare_depth)
+{
+    std::vector<int64_t> offsets;
+    for (size_t i = 1; i < playbacks.size(); i++)
+    {
+        k4a_record_configuration_t record_config = playbacks[i].get_record_configuration();
+        offsets.push_back((int64_t)record_config.subordinate_delay_off_master_usec +
+            (compare_depth ? record_config.depth_delay_off_color_usec : 0));
+    }
+    return offsets;
+}
+
+bool open_session_recordings(const std::vector<std::string>& input_paths, std::vector<k4a::playback>& playbacks,
+    std::vector<std::string>& ordered_paths)
+{
+    playbacks.clear();
+    ordered_paths.clear();
+
+    int master_index = -1;
+    std::vector<k4a::playback> opened;
+    for (size_t i = 0; i < input_paths.size(); i++)
+    {
+        opened.push_back(k4a::playback::open(input_paths[i].c_str()));
+        if (opened.back().get_record_configuration().wired_sync_mode == K4A_WIRED_SYNC_MODE_MASTER)
+        {
+            if (master_index >= 0)
+            {
+                std::cerr << "More than one master recording: " << input_paths[master_index] << ", " << input_paths[i] << std::endl;
+                return false;
+            }
+            master_index = (int)i;
+        }
+    }
+    if (master_index < 0)
+    {
+        if (input_paths.size() > 1)
+        {
+            std::cerr << "No master recording among the " << input_paths.size() << " recordings" << std::endl;
+            return false;
+        }
+        master_index = 0;
+    }
+
+    playbacks.push_back(std::move(opened[master_index]));
+    ordered_paths.push_back(input_paths[master_index]);
+    for (size_t i = 0; i < opened.size(); i++)
+    {
+        if ((int)i != master_index)
+        {
+            playbacks.push_back(std::move(opened[i]));
+            ordered_paths.push_back(input_paths[i]);
+        }
+    }
+    return true;
+}
+
+// Print frame yield and sync error of the recordings of a session
+void benchmarkSynchronization(const std::vector<std::string>& input_paths, bool compare_depth, size_t window_size)
+{
+    std::vector<k4a::playback> playbacks;
+    std::vector<std::string> paths;
+    if (!open_session_recordings(input_paths, playbacks, paths))
+    {
+        return;
+    }
+
+    std::vector<int64_t> offsets = recording_offsets(playbacks, compare_depth);
+    CaptureSynchronizer synchronizer(offsets, compare_depth, MAX_ALLOWABLE_TIME_OFFSET_ERROR_FOR_IMAGE_TIMESTAMP,
+        window_size);
+
+    // The captures are added in the order a live capture would deliver them: by timestamp minus the offset
+    auto arrival_time = [&](size_t device, const k4a::capture& capture) {
+        k4a::image image = device == 0 || !compare_depth ? capture.get_color_image() : capture.get_depth_image();
+        int64_t timestamp = image ? image.get_device_timestamp().count() : 0;
+        return device == 0 ? timestamp : timestamp - offsets[device - 1];
+    };
+
+    std::vector<k4a::capture> next_captures(playbacks.size());
+    std::vector<bool> has_capture(playbacks.size());
+    for (size_t device = 0; device < playbacks.size(); device++)
+    {
+        has_capture[device] = playbacks[device].get_next_capture(&next_captures[device]);
+    }
+
+    SynchronizedSet set;
+    double matching_seconds = 0.0;
+    while (true)
+    {
+        int next_device = -1;
+        int64_t next_time = 0;
+        for (size_t device = 0; device < playbacks.size(); device++)
+        {
+            if (has_capture[device] && (next_device < 0 || arrival_time(device, next_captures[device]) < next_time))
+            {
+                next_device = (int)device;
+                next_time = arrival_time(device, next_captures[device]);
+            }
+        }
+        if (next_device < 0)
+        {
+            break;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        synchronizer.add_capture(next_device, std::move(next_captures[next_device]));
+        while (synchronizer.pop_synchronized_set(set))
+        {
+        }
+        matching_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        has_capture[next_device] = playbacks[next_device].get_next_capture(&next_captures[next_device]);
+    }
+
+    SynchronizerStats stats = synchronizer.get_stats();
+    std::cout << "Synchronized sets: " << stats.sets << ", frame yield " << 100.0 * stats.frame_yield() << "%, "
+        << (stats.sets == 0 ? 0.0 : 1e6 * matching_seconds / stats.sets) << " us of matching per set" << std::endl;
+    for (size_t device = 0; device < playbacks.size(); device++)
+    {
+        std::cout << std::setw(3) << device << " " << paths[device]
+            << " | captures " << std::setw(6) << stats.captures[device]
+            << " | discarded " << std::setw(5) << stats.discarded[device]
+            << " | mean error " << std::setw(6) << stats.mean_abs_error_usec[device] << " us"
+            << " | max error " << std::setw(5) << stats.max_abs_error_usec[device] << " us" << std::endl;
+    }
+
+    for (k4a::playback& playback : playbacks)
+    {
+        playback.close();
+    }
+}
@@ -0,0 +1,486 @@
+#include "../include/CommandLine.hpp"
+
+static const std::map<std::string, ExtractionMode> MODES = {
+    { "playback", ExtractionMode::Playback },
+    { "session", ExtractionMode::Session },
+    { "online", ExtractionMode::Online },
+    { "replay", ExtractionMode::Replay },
+    { "synthetic", ExtractionMode::Synthetic },
+};
+
+static const std::map<std::string, ImageFormat> IMAGE_FORMATS = {
+    { "jpg", ImageFormat::Jpeg },
+    { "png", ImageFormat::Png },
+    { "webp", ImageFormat::Webp },
+};
+
+static const std::map<std::string, RawCodec> RAW_CODECS = {
+    { "raw", RawCodec::Uncompressed },
+    { "png", RawCodec::Png },
+    { "zstd", RawCodec::DeltaZstd },
+};
+
+static const std::map<std::string, DepthTransform> DEPTH_TRANSFORMS = {
+    { "sdk", DepthTransform::Sdk },
+    { "table", DepthTransform::Table },
+};
+
+static const std::map<std::string, ImageGeometry> IMAGE_GEOMETRIES = {
+    { "color", ImageGeometry::Color },
+    { "depth", ImageGeometry::Depth },
+};
+
+static const std::map<std::string, PointCloudFormat> POINT_CLOUD_FORMATS = {
+    { "ascii-ply", PointCloudFormat::AsciiPly },
+    { "ply", PointCloudFormat::BinaryPly },
+    { "bin", PointCloudFormat::Bin },
+    { "pcd", PointCloudFormat::Pcd },
+};
+
+static const std::map<std::string, ImuFormat> IMU_FORMATS = {
+    { "ndjson", ImuFormat::Ndjson },
+    { "csv", ImuFormat::Csv },
+    { "bin", ImuFormat::Bin },
+};
+
+// Splits "a,b,c" into its items
+static std::vector<std::string> split_list(const std::string& list)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = std::min(list.find(',', start), list.size());
+        if (end > start)
+        {
+            items.push_back(list.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+static std::string trim(const std::string& text)
+{
+    size_t start = text.find_first_not_of(" \t\r");
+    if (start == std::string::npos)
+    {
+        return "";
+    }
+    return text.substr(start, text.find_last_not_of(" \t\r") - start + 1);
+}
+
+template <typename T>
+static bool parse_choice(const std::map<std::string, T>& choices, const std::string& option, const std::string& value,
+    T& result)
+{
+    auto it = choices.find(value);
+    if (it == choices.end())
+    {
+        std::cerr << "Invalid value for " << option << ": " << value << std::endl;
+        return false;
+    }
+    result = it->second;
+    return true;
+}
+
+template <typename T>
+static bool parse_number(const std::string& option, const std::string& value, T min, T max, T& result)
+{
+    try
+    {
+        size_t end = 0;
+        double number = std::stod(value, &end);
+        if (end != value.size() || number < min || number > max)
+        {
+            throw std::invalid_argument(value);
+        }
+        result = (T)number;
+        return true;
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "Invalid value for " << option << ": " << value << ", expected " << min << " to " << max
+            << std::endl;
+        return false;
+    }
+}
+
+// Options of a --config file, as if they were given where --config is
+static bool read_config_file(const std::string& path, std::vector<std::string>& arguments)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    for (std::string line; std::getline(file, line); )
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        size_t equals = line.find('=');
+        arguments.push_back("--" + trim(line.substr(0, equals)));
+        if (equals != std::string::npos)
+        {
+            arguments.push_back(trim(line.substr(equals + 1)));
+        }
+    }
+    return true;
+}
+
+static bool read_input_list(const std::string& path, std::vector<std::string>& input_paths)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    for (std::string input_path; std::getline(file, input_path); )
+    {
+        input_path = trim(input_path);
+        if (!input_path.empty())
+        {
+            input_paths.push_back(input_path);
+        }
+    }
+    return true;
+}
+
+// Sets the listed flags and clears the others, false if an item is not one of them
+static bool parse_flag_list(const std::string& option, const std::string& value,
+    const std::map<std::string, bool*>& flags)
+{
+    for (const auto& [name, flag] : flags)
+    {
+        *flag = false;
+    }
+    for (const std::string& item : split_list(value))
+    {
+        auto it = flags.find(item);
+        if (it == flags.end())
+        {
+            std::cerr << "Invalid value for " << option << ": " << item << std::endl;
+            return false;
+        }
+        *it->second = true;
+    }
+    return true;
+}
+
+bool parse_command_line(int argc, char** argv, CommandLineOptions& options)
+{
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    PipelineConfig& pipeline = options.batch.pipeline;
+    std::string input_list;
+    bool manifest_given = false;
+    bool mode_given = false;
+
+    // Options without a value
+    std::map<std::string, std::function<void()>> flags = {
+        { "--help", [&] { options.help = true; } },
+        { "--container", [&] { pipeline.output_mode = OutputMode::Container; } },
+        { "--no-color-passthrough", [&] { pipeline.color_passthrough = false; } },
+        { "--point-cloud-stream", [&] { pipeline.point_cloud.stream = true; } },
+        { "--no-imu-thread", [&] { pipeline.imu.thread = false; } },
+        { "--head-pose", [&] { pipeline.head_pose.enabled = true; } },
+        { "--profile", [&] { pipeline.profile.enabled = true; } },
+        { "--trace", [&] { pipeline.profile.enabled = pipeline.profile.trace = true; } },
+    };
+
+    // Options with a value, false if the value is invalid
+    std::map<std::string, std::function<bool(const std::string&, const std::string&)>> valued_options = {
+        { "--input-list", [&](const std::string&, const std::string& value) {
+            input_list = value;
+            return read_input_list(value, options.input_paths);
+        } },
+        { "--output", [&](const std::string&, const std::string& value) {
+            options.output_path = value;
+            return true;
+        } },
+        { "--manifest", [&](const std::string&, const std::string& value) {
+            options.batch.manifest_path = value;
+            manifest_given = true;
+            return true;
+        } },
+        { "--duration", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1, 86400, options.duration);
+        } },
+        { "--devices", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1, 64, options.num_devices);
+        } },
+        { "--streams", [&](const std::string& option, const std::string& value) {
+            return parse_flag_list(option, value, {
+                { "color", &pipeline.streams.color },
+                { "depth", &pipeline.streams.depth_images },
+                { "depth-raw", &pipeline.streams.depth_raw },
+                { "ir", &pipeline.streams.ir_images },
+                { "ir-raw", &pipeline.streams.ir_raw },
+                { "point-clouds", &pipeline.point_clouds },
+                { "imu", &pipeline.imu.enabled } });
+        } },
+        { "--color-format", [&](const std::string& option, const std::string& value) {
+            return parse_choice(IMAGE_FORMATS, option, value, pipeline.color_encoder.format);
+        } },
+        { "--color-quality", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 0, 100, pipeline.color_encoder.quality);
+        } },
+        { "--image-format", [&](const std::string& option, const std::string& value) {
+            return parse_choice(IMAGE_FORMATS, option, value, pipeline.depth_ir_encoder.format);
+        } },
+        { "--image-quality", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 0, 100, pipeline.depth_ir_encoder.quality);
+        } },
+        { "--png-compression", [&](const std::string& option, const std::string& value) {
+            bool ok = parse_number(option, value, 0, 9, pipeline.color_encoder.png_compression);
+            pipeline.depth_ir_encoder.png_compression = pipeline.color_encoder.png_compression;
+            return ok;
+        } },
+        { "--depth-max-mm", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1.0, 65535.0, pipeline.depth_image_max_mm);
+        } },
+        { "--ir-max", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1.0, 65535.0, pipeline.ir_image_max);
+        } },
+        { "--geometry", [&](const std::string& option, const std::string& value) {
+            return parse_choice(IMAGE_GEOMETRIES, option, value, pipeline.geometry);
+        } },
+        { "--depth-transform", [&](const std::string& option, const std::string& value) {
+            return parse_choice(DEPTH_TRANSFORMS, option, value, pipeline.depth_transform);
+        } },
+        { "--raw-codec", [&](const std::string& option, const std::string& value) {
+            return parse_choice(RAW_CODECS, option, value, pipeline.raw_codec.codec);
+        } },
+        { "--raw-png-compression", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 0, 9, pipeline.raw_codec.png_compression);
+        } },
+        { "--raw-zstd-level", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1, 19, pipeline.raw_codec.zstd_level);
+        } },
+        { "--point-cloud-format", [&](const std::string& option, const std::string& value) {
+            return parse_choice(POINT_CLOUD_FORMATS, option, value, pipeline.point_cloud.format);
+        } },
+        { "--point-cloud-attributes", [&](const std::string& option, const std::string& value) {
+            return parse_flag_list(option, value, {
+                { "color", &pipeline.point_cloud.color },
+                { "ir", &pipeline.point_cloud.ir } });
+        } },
+        { "--imu-format", [&](const std::string& option, const std::string& value) {
+            return parse_choice(IMU_FORMATS, option, value, pipeline.imu.format);
+        } },
+        { "--head-pose-model", [&](const std::string&, const std::string& value) {
+            pipeline.head_pose.model_path = value;
+            return true;
+        } },
+        { "--face-detector", [&](const std::string&, const std::string& value) {
+            pipeline.head_pose.detector_path = value;
+            return true;
+        } },
+        { "--face-score", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 0.0f, 1.0f, pipeline.head_pose.score_threshold);
+        } },
+        { "--head-pose-batch", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, (size_t)1, (size_t)256, pipeline.head_pose.batch_size);
+        } },
+        { "--head-pose-threads", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1, 256, pipeline.head_pose.inference_threads);
+        } },
+        { "--transform-threads", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1u, 256u, pipeline.transform_threads);
+        } },
+        { "--encode-threads", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1u, 1024u, pipeline.encode_threads);
+        } },
+        { "--queue-depth", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, (size_t)1, (size_t)1024, pipeline.queue_depth);
+        } },
+        { "--time-ranges", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1u, 256u, pipeline.playback_ranges);
+        } },
+        { "--concurrent-recordings", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1u, 256u, options.batch.concurrent_recordings);
+        } },
+        { "--io-threads", [&](const std::string& option, const std::string& value) {
+            return parse_number(option, value, 1u, 256u, options.batch.io_threads);
+        } },
+    };
+
+    for (size_t i = 0; i < arguments.size(); i++)
+    {
+        std::string option = arguments[i];
+        if (option.rfind("--", 0) != 0)
+        {
+            // The first positional argument may name the mode, the others are recordings
+            auto mode = MODES.find(option);
+            if (!mode_given && options.input_paths.empty() && mode != MODES.end())
+            {
+                options.mode = mode->second;
+                mode_given = true;
+            }
+            else
+            {
+                options.input_paths.push_back(option);
+            }
+            continue;
+        }
+
+        auto flag = flags.find(option);
+        if (flag != flags.end())
+        {
+            flag->second();
+            continue;
+        }
+
+        auto valued_option = valued_options.find(option);
+        if (valued_option == valued_options.end() && option != "--config")
+        {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return false;
+        }
+        if (i + 1 >= arguments.size())
+        {
+            std::cerr << "Missing value for " << option << std::endl;
+            return false;
+        }
+        std::string value = arguments[++i];
+
+        if (option == "--config")
+        {
+            std::vector<std::string> file_arguments;
+            if (!read_config_file(value, file_arguments))
+            {
+                return false;
+            }
+            arguments.insert(arguments.begin() + i + 1, file_arguments.begin(), file_arguments.end());
+        }
+        else if (!valued_option->second(option, value))
+        {
+            return false;
+        }
+    }
+
+    // A batch listed in a file resumes from the manifest next to it, unless told otherwise
+    if (!manifest_given && !input_list.empty())
+    {
+        options.batch.manifest_path = input_list + ".manifest";
+    }
+    if (options.help)
+    {
+        return true;
+    }
+
+    bool needs_inputs = options.mode == ExtractionMode::Playback || options.mode == ExtractionMode::Session ||
+        options.mode == ExtractionMode::Replay;
+    if (needs_inputs && options.input_paths.empty())
+    {
+        std::cerr << "No recordings given" << std::endl;
+        return false;
+    }
+    if (options.mode != ExtractionMode::Playback && options.output_path.empty())
+    {
+        std::cerr << "No --output directory given" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int run_command_line(const CommandLineOptions& options)
+{
+    const PipelineConfig& pipeline = options.batch.pipeline;
+    switch (options.mode)
+    {
+    case ExtractionMode::Session:
+        return sessionExtraction(options.input_paths, options.output_path, pipeline);
+    case ExtractionMode::Online:
+        return onlineExtraction(options.duration, options.output_path, options.num_devices, pipeline);
+    case ExtractionMode::Replay:
+    {
+        std::vector<std::unique_ptr<CaptureSource>> sources;
+        try
+        {
+            sources = open_playback_sources(options.input_paths);
+        }
+        catch (const k4a::error& e)
+        {
+            std::cerr << "Error opening the recordings: " << e.what() << std::endl;
+            return 1;
+        }
+        return onlineExtraction(options.duration, options.output_path, std::move(sources), pipeline);
+    }
+    case ExtractionMode::Synthetic:
+        return onlineExtraction(options.duration, options.output_path, open_synthetic_sources(options.num_devices),
+            pipeline);
+    default:
+        return batchExtraction(options.input_paths, options.batch);
+    }
+}
+
+void printUsage(const char* program)
+{
+    std::cout <<
+        "Usage: " << program << " [mode] [recordings...] [options]\n"
+        "\n"
+        "Modes:\n"
+        "  playback                  extract every recording into the folder of its name (default)\n"
+        "  session                   extract the recordings of one session, master first, into --output\n"
+        "  online                    record and extract the connected devices into --output\n"
+        "  replay                    like online, with the recordings of a session replayed in real time\n"
+        "  synthetic                 like online, with synthetic devices\n"
+        "\n"
+        "Inputs and outputs:\n"
+        "  --input-list <file>       recordings, one per line. The batch resumes from <file>.manifest\n"
+        "  --output <dir>            output directory of every mode but playback\n"
+        "  --manifest <file>         resume a playback batch from this manifest\n"
+        "  --duration <seconds>      online, replay and synthetic recording length, default 15\n"
+        "  --devices <n>             online and synthetic devices, default 1\n"
+        "  --config <file>           read more options, one \"option = value\" per line\n"
+        "\n"
+        "Streams and encoders:\n"
+        "  --streams <list>          outputs to write, of color,depth,depth-raw,ir,ir-raw,point-clouds,imu.\n"
+        "                            Default all but point-clouds\n"
+        "  --color-format <f>        jpg, png or webp, default jpg\n"
+        "  --color-quality <0-100>   JPEG and WebP quality of the color images, default 95\n"
+        "  --no-color-passthrough    decode and encode MJPG color images instead of copying them\n"
+        "  --image-format <f>        jpg, png or webp of the depth and IR images, default jpg\n"
+        "  --image-quality <0-100>   JPEG and WebP quality of the depth and IR images, default 95\n"
+        "  --png-compression <0-9>   PNG compression of the color, depth and IR images, default 1\n"
+        "  --depth-max-mm <mm>       depth drawn white in the depth images, default 3860\n"
+        "  --ir-max <value>          IR drawn white in the IR images, default 1000\n"
+        "  --geometry <g>            color: depth and IR mapped into the color camera (default), depth: color\n"
+        "                            mapped into the depth camera at the depth resolution\n"
+        "  --depth-transform <t>     sdk or table, how the images are mapped into the other camera, default sdk\n"
+        "  --raw-codec <c>           raw, png or zstd for the raw matrices, default png\n"
+        "  --raw-png-compression <n> 0 to 9, default 1\n"
+        "  --raw-zstd-level <n>      1 to 19, default 1\n"
+        "  --point-cloud-format <f>  ply, ascii-ply, bin or pcd, default ply\n"
+        "  --point-cloud-attributes <list>  color,ir values of the points, default none\n"
+        "  --point-cloud-stream      append the point clouds to depth/point_clouds.k4ps\n"
+        "  --imu-format <f>          ndjson, csv or bin, default ndjson\n"
+        "  --no-imu-thread           read the IMU samples of a recording after its frames\n"
+        "  --container               write the images into frames.k4fc instead of separate files\n"
+        "\n"
+        "Head pose, needs a build with -DVIDEO_EXTRACTION_HEAD_POSE=ON:\n"
+        "  --head-pose               write the orientation of the faces to color/head_pose.csv\n"
+        "  --head-pose-model <file>  6DRepNet exported by 6dRepnet/export_onnx.py,\n"
+        "                            default 6DRepNet_300W_LP_AFLW2000.onnx\n"
+        "  --face-detector <file>    YuNet face detector, default face_detection_yunet_2023mar.onnx\n"
+        "  --face-score <0-1>        faces detected with a lower score are skipped, default 0.95\n"
+        "  --head-pose-batch <n>     faces run through the model at once, default 16\n"
+        "  --head-pose-threads <n>   ONNX Runtime threads, default 4\n"
+        "\n"
+        "Threads:\n"
+        "  --transform-threads <n>   transformation threads per recording, default 2\n"
+        "  --encode-threads <n>      encode worker pool, default the number of cores\n"
+        "  --queue-depth <n>         frames queued between the stages, default 8\n"
+        "  --concurrent-recordings <n>  recordings of a playback batch extracted at once, default 2\n"
+        "  --io-threads <n>          writers saving files at the same time in a batch, default 2\n"
+        "  --time-ranges <n>         time ranges of a recording extracted in parallel, default 1\n"
+        "\n"
+        "  --profile                 write profile.json with the time of every stage\n"
+        "  --trace                   also write profile_trace.json\n"
+        "  --help\n";
+}
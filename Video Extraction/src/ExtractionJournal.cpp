@@ -0,0 +1,176 @@
+#include "../include/ExtractionJournal.hpp"
+
+#include <array>
+#include <format>
+
+namespace fs = std::filesystem;
+
+uint32_t crc32(const void* data, size_t size)
+{
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            table[i] = value;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// "checkpoint frames=... depth=..." without the checksum
+static std::string format_checkpoint(const JournalCheckpoint& checkpoint)
+{
+    std::string record = std::format("checkpoint frames={} depth={} color={} ir={}", checkpoint.frames,
+        checkpoint.depth_timestamp_usec, checkpoint.color_timestamp_usec, checkpoint.ir_timestamp_usec);
+    for (const auto& [path, size] : checkpoint.file_sizes)
+    {
+        record += std::format(" {}={}", path, size);
+    }
+    return record;
+}
+
+static bool parse_checkpoint(const std::string& record, JournalCheckpoint& checkpoint)
+{
+    std::istringstream fields(record);
+    std::string field;
+    fields >> field;
+    while (fields >> field)
+    {
+        size_t equals = field.rfind('=');
+        if (equals == std::string::npos)
+        {
+            return false;
+        }
+        std::string key = field.substr(0, equals);
+        std::string value = field.substr(equals + 1);
+        try
+        {
+            if (key == "frames")
+            {
+                checkpoint.frames = std::stoull(value);
+            }
+            else if (key == "depth")
+            {
+                checkpoint.depth_timestamp_usec = std::stoll(value);
+            }
+            else if (key == "color")
+            {
+                checkpoint.color_timestamp_usec = std::stoll(value);
+            }
+            else if (key == "ir")
+            {
+                checkpoint.ir_timestamp_usec = std::stoll(value);
+            }
+            else
+            {
+                checkpoint.file_sizes[key] = std::stoull(value);
+            }
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+ExtractionJournal::~ExtractionJournal()
+{
+    close();
+}
+
+bool ExtractionJournal::open(const fs::path& path, const JournalCheckpoint* resumed)
+{
+    file.open(path, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path.string() << std::endl;
+        return false;
+    }
+    return resumed == nullptr || append_checkpoint(*resumed);
+}
+
+bool ExtractionJournal::append_checkpoint(const JournalCheckpoint& checkpoint)
+{
+    return append_record(format_checkpoint(checkpoint));
+}
+
+bool ExtractionJournal::mark_done(const fs::path& path)
+{
+    ExtractionJournal journal;
+    journal.file.open(path, std::ios::app);
+    if (!journal.file.is_open())
+    {
+        std::cerr << "Error opening file: " << path.string() << std::endl;
+        return false;
+    }
+    return journal.append_record("done");
+}
+
+bool ExtractionJournal::append_record(const std::string& record)
+{
+    file << record << std::format(" crc32={:08x}", crc32(record.data(), record.size())) << '\n';
+    file.flush();
+    return file.good();
+}
+
+void ExtractionJournal::close()
+{
+    file.close();
+}
+
+bool ExtractionJournal::is_open() const
+{
+    return file.is_open();
+}
+
+JournalState read_journal(const fs::path& path)
+{
+    JournalState state;
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        return state;
+    }
+    state.exists = true;
+
+    for (std::string line; std::getline(file, line); )
+    {
+        size_t crc_start = line.rfind(" crc32=");
+        if (crc_start == std::string::npos || line.size() != crc_start + 15 ||
+            std::format("{:08x}", crc32(line.data(), crc_start)) != line.substr(crc_start + 7))
+        {
+            break;
+        }
+        std::string record = line.substr(0, crc_start);
+
+        JournalCheckpoint checkpoint;
+        if (record == "done")
+        {
+            state.done = true;
+        }
+        else if (record.rfind("checkpoint ", 0) == 0 && parse_checkpoint(record, checkpoint))
+        {
+            state.has_checkpoint = true;
+            state.checkpoint = checkpoint;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return state;
+}
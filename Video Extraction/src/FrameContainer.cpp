@@ -0,0 +1,337 @@
+#include "../include/FrameContainer.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char CONTAINER_HEADER_MAGIC[4] = { 'K', '4', 'F', 'C' };
+static const char CONTAINER_FOOTER_MAGIC[4] = { 'K', '4', 'F', 'I' };
+
+FrameContainerWriter::~FrameContainerWriter()
+{
+    close();
+}
+
+bool FrameContainerWriter::open(const std::string& path)
+{
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    file.write(CONTAINER_HEADER_MAGIC, sizeof(CONTAINER_HEADER_MAGIC));
+    file.write((const char*)&CONTAINER_VERSION, sizeof(CONTAINER_VERSION));
+    position = sizeof(CONTAINER_HEADER_MAGIC) + sizeof(CONTAINER_VERSION);
+    stream_indices.clear();
+    stream_names.clear();
+    frame_table.clear();
+    return file.good();
+}
+
+bool FrameContainerWriter::append_frame(const std::vector<ContainerImage>& images)
+{
+    std::vector<FrameContainerEntry> entries(stream_names.size(), FrameContainerEntry{ 0, 0, 0 });
+    for (const ContainerImage& image : images)
+    {
+        auto it = stream_indices.find(image.stream);
+        if (it == stream_indices.end())
+        {
+            if (image.stream.size() >= CONTAINER_STREAM_NAME_SIZE)
+            {
+                std::cerr << "Stream name too long: " << image.stream << std::endl;
+                return false;
+            }
+            it = stream_indices.emplace(image.stream, (uint32_t)stream_names.size()).first;
+            stream_names.push_back(image.stream);
+            entries.push_back(FrameContainerEntry{ 0, 0, 0 });
+        }
+
+        file.write((const char*)image.data, (std::streamsize)image.size);
+        entries[it->second] = FrameContainerEntry{ position, image.size, image.timestamp_usec };
+        position += image.size;
+    }
+    frame_table.push_back(std::move(entries));
+    return file.good();
+}
+
+bool FrameContainerWriter::close()
+{
+    if (!file.is_open())
+    {
+        return true;
+    }
+
+    FrameContainerFooter footer = {};
+    footer.table_offset = position;
+    footer.frame_count = frame_table.size();
+    footer.stream_count = (uint32_t)stream_names.size();
+    footer.version = CONTAINER_VERSION;
+    std::memcpy(footer.magic, CONTAINER_FOOTER_MAGIC, sizeof(footer.magic));
+
+    // Frames appended before a stream first appeared have no entry for it
+    for (std::vector<FrameContainerEntry>& entries : frame_table)
+    {
+        entries.resize(stream_names.size(), FrameContainerEntry{ 0, 0, 0 });
+        file.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(FrameContainerEntry)));
+    }
+    for (const std::string& name : stream_names)
+    {
+        char padded_name[CONTAINER_STREAM_NAME_SIZE] = {};
+        std::memcpy(padded_name, name.data(), name.size());
+        file.write(padded_name, sizeof(padded_name));
+    }
+    file.write((const char*)&footer, sizeof(footer));
+
+    bool good = file.good();
+    file.close();
+    frame_table.clear();
+    return good;
+}
+
+bool FrameContainerWriter::is_open() const
+{
+    return file.is_open();
+}
+
+FrameContainerReader::~FrameContainerReader()
+{
+    close();
+}
+
+bool FrameContainerReader::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file_handle, &file_size);
+    size = (size_t)file_size.QuadPart;
+    mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle != nullptr)
+    {
+        data = (const uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    file_descriptor = ::open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    struct stat file_stat;
+    fstat(file_descriptor, &file_stat);
+    size = (size_t)file_stat.st_size;
+    void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, file_descriptor, 0) : MAP_FAILED;
+    data = mapping == MAP_FAILED ? nullptr : (const uint8_t*)mapping;
+#endif
+
+    if (data == nullptr)
+    {
+        std::cerr << "Error mapping file: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    if (size < sizeof(CONTAINER_HEADER_MAGIC) + sizeof(FrameContainerFooter) ||
+        std::memcmp(data, CONTAINER_HEADER_MAGIC, sizeof(CONTAINER_HEADER_MAGIC)) != 0)
+    {
+        std::cerr << "Not a frame container: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    std::memcpy(&footer, data + size - sizeof(FrameContainerFooter), sizeof(FrameContainerFooter));
+    uint64_t table_size = footer.frame_count * footer.stream_count * sizeof(FrameContainerEntry);
+    uint64_t names_size = (uint64_t)footer.stream_count * CONTAINER_STREAM_NAME_SIZE;
+    if (std::memcmp(footer.magic, CONTAINER_FOOTER_MAGIC, sizeof(footer.magic)) != 0 ||
+        footer.version != CONTAINER_VERSION ||
+        footer.table_offset + table_size + names_size + sizeof(FrameContainerFooter) != size)
+    {
+        std::cerr << "Frame container without frame table, was the extraction interrupted? " << path << std::endl;
+        close();
+        return false;
+    }
+
+    frame_table = data + footer.table_offset;
+    const char* names = (const char*)(data + footer.table_offset + table_size);
+    for (uint32_t i = 0; i < footer.stream_count; i++)
+    {
+        const char* name = names + i * CONTAINER_STREAM_NAME_SIZE;
+        stream_names.emplace_back(name, strnlen(name, CONTAINER_STREAM_NAME_SIZE));
+    }
+    return true;
+}
+
+void FrameContainerReader::close()
+{
+#ifdef _WIN32
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mapping_handle != nullptr)
+    {
+        CloseHandle(mapping_handle);
+        mapping_handle = nullptr;
+    }
+    if (file_handle != nullptr)
+    {
+        CloseHandle(file_handle);
+        file_handle = nullptr;
+    }
+#else
+    if (data != nullptr)
+    {
+        munmap((void*)data, size);
+    }
+    if (file_descriptor >= 0)
+    {
+        ::close(file_descriptor);
+        file_descriptor = -1;
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    frame_table = nullptr;
+    footer = {};
+    stream_names.clear();
+}
+
+size_t FrameContainerReader::frame_count() const
+{
+    return (size_t)footer.frame_count;
+}
+
+const std::vector<std::string>& FrameContainerReader::get_stream_names() const
+{
+    return stream_names;
+}
+
+int FrameContainerReader::get_stream_index(const std::string& stream) const
+{
+    auto it = std::find(stream_names.begin(), stream_names.end(), stream);
+    return it == stream_names.end() ? -1 : (int)(it - stream_names.begin());
+}
+
+FrameContainerEntry FrameContainerReader::entry(size_t index, size_t stream) const
+{
+    // The table follows the images and is not necessarily aligned
+    FrameContainerEntry table_entry;
+    std::memcpy(&table_entry, frame_table + (index * footer.stream_count + stream) * sizeof(FrameContainerEntry),
+        sizeof(FrameContainerEntry));
+    return table_entry;
+}
+
+bool FrameContainerReader::get_frame(size_t index, std::vector<ContainerImage>& images) const
+{
+    images.clear();
+    if (index >= frame_count())
+    {
+        return false;
+    }
+    for (size_t stream = 0; stream < stream_names.size(); stream++)
+    {
+        FrameContainerEntry image_entry = entry(index, stream);
+        if (image_entry.size == 0)
+        {
+            continue;
+        }
+        ContainerImage image;
+        image.stream = stream_names[stream];
+        image.timestamp_usec = image_entry.timestamp_usec;
+        image.data = data + image_entry.offset;
+        image.size = (size_t)image_entry.size;
+        images.push_back(image);
+    }
+    return true;
+}
+
+bool FrameContainerReader::find_frame(int64_t timestamp_usec, size_t& index, size_t stream) const
+{
+    if (frame_count() == 0 || stream >= stream_names.size())
+    {
+        return false;
+    }
+
+    // Frames that dropped the image of the stream have an empty entry with timestamp 0, so the search only looks at
+    // the frames with an image: the first one not earlier than the timestamp, then the closer of it and the one
+    // before. A probe that lands on a hole moves on to the next image within the remaining range
+    auto has_image = [&](size_t frame) { return entry(frame, stream).size != 0; };
+    size_t low = 0;
+    size_t high = frame_count();
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        size_t probe = middle;
+        while (probe < high && !has_image(probe))
+        {
+            probe++;
+        }
+        if (probe < high && entry(probe, stream).timestamp_usec < timestamp_usec)
+        {
+            low = probe + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    size_t after = low;
+    while (after < frame_count() && !has_image(after))
+    {
+        after++;
+    }
+    size_t before = low;
+    while (before > 0 && !has_image(before - 1))
+    {
+        before--;
+    }
+    if (after == frame_count() && before == 0)
+    {
+        return false;
+    }
+    if (after == frame_count() ||
+        (before > 0 && timestamp_usec - entry(before - 1, stream).timestamp_usec < entry(after, stream).timestamp_usec - timestamp_usec))
+    {
+        index = before - 1;
+    }
+    else
+    {
+        index = after;
+    }
+    return true;
+}
+
+cv::Mat FrameContainerReader::get_image(size_t index, size_t stream) const
+{
+    if (index >= frame_count() || stream >= stream_names.size() || entry(index, stream).size == 0)
+    {
+        return cv::Mat();
+    }
+
+    FrameContainerEntry image_entry = entry(index, stream);
+    std::vector<uchar> buffer(data + image_entry.offset, data + image_entry.offset + image_entry.size);
+    const std::string& name = stream_names[stream];
+    if (name.find("raw_matrices") != std::string::npos)
+    {
+        return decode_raw_frame(buffer);
+    }
+    return cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+}
@@ -0,0 +1,104 @@
+#include "../include/FrameLog.hpp"
+
+FrameMetadata get_frame_metadata(const k4a::image& image)
+{
+    FrameMetadata metadata;
+    metadata.device_timestamp_usec = image.get_device_timestamp().count();
+    metadata.system_timestamp_nsec = image.get_system_timestamp().count();
+    metadata.host_timestamp_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (image.get_format() == K4A_IMAGE_FORMAT_COLOR_MJPG || image.get_format() == K4A_IMAGE_FORMAT_COLOR_NV12 ||
+        image.get_format() == K4A_IMAGE_FORMAT_COLOR_YUY2 || image.get_format() == K4A_IMAGE_FORMAT_COLOR_BGRA32)
+    {
+        metadata.exposure_usec = image.get_exposure().count();
+    }
+    return metadata;
+}
+
+FrameLog::~FrameLog()
+{
+    close();
+}
+
+bool FrameLog::open(const std::filesystem::path& directory)
+{
+    std::string timestamps_path = (directory / "timestamps.txt").string();
+    std::string metadata_path = (directory / "metadata.csv").string();
+
+    bool new_metadata_file = !std::filesystem::exists(metadata_path) || std::filesystem::file_size(metadata_path) == 0;
+
+    timestamps_file.open(timestamps_path, std::ios::app);
+    if (!timestamps_file.is_open())
+    {
+        std::cerr << "Error opening file: " << timestamps_path << std::endl;
+        return false;
+    }
+    metadata_file.open(metadata_path, std::ios::app);
+    if (!metadata_file.is_open())
+    {
+        std::cerr << "Error opening file: " << metadata_path << std::endl;
+        return false;
+    }
+    if (new_metadata_file)
+    {
+        metadata_file << "device_timestamp_usec,system_timestamp_nsec,host_timestamp_usec,exposure_usec\n";
+    }
+    return true;
+}
+
+void FrameLog::append(const FrameMetadata& metadata)
+{
+    if (pending_records == 0)
+    {
+        oldest_pending = std::chrono::steady_clock::now();
+    }
+
+    std::string device_timestamp = std::to_string(metadata.device_timestamp_usec);
+    timestamps_buffer += device_timestamp;
+    timestamps_buffer += '\n';
+    metadata_buffer += device_timestamp;
+    metadata_buffer += ',';
+    metadata_buffer += std::to_string(metadata.system_timestamp_nsec);
+    metadata_buffer += ',';
+    metadata_buffer += std::to_string(metadata.host_timestamp_usec);
+    metadata_buffer += ',';
+    metadata_buffer += std::to_string(metadata.exposure_usec);
+    metadata_buffer += '\n';
+    pending_records++;
+
+    if (pending_records >= FRAME_LOG_FLUSH_RECORDS ||
+        std::chrono::steady_clock::now() - oldest_pending >= FRAME_LOG_FLUSH_INTERVAL)
+    {
+        flush();
+    }
+}
+
+void FrameLog::flush()
+{
+    if (pending_records == 0)
+    {
+        return;
+    }
+    timestamps_file.write(timestamps_buffer.data(), (std::streamsize)timestamps_buffer.size());
+    metadata_file.write(metadata_buffer.data(), (std::streamsize)metadata_buffer.size());
+    timestamps_file.flush();
+    metadata_file.flush();
+    timestamps_buffer.clear();
+    metadata_buffer.clear();
+    pending_records = 0;
+}
+
+void FrameLog::close()
+{
+    if (timestamps_file.is_open())
+    {
+        flush();
+    }
+    timestamps_file.close();
+    metadata_file.close();
+}
+
+bool FrameLog::is_open() const
+{
+    return timestamps_file.is_open() && metadata_file.is_open();
+}
@@ -0,0 +1,76 @@
+#include "../include/FramePool.hpp"
+
+double FramePoolStats::hit_rate() const
+{
+    return hits + misses == 0 ? 0.0 : (double)hits / (double)(hits + misses);
+}
+
+// Called by the SDK when the last reference to a pooled image is released
+static void release_pooled_buffer(void* buffer, void* context)
+{
+    (void)buffer;
+    FramePoolBuffer* pooled_buffer = (FramePoolBuffer*)context;
+    std::shared_ptr<FramePoolState> state = std::move(pooled_buffer->state);
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->free_buffers[pooled_buffer->key].emplace_back(pooled_buffer);
+}
+
+FramePool::FramePool() : state(std::make_shared<FramePoolState>())
+{
+}
+
+k4a::image FramePool::create_image(k4a_image_format_t format, int width_pixels, int height_pixels, int stride_bytes)
+{
+    std::tuple<int, int, int, int> key = { (int)format, width_pixels, height_pixels, stride_bytes };
+    size_t size = (size_t)height_pixels * stride_bytes;
+
+    std::unique_ptr<FramePoolBuffer> pooled_buffer;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        std::vector<std::unique_ptr<FramePoolBuffer>>& free_buffers = state->free_buffers[key];
+        if (!free_buffers.empty())
+        {
+            pooled_buffer = std::move(free_buffers.back());
+            free_buffers.pop_back();
+            state->stats.hits++;
+        }
+        else
+        {
+            state->stats.misses++;
+        }
+    }
+
+    if (!pooled_buffer)
+    {
+        pooled_buffer = std::make_unique<FramePoolBuffer>();
+        pooled_buffer->key = key;
+        pooled_buffer->storage.resize(size);
+    }
+    pooled_buffer->state = state;
+
+    uint8_t* buffer = pooled_buffer->storage.data();
+    FramePoolBuffer* context = pooled_buffer.release();
+    return k4a::image::create_from_buffer(
+        format,
+        width_pixels,
+        height_pixels,
+        stride_bytes,
+        buffer,
+        size,
+        release_pooled_buffer,
+        context);
+}
+
+cv::Mat FramePool::create_mat(int rows, int cols, int type, k4a::image& backing)
+{
+    int stride_bytes = cols * (int)CV_ELEM_SIZE(type);
+    backing = create_image(K4A_IMAGE_FORMAT_CUSTOM, stride_bytes, rows, stride_bytes);
+    return cv::Mat(rows, cols, type, backing.get_buffer(), stride_bytes);
+}
+
+FramePoolStats FramePool::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->stats;
+}
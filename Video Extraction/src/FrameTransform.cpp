@@ -0,0 +1,163 @@
+#include "../include/FrameTransform.hpp"
+
+// The transformation takes IR as a custom image. This only wraps the IR buffer, which stays owned by ir_image
+static k4a::image wrap_ir_image(const k4a::image& ir_image)
+{
+    k4a::image image = ir_image;
+    return k4a::image::create_from_buffer(
+        K4A_IMAGE_FORMAT_CUSTOM16,
+        image.get_width_pixels(),
+        image.get_height_pixels(),
+        image.get_width_pixels() * (int)sizeof(uint16_t),
+        image.get_buffer(),
+        image.get_height_pixels() * image.get_stride_bytes(),
+        NULL,
+        NULL);
+}
+
+void transform_depth_and_ir(
+    const k4a::transformation& transformation,
+    const k4a::image& depth_image,
+    const k4a::image& ir_image,
+    int color_image_width_pixels,
+    int color_image_height_pixels,
+    FramePool& pool,
+    k4a::image& transformed_depth_image,
+    k4a::image& transformed_ir_image)
+{
+    k4a::image custom_ir_image = wrap_ir_image(ir_image);
+
+    transformed_depth_image = pool.create_image(
+        K4A_IMAGE_FORMAT_DEPTH16,
+        color_image_width_pixels,
+        color_image_height_pixels,
+        color_image_width_pixels * (int)sizeof(uint16_t));
+
+    transformed_ir_image = pool.create_image(
+        K4A_IMAGE_FORMAT_CUSTOM16,
+        color_image_width_pixels,
+        color_image_height_pixels,
+        color_image_width_pixels * (int)sizeof(uint16_t));
+
+    transformation.depth_image_to_color_camera_custom(
+        depth_image,
+        custom_ir_image,
+        &transformed_depth_image,
+        &transformed_ir_image,
+        K4A_TRANSFORMATION_INTERPOLATION_TYPE_NEAREST,
+        0);
+}
+
+void transform_depth(
+    const k4a::transformation& transformation,
+    const k4a::image& depth_image,
+    int color_image_width_pixels,
+    int color_image_height_pixels,
+    FramePool& pool,
+    k4a::image& transformed_depth_image)
+{
+    transformed_depth_image = pool.create_image(
+        K4A_IMAGE_FORMAT_DEPTH16,
+        color_image_width_pixels,
+        color_image_height_pixels,
+        color_image_width_pixels * (int)sizeof(uint16_t));
+
+    transformation.depth_image_to_color_camera(depth_image, &transformed_depth_image);
+}
+
+void transform_color(
+    const k4a::transformation& transformation,
+    const k4a::image& depth_image,
+    const cv::Mat& color_image,
+    FramePool& pool,
+    k4a::image& transformed_color_image)
+{
+    k4a::image bgra_image = pool.create_image(
+        K4A_IMAGE_FORMAT_COLOR_BGRA32,
+        color_image.cols,
+        color_image.rows,
+        color_image.cols * 4);
+    cv::Mat bgra(color_image.rows, color_image.cols, CV_8UC4, bgra_image.get_buffer());
+    if (color_image.channels() == 3)
+    {
+        cv::cvtColor(color_image, bgra, cv::COLOR_BGR2BGRA);
+    }
+    else
+    {
+        color_image.copyTo(bgra);
+    }
+
+    transformed_color_image = pool.create_image(
+        K4A_IMAGE_FORMAT_COLOR_BGRA32,
+        depth_image.get_width_pixels(),
+        depth_image.get_height_pixels(),
+        depth_image.get_width_pixels() * 4);
+
+    transformation.color_image_to_depth_camera(depth_image, bgra_image, &transformed_color_image);
+}
+
+k4a::image copy_image(const k4a::image& image, FramePool& pool)
+{
+    int row_bytes = image.get_width_pixels() * (int)sizeof(uint16_t);
+    k4a::image copy = pool.create_image(image.get_format(), image.get_width_pixels(), image.get_height_pixels(),
+        row_bytes);
+    const uint8_t* source = image.get_buffer();
+    uint8_t* destination = copy.get_buffer();
+    for (int y = 0; y < image.get_height_pixels(); y++)
+    {
+        std::memcpy(destination + (size_t)y * row_bytes, source + (size_t)y * image.get_stride_bytes(), row_bytes);
+    }
+    return copy;
+}
+
+void benchmarkColorTransformation(const k4a::calibration& calibration, const k4a::capture& capture, int iterations)
+{
+    k4a::image depth_image = capture.get_depth_image();
+    k4a::image color_image = capture.get_color_image();
+    k4a::image ir_image = capture.get_ir_image();
+    if (!depth_image.is_valid() || !color_image.is_valid() || !ir_image.is_valid())
+    {
+        std::cerr << "The benchmark needs a capture with depth, color and IR images" << std::endl;
+        return;
+    }
+
+    int width = color_image.get_width_pixels();
+    int height = color_image.get_height_pixels();
+    k4a::transformation transformation(calibration);
+    FramePool pool;
+    k4a::image separate_depth_image;
+    k4a::image fused_depth_image;
+    k4a::image transformed_ir_image;
+
+    // What both extraction paths used to do: the depth alone, then depth and IR again
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        separate_depth_image = pool.create_image(K4A_IMAGE_FORMAT_DEPTH16, width, height, width * (int)sizeof(uint16_t));
+        transformation.depth_image_to_color_camera(depth_image, &separate_depth_image);
+
+        k4a::image reference_depth_image;
+        transform_depth_and_ir(transformation, depth_image, ir_image, width, height, pool,
+            reference_depth_image, transformed_ir_image);
+    }
+    auto middle = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        transform_depth_and_ir(transformation, depth_image, ir_image, width, height, pool,
+            fused_depth_image, transformed_ir_image);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double separate_ms = std::chrono::duration<double, std::milli>(middle - start).count() / iterations;
+    double fused_ms = std::chrono::duration<double, std::milli>(end - middle).count() / iterations;
+
+    cv::Mat separate_depth(height, width, CV_16UC1, separate_depth_image.get_buffer());
+    cv::Mat fused_depth(height, width, CV_16UC1, fused_depth_image.get_buffer());
+    int differing_pixels = cv::countNonZero(separate_depth != fused_depth);
+
+    std::cout << width << "x" << height << " color: separate " << separate_ms << " ms/frame, fused " << fused_ms
+        << " ms/frame, saving " << separate_ms - fused_ms << " ms/frame (" << 100.0 * (1.0 - fused_ms / separate_ms)
+        << "%), " << differing_pixels << " depth pixels differ" << std::endl;
+
+    transformation.destroy();
+}
@@ -0,0 +1,472 @@
+#include "../include/HeadPose.hpp"
+
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+
+#ifdef VIDEO_EXTRACTION_HEAD_POSE
+#include <opencv2/objdetect.hpp>
+#include <onnxruntime_cxx_api.h>
+#endif
+
+// transforms.Normalize of demo.py, the ImageNet mean and standard deviation, applied to the channels in the order given
+static const float INPUT_MEAN[3] = { 0.485f, 0.456f, 0.406f };
+static const float INPUT_STD[3] = { 0.229f, 0.224f, 0.225f };
+
+// utils.normalize_vector
+static void normalize_vector(float* v)
+{
+    float magnitude = std::max(std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]), 1e-8f);
+    v[0] /= magnitude;
+    v[1] /= magnitude;
+    v[2] /= magnitude;
+}
+
+// utils.cross_product
+static void cross_product(const float* u, const float* v, float* out)
+{
+    out[0] = u[1] * v[2] - u[2] * v[1];
+    out[1] = u[2] * v[0] - u[0] * v[2];
+    out[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+void ortho6d_to_rotation_matrix(const float* ortho6d, float* rotation)
+{
+    float x[3] = { ortho6d[0], ortho6d[1], ortho6d[2] };
+    float z[3];
+    float y[3];
+    normalize_vector(x);
+    cross_product(x, ortho6d + 3, z);
+    normalize_vector(z);
+    cross_product(z, x, y);
+
+    for (int row = 0; row < 3; row++)
+    {
+        rotation[row * 3 + 0] = x[row];
+        rotation[row * 3 + 1] = y[row];
+        rotation[row * 3 + 2] = z[row];
+    }
+}
+
+void rotation_matrix_to_euler_angles(const float* rotation, float* euler)
+{
+    const float* R = rotation;
+    float sy = std::sqrt(R[0] * R[0] + R[3] * R[3]);
+    if (sy < 1e-6f)
+    {
+        euler[0] = std::atan2(-R[5], R[4]);
+        euler[1] = std::atan2(-R[6], sy);
+        euler[2] = 0.0f;
+    }
+    else
+    {
+        euler[0] = std::atan2(R[7], R[8]);
+        euler[1] = std::atan2(-R[6], sy);
+        euler[2] = std::atan2(R[3], R[0]);
+    }
+}
+
+cv::Rect get_face_crop(const cv::Rect& face, const cv::Size& image_size)
+{
+    // demo.py widens by the height and heightens by the width
+    int x_min = std::max(0, face.x - (int)(0.2 * face.height));
+    int y_min = std::max(0, face.y - (int)(0.2 * face.width));
+    int x_max = std::min(image_size.width, face.x + face.width + (int)(0.2 * face.height));
+    int y_max = std::min(image_size.height, face.y + face.height + (int)(0.2 * face.width));
+    return cv::Rect(x_min, y_min, std::max(0, x_max - x_min), std::max(0, y_max - y_min));
+}
+
+// Resize(224), CenterCrop(224), ToTensor and Normalize of demo.py: the shorter side scaled to the input size, the
+// center cut out and written channel by channel, normalized. The channels stay in OpenCV's BGR order: demo.py
+// hands the BGR frame to Image.fromarray, whose convert('RGB') does not reorder them
+static void fill_input_tensor(const cv::Mat& crop, std::vector<float>& tensor)
+{
+    const int size = HEAD_POSE_INPUT_SIZE;
+    cv::Size scaled_size = crop.cols <= crop.rows ?
+        cv::Size(size, std::max(size, (int)((double)size * crop.rows / crop.cols))) :
+        cv::Size(std::max(size, (int)((double)size * crop.cols / crop.rows)), size);
+    cv::Mat scaled;
+    cv::resize(crop, scaled, scaled_size, 0, 0, scaled_size.width < crop.cols ? cv::INTER_AREA : cv::INTER_LINEAR);
+
+    int left = (int)std::lround((scaled.cols - size) / 2.0);
+    int top = (int)std::lround((scaled.rows - size) / 2.0);
+    cv::Mat input = scaled(cv::Rect(left, top, size, size));
+
+    tensor.resize((size_t)3 * size * size);
+    float* channels[3] = { tensor.data(), tensor.data() + size * size, tensor.data() + 2 * size * size };
+    for (int y = 0; y < size; y++)
+    {
+        const uchar* row = input.ptr<uchar>(y);
+        for (int x = 0; x < size; x++)
+        {
+            const uchar* pixel = row + x * input.channels();
+            for (int c = 0; c < 3; c++)
+            {
+                channels[c][y * size + x] = (pixel[c] / 255.0f - INPUT_MEAN[c]) / INPUT_STD[c];
+            }
+        }
+    }
+}
+
+#ifdef VIDEO_EXTRACTION_HEAD_POSE
+
+struct HeadPoseEstimator::Models
+{
+    Models(const HeadPoseConfig& config)
+        : env(ORT_LOGGING_LEVEL_WARNING, "head_pose"),
+        session(nullptr),
+        memory_info(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault))
+    {
+        Ort::SessionOptions options;
+        options.SetIntraOpNumThreads(std::max(config.inference_threads, 1));
+        options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+        session = Ort::Session(env, std::filesystem::path(config.model_path).c_str(), options);
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        input_name = session.GetInputNameAllocated(0, allocator).get();
+        output_name = session.GetOutputNameAllocated(0, allocator).get();
+
+        // Throws if the detector cannot be loaded, the later ones are created the same way
+        detectors.push_back(create_detector(config));
+    }
+
+    static cv::Ptr<cv::FaceDetectorYN> create_detector(const HeadPoseConfig& config)
+    {
+        return cv::FaceDetectorYN::create(config.detector_path, "", cv::Size(320, 320), config.score_threshold);
+    }
+
+    Ort::Env env;
+    Ort::Session session;
+    Ort::MemoryInfo memory_info;
+    std::string input_name;
+    std::string output_name;
+
+    // A detector keeps the size of its last input and is used by one thread at a time, the idle ones wait here
+    std::vector<cv::Ptr<cv::FaceDetectorYN>> detectors;
+    std::mutex detectors_mutex;
+};
+
+#else
+
+struct HeadPoseEstimator::Models
+{
+};
+
+#endif
+
+HeadPoseEstimator::HeadPoseEstimator() = default;
+
+HeadPoseEstimator::~HeadPoseEstimator()
+{
+    close();
+}
+
+bool HeadPoseEstimator::open(const HeadPoseConfig& config, Profiler* profiler)
+{
+#ifdef VIDEO_EXTRACTION_HEAD_POSE
+    this->config = config;
+    this->config.batch_size = std::max<size_t>(config.batch_size, 1);
+    this->profiler = profiler;
+    try
+    {
+        models = std::make_unique<Models>(this->config);
+    }
+    catch (const Ort::Exception& e)
+    {
+        std::cerr << "Error loading head pose model: " << config.model_path << ": " << e.what() << std::endl;
+        return false;
+    }
+    catch (const cv::Exception& e)
+    {
+        std::cerr << "Error loading face detector: " << config.detector_path << ": " << e.what() << std::endl;
+        return false;
+    }
+    closed = false;
+    inference_thread = std::thread(&HeadPoseEstimator::inference_worker, this);
+    return true;
+#else
+    std::cerr << "Head pose estimation needs a build with -DVIDEO_EXTRACTION_HEAD_POSE=ON" << std::endl;
+    return false;
+#endif
+}
+
+bool HeadPoseEstimator::is_open() const
+{
+    return inference_thread.joinable();
+}
+
+std::future<std::vector<HeadPose>> HeadPoseEstimator::estimate(const cv::Mat& color_image)
+{
+    std::shared_ptr<FrameRequest> frame = std::make_shared<FrameRequest>();
+    std::future<std::vector<HeadPose>> result = frame->promise.get_future();
+    if (!is_open())
+    {
+        frame->promise.set_value({});
+        return result;
+    }
+
+    std::vector<FaceCrop> crops;
+    for (const HeadPose& face : detect_faces(color_image))
+    {
+        FaceCrop crop;
+        crop.frame = frame;
+        crop.pose = face;
+        fill_input_tensor(color_image(face.box), crop.tensor);
+        crops.push_back(std::move(crop));
+    }
+
+    if (crops.empty())
+    {
+        frame->promise.set_value({});
+        return result;
+    }
+
+    frame->remaining = crops.size();
+    std::unique_lock<std::mutex> lock(mutex);
+    for (FaceCrop& crop : crops)
+    {
+        space_available.wait(lock, [this] {
+            return pending_crops.size() < HEAD_POSE_QUEUED_BATCHES * config.batch_size || closed;
+        });
+        crop.queued = std::chrono::steady_clock::now();
+        pending_crops.push_back(std::move(crop));
+        crops_available.notify_one();
+    }
+    return result;
+}
+
+void HeadPoseEstimator::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        crops_available.notify_all();
+        space_available.notify_all();
+    }
+    if (inference_thread.joinable())
+    {
+        inference_thread.join();
+    }
+    models.reset();
+}
+
+// Faces above the score threshold, with the crop of demo.py and the detection score
+std::vector<HeadPose> HeadPoseEstimator::detect_faces(const cv::Mat& color_image)
+{
+    std::vector<HeadPose> faces;
+#ifdef VIDEO_EXTRACTION_HEAD_POSE
+    cv::Mat image = color_image;
+    if (color_image.channels() == 4)
+    {
+        cv::cvtColor(color_image, image, cv::COLOR_BGRA2BGR);
+    }
+
+    // The faces are found in a scaled down copy, a face filling a fraction of a 4K image has plenty of pixels left
+    double scale = 1.0;
+    if (config.detection_width > 0 && image.cols > config.detection_width)
+    {
+        scale = (double)config.detection_width / image.cols;
+        cv::resize(image, image, cv::Size(), scale, scale, cv::INTER_AREA);
+    }
+
+    cv::Ptr<cv::FaceDetectorYN> detector;
+    {
+        std::lock_guard<std::mutex> lock(models->detectors_mutex);
+        if (!models->detectors.empty())
+        {
+            detector = models->detectors.back();
+            models->detectors.pop_back();
+        }
+    }
+    if (!detector)
+    {
+        detector = Models::create_detector(config);
+    }
+
+    // One row per face: x, y, width, height, 5 landmarks and the score
+    cv::Mat detections;
+    try
+    {
+        detector->setInputSize(image.size());
+        detector->detect(image, detections);
+    }
+    catch (const cv::Exception& e)
+    {
+        std::cerr << "Error detecting faces: " << e.what() << std::endl;
+        detections.release();
+    }
+    {
+        std::lock_guard<std::mutex> lock(models->detectors_mutex);
+        models->detectors.push_back(detector);
+    }
+
+    for (int i = 0; i < detections.rows; i++)
+    {
+        const float* detection = detections.ptr<float>(i);
+        if (detection[14] < config.score_threshold)
+        {
+            continue;
+        }
+        cv::Rect face((int)(detection[0] / scale), (int)(detection[1] / scale), (int)(detection[2] / scale),
+            (int)(detection[3] / scale));
+        HeadPose pose;
+        pose.box = get_face_crop(face, color_image.size());
+        pose.score = detection[14];
+        if (!pose.box.empty())
+        {
+            faces.push_back(pose);
+        }
+    }
+#endif
+    return faces;
+}
+
+// Gathers batches of crops until the estimator is closed and every queued crop is done
+void HeadPoseEstimator::inference_worker()
+{
+    std::vector<FaceCrop> crops;
+    std::vector<float> batch;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            crops_available.wait(lock, [this] { return !pending_crops.empty() || closed; });
+            if (pending_crops.empty())
+            {
+                return;
+            }
+
+            // A full batch, or what arrived until the oldest crop has waited batch_timeout
+            crops_available.wait_until(lock, pending_crops.front().queued + config.batch_timeout, [this] {
+                return pending_crops.size() >= config.batch_size || closed;
+            });
+            size_t count = std::min(pending_crops.size(), config.batch_size);
+            for (size_t i = 0; i < count; i++)
+            {
+                crops.push_back(std::move(pending_crops.front()));
+                pending_crops.pop_front();
+            }
+            space_available.notify_all();
+        }
+
+        run_batch(crops, batch);
+        crops.clear();
+    }
+}
+
+// Runs the model on the crops and completes the frames whose last face was in the batch. The faces of a failed
+// batch are left out of their frames
+void HeadPoseEstimator::run_batch(std::vector<FaceCrop>& crops, std::vector<float>& batch)
+{
+#ifdef VIDEO_EXTRACTION_HEAD_POSE
+    const size_t crop_size = (size_t)3 * HEAD_POSE_INPUT_SIZE * HEAD_POSE_INPUT_SIZE;
+    batch.resize(crops.size() * crop_size);
+    for (size_t i = 0; i < crops.size(); i++)
+    {
+        std::copy(crops[i].tensor.begin(), crops[i].tensor.end(), batch.begin() + i * crop_size);
+    }
+
+    std::vector<float> outputs;
+    size_t output_size = 0;
+    try
+    {
+        ScopedTimer timer(profiler, ProfileStage::HeadPoseInference);
+        int64_t shape[4] = { (int64_t)crops.size(), 3, HEAD_POSE_INPUT_SIZE, HEAD_POSE_INPUT_SIZE };
+        Ort::Value input = Ort::Value::CreateTensor<float>(models->memory_info, batch.data(), batch.size(), shape, 4);
+        const char* input_names[] = { models->input_name.c_str() };
+        const char* output_names[] = { models->output_name.c_str() };
+        std::vector<Ort::Value> results = models->session.Run(Ort::RunOptions{ nullptr }, input_names, &input, 1,
+            output_names, 1);
+
+        // 6 values per crop for the 6D pose, 9 for the rotation matrix of the unmodified forward
+        const float* data = results[0].GetTensorData<float>();
+        outputs.assign(data, data + results[0].GetTensorTypeAndShapeInfo().GetElementCount());
+        output_size = outputs.size() / crops.size();
+        if (output_size != 6 && output_size != 9)
+        {
+            std::cerr << "Unexpected head pose model output of " << output_size << " values per face" << std::endl;
+            outputs.clear();
+        }
+    }
+    catch (const Ort::Exception& e)
+    {
+        std::cerr << "Error running the head pose model: " << e.what() << std::endl;
+        outputs.clear();
+    }
+
+    for (size_t i = 0; i < crops.size(); i++)
+    {
+        FrameRequest& frame = *crops[i].frame;
+        if (!outputs.empty())
+        {
+            HeadPose& pose = crops[i].pose;
+            const float* output = outputs.data() + i * output_size;
+            if (output_size == 6)
+            {
+                ortho6d_to_rotation_matrix(output, pose.rotation);
+            }
+            else
+            {
+                std::copy(output, output + 9, pose.rotation);
+            }
+            float euler[3];
+            rotation_matrix_to_euler_angles(pose.rotation, euler);
+            pose.pitch = euler[0] * 180.0f / (float)CV_PI;
+            pose.yaw = euler[1] * 180.0f / (float)CV_PI;
+            pose.roll = euler[2] * 180.0f / (float)CV_PI;
+            frame.poses.push_back(pose);
+        }
+        if (--frame.remaining == 0)
+        {
+            frame.promise.set_value(std::move(frame.poses));
+        }
+    }
+#endif
+}
+
+bool HeadPoseLog::open(const std::filesystem::path& path)
+{
+    bool new_file = !std::filesystem::exists(path) || std::filesystem::file_size(path) == 0;
+    file.open(path, std::ios::app);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path.string() << std::endl;
+        return false;
+    }
+    if (new_file)
+    {
+        file << "device_timestamp_usec,face,score,x,y,width,height,pitch,yaw,roll,"
+            "r00,r01,r02,r10,r11,r12,r20,r21,r22\n";
+    }
+    return true;
+}
+
+void HeadPoseLog::append(int64_t device_timestamp_usec, const std::vector<HeadPose>& poses)
+{
+    for (size_t i = 0; i < poses.size(); i++)
+    {
+        const HeadPose& pose = poses[i];
+        file << device_timestamp_usec << ',' << i << ',' << pose.score << ',' << pose.box.x << ',' << pose.box.y
+            << ',' << pose.box.width << ',' << pose.box.height << ',' << pose.pitch << ',' << pose.yaw << ','
+            << pose.roll;
+        for (float value : pose.rotation)
+        {
+            file << ',' << value;
+        }
+        file << '\n';
+    }
+}
+
+void HeadPoseLog::flush()
+{
+    file.flush();
+}
+
+void HeadPoseLog::close()
+{
+    file.close();
+}
+
+bool HeadPoseLog::is_open() const
+{
+    return file.is_open();
+}
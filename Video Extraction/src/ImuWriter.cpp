@@ -0,0 +1,286 @@
+#include "../include/ImuWriter.hpp"
+
+std::string imu_extension(ImuFormat format)
+{
+    switch (format)
+    {
+    case ImuFormat::Csv:
+        return ".csv";
+    case ImuFormat::Bin:
+        return ".bin";
+    default:
+        return ".ndjson";
+    }
+}
+
+ImuWriter::~ImuWriter()
+{
+    close();
+}
+
+bool ImuWriter::open(const std::string& path, ImuFormat format, bool frame_index)
+{
+    this->format = format;
+    tagged = frame_index;
+    samples = 0;
+    buffer.clear();
+    buffer.reserve(IMU_WRITER_BUFFER_BYTES + 512);
+
+    file.open(path, format == ImuFormat::Bin ? std::ios::binary | std::ios::trunc : std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    if (format == ImuFormat::Csv)
+    {
+        buffer += "acc_x,acc_y,acc_z,acc_timestamp_usec,gyro_x,gyro_y,gyro_z,gyro_timestamp_usec,temperature";
+        buffer += tagged ? ",frame_index\n" : "\n";
+    }
+    return true;
+}
+
+template <typename T>
+static void append_bytes(std::string& buffer, T value)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    buffer.append(bytes, sizeof(T));
+}
+
+void ImuWriter::append(const k4a_imu_sample_t& sample, int64_t frame_index)
+{
+    const k4a_float3_t& acc = sample.acc_sample;
+    const k4a_float3_t& gyro = sample.gyro_sample;
+    char line[512];
+    int length = 0;
+
+    // %.9g keeps every bit of a float32
+    switch (format)
+    {
+    case ImuFormat::Ndjson:
+        length = std::snprintf(line, sizeof(line),
+            "{\"acc_sample\":{\"x\":%.9g,\"y\":%.9g,\"z\":%.9g},\"acc_timestamp_usec\":%llu,"
+            "\"gyro_sample\":{\"x\":%.9g,\"y\":%.9g,\"z\":%.9g},\"gyro_timestamp_usec\":%llu,\"temperature\":%.9g",
+            acc.xyz.x, acc.xyz.y, acc.xyz.z, (unsigned long long)sample.acc_timestamp_usec,
+            gyro.xyz.x, gyro.xyz.y, gyro.xyz.z, (unsigned long long)sample.gyro_timestamp_usec, sample.temperature);
+        buffer.append(line, length);
+        if (tagged)
+        {
+            buffer += ",\"frame_index\":";
+            buffer += std::to_string(frame_index);
+        }
+        buffer += "}\n";
+        break;
+    case ImuFormat::Csv:
+        length = std::snprintf(line, sizeof(line), "%.9g,%.9g,%.9g,%llu,%.9g,%.9g,%.9g,%llu,%.9g",
+            acc.xyz.x, acc.xyz.y, acc.xyz.z, (unsigned long long)sample.acc_timestamp_usec,
+            gyro.xyz.x, gyro.xyz.y, gyro.xyz.z, (unsigned long long)sample.gyro_timestamp_usec, sample.temperature);
+        buffer.append(line, length);
+        if (tagged)
+        {
+            buffer += ',';
+            buffer += std::to_string(frame_index);
+        }
+        buffer += '\n';
+        break;
+    case ImuFormat::Bin:
+        append_bytes(buffer, acc.xyz.x);
+        append_bytes(buffer, acc.xyz.y);
+        append_bytes(buffer, acc.xyz.z);
+        append_bytes(buffer, (uint64_t)sample.acc_timestamp_usec);
+        append_bytes(buffer, gyro.xyz.x);
+        append_bytes(buffer, gyro.xyz.y);
+        append_bytes(buffer, gyro.xyz.z);
+        append_bytes(buffer, (uint64_t)sample.gyro_timestamp_usec);
+        append_bytes(buffer, sample.temperature);
+        if (tagged)
+        {
+            append_bytes(buffer, frame_index);
+        }
+        break;
+    }
+    samples++;
+
+    if (buffer.size() >= IMU_WRITER_BUFFER_BYTES)
+    {
+        flush();
+    }
+}
+
+void ImuWriter::flush()
+{
+    file.write(buffer.data(), (std::streamsize)buffer.size());
+    file.flush();
+    buffer.clear();
+}
+
+void ImuWriter::close()
+{
+    if (file.is_open())
+    {
+        flush();
+    }
+    file.close();
+}
+
+bool ImuWriter::is_open() const
+{
+    return file.is_open();
+}
+
+uint64_t ImuWriter::get_sample_count() const
+{
+    return samples;
+}
+
+ImuStreamWriter::ImuStreamWriter(size_t sample_capacity, size_t frame_capacity)
+    : sample_ring(sample_capacity),
+    frame_ring(frame_capacity)
+{
+}
+
+ImuStreamWriter::~ImuStreamWriter()
+{
+    close();
+}
+
+bool ImuStreamWriter::open(const std::string& path, ImuFormat format)
+{
+    if (!writer.open(path, format, true))
+    {
+        return false;
+    }
+    running = true;
+    thread = std::thread(&ImuStreamWriter::run, this);
+    return true;
+}
+
+void ImuStreamWriter::push_sample(const k4a_imu_sample_t& sample)
+{
+    if (!sample_ring.try_push(sample))
+    {
+        dropped_samples++;
+    }
+}
+
+void ImuStreamWriter::push_frame(const ImuFrameTag& frame)
+{
+    frame_ring.try_push(frame);
+}
+
+void ImuStreamWriter::close()
+{
+    running = false;
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+    writer.close();
+}
+
+uint64_t ImuStreamWriter::get_sample_count() const
+{
+    return writer.get_sample_count();
+}
+
+uint64_t ImuStreamWriter::get_dropped_sample_count() const
+{
+    return dropped_samples;
+}
+
+void ImuStreamWriter::run()
+{
+    while (true)
+    {
+        // Read before draining, so nothing pushed before close is missed
+        bool final = !running;
+
+        bool received = false;
+        ImuFrameTag frame;
+        while (frame_ring.try_pop(frame))
+        {
+            frames.push_back(frame);
+            received = true;
+        }
+        k4a_imu_sample_t sample;
+        while (sample_ring.try_pop(sample))
+        {
+            pending_samples.push_back(sample);
+            received = true;
+        }
+
+        write_pending(final);
+        if (final)
+        {
+            return;
+        }
+        if (!received)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        }
+    }
+}
+
+void ImuStreamWriter::write_pending(bool final)
+{
+    while (!pending_samples.empty())
+    {
+        const k4a_imu_sample_t& sample = pending_samples.front();
+        int64_t timestamp = (int64_t)sample.acc_timestamp_usec;
+
+        // Keep the last frame before the sample and the frames after it
+        while (frames.size() >= 2 && frames[1].timestamp_usec <= timestamp)
+        {
+            frames.pop_front();
+        }
+
+        // Without the frame after the sample it cannot be told whether a closer frame follows. The samples wait
+        // for it unless the frame loop stopped announcing frames long ago
+        bool decided = frames.size() >= 2 || (frames.size() == 1 && frames[0].timestamp_usec >= timestamp);
+        if (!decided && !final && pending_samples.size() < sample_ring.capacity())
+        {
+            return;
+        }
+
+        int64_t frame_index = -1;
+        if (frames.size() >= 2)
+        {
+            frame_index = timestamp - frames[0].timestamp_usec <= frames[1].timestamp_usec - timestamp ?
+                frames[0].index : frames[1].index;
+        }
+        else if (frames.size() == 1)
+        {
+            frame_index = frames[0].index;
+        }
+        writer.append(sample, frame_index);
+        pending_samples.pop_front();
+    }
+}
+
+// Write the IMU samples of the recording, one at a time
+bool extract_imu(k4a::playback& playback, const std::string& imu_path, ImuFormat format)
+{
+    ImuWriter writer;
+    if (!writer.open(imu_path, format))
+    {
+        return false;
+    }
+
+    k4a_imu_sample_t imu_sample;
+    while (playback.get_next_imu_sample(&imu_sample))
+    {
+        writer.append(imu_sample);
+    }
+
+    writer.close();
+    return true;
+}
+
+bool extract_imu(const std::string& input_path, const std::string& imu_path, ImuFormat format)
+{
+    k4a::playback playback = k4a::playback::open(input_path.c_str());
+    bool ok = extract_imu(playback, imu_path, format);
+    playback.close();
+    return ok;
+}
@@ -3,71 +3,313 @@
 
 // Set up all the devices. Note that the index order isn't necessarily preserved, because we might swap with master
 MultiDeviceCapturer::MultiDeviceCapturer(const std::vector<uint32_t>& device_indices, int32_t color_exposure_usec, int32_t powerline_freq)
+    : MultiDeviceCapturer([&] {
+        std::vector<std::unique_ptr<CaptureSource>> sources;
+        for (uint32_t i : device_indices)
+        {
+            sources.push_back(std::make_unique<DeviceCaptureSource>(i, color_exposure_usec, powerline_freq));
+        }
+        return sources;
+    }())
+{
+}
+
+MultiDeviceCapturer::MultiDeviceCapturer(std::vector<std::unique_ptr<CaptureSource>> sources)
 {
     bool master_found = false;
-    if (device_indices.size() == 0)
+    if (sources.size() == 0)
     {
-        std::cerr << "Capturer must be passed at least one camera!\n ";
-        exit(1);
+        throw CaptureError("Capturer must be passed at least one camera!");
     }
-    for (uint32_t i : device_indices)
+    size_t num_sources = sources.size();
+    for (std::unique_ptr<CaptureSource>& next_source : sources)
     {
-        k4a::device next_device = k4a::device::open(i); // construct a device using this index
-        // If you want to synchronize cameras, you need to manually set both their exposures
-        next_device.set_color_control(K4A_COLOR_CONTROL_EXPOSURE_TIME_ABSOLUTE,
-            K4A_COLOR_CONTROL_MODE_MANUAL,
-            color_exposure_usec);
-        // This setting compensates for the flicker of lights due to the frequency of AC power in your region. If
-        // you are in an area with 50 Hz power, this may need to be updated (check the docs for
-        // k4a_color_control_command_t)
-        next_device.set_color_control(K4A_COLOR_CONTROL_POWERLINE_FREQUENCY,
-            K4A_COLOR_CONTROL_MODE_MANUAL,
-            powerline_freq);
         // We treat the first device found with a sync out cable attached as the master. If it's not supposed to be,
         // unplug the cable from it. Also, if there's only one device, just use it
-        if ((next_device.is_sync_out_connected() && !next_device.is_sync_in_connected() && !master_found) || device_indices.size() == 1)
+        if ((next_source->is_sync_out_connected() && !next_source->is_sync_in_connected() && !master_found) || num_sources == 1)
         {
-            master_device = std::move(next_device);
+            master_source = std::move(next_source);
             master_found = true;
         }
-        else if (!next_device.is_sync_in_connected() && !next_device.is_sync_out_connected())
+        else if (!next_source->is_sync_in_connected() && !next_source->is_sync_out_connected())
         {
-            std::cerr << "Each device must have sync in or sync out connected!\n ";
-            exit(1);
+            throw CaptureError("Each device must have sync in or sync out connected: " + next_source->get_name());
         }
-        else if (!next_device.is_sync_in_connected())
+        else if (!next_source->is_sync_in_connected())
         {
-            std::cerr << "Non-master camera found that doesn't have the sync in port connected!\n ";
-            exit(1);
+            throw CaptureError("Non-master camera found that doesn't have the sync in port connected: " +
+                next_source->get_name());
         }
         else
         {
-            subordinate_devices.emplace_back(std::move(next_device));
+            subordinate_sources.emplace_back(std::move(next_source));
         }
     }
     if (!master_found)
     {
-        std::cerr << "No device with sync out connected found!\n ";
-        exit(1);
+        throw CaptureError("No device with sync out connected found!");
     }
 }
 
+MultiDeviceCapturer::~MultiDeviceCapturer()
+{
+    stop_reader_threads();
+    stop_imu_threads();
+}
+
 // configs[0] should be the master, the rest subordinate
 void MultiDeviceCapturer::start_devices(const k4a_device_configuration_t& master_config, const k4a_device_configuration_t& sub_config)
 {
+    frame_period = get_frame_period(master_config.camera_fps);
+
     // Start by starting all of the subordinate devices. They must be started before the master!
-    for (k4a::device& d : subordinate_devices)
+    for (std::unique_ptr<CaptureSource>& s : subordinate_sources)
     {
-        d.start_cameras(&sub_config);
+        s->start_cameras(sub_config);
     }
     // Lastly, start the master device
-    master_device.start_cameras(&master_config);
+    master_source->start_cameras(master_config);
+}
+
+void MultiDeviceCapturer::start_reader_threads(size_t ring_capacity)
+{
+    if (readers_running)
+    {
+        return;
+    }
+    readers.clear();
+    for (size_t i = 0; i < subordinate_sources.size() + 1; i++)
+    {
+        readers.push_back(std::make_unique<DeviceReader>(ring_capacity));
+        readers.back()->source = i == 0 ? master_source.get() : subordinate_sources[i - 1].get();
+    }
+    readers_running = true;
+    for (std::unique_ptr<DeviceReader>& device_reader : readers)
+    {
+        device_reader->thread = std::thread(&MultiDeviceCapturer::reader, this, std::ref(*device_reader));
+    }
+}
+
+void MultiDeviceCapturer::stop_reader_threads()
+{
+    readers_running = false;
+    for (std::unique_ptr<DeviceReader>& device_reader : readers)
+    {
+        if (device_reader->thread.joinable())
+        {
+            device_reader->thread.join();
+        }
+    }
+}
+
+void MultiDeviceCapturer::start_imu_threads(const std::vector<ImuStreamWriter*>& imu_writers)
+{
+    if (imu_running)
+    {
+        return;
+    }
+    imu_running = true;
+    for (size_t i = 0; i < subordinate_sources.size() + 1 && i < imu_writers.size(); i++)
+    {
+        CaptureSource& source = i == 0 ? *master_source : *subordinate_sources[i - 1];
+        source.start_imu();
+        imu_threads.emplace_back(&MultiDeviceCapturer::imu_reader, this, std::ref(source), std::ref(*imu_writers[i]));
+    }
+}
+
+void MultiDeviceCapturer::stop_imu_threads()
+{
+    if (!imu_running)
+    {
+        return;
+    }
+    imu_running = false;
+    for (std::thread& imu_thread : imu_threads)
+    {
+        imu_thread.join();
+    }
+    for (size_t i = 0; i < imu_threads.size(); i++)
+    {
+        (i == 0 ? *master_source : *subordinate_sources[i - 1]).stop_imu();
+    }
+    imu_threads.clear();
 }
 
-// Blocks until we have synchronized captures stored in the output. First is master, rest are subordinates
+std::vector<CaptureDeviceStats> MultiDeviceCapturer::get_device_stats() const
+{
+    std::vector<CaptureDeviceStats> stats;
+    for (const std::unique_ptr<DeviceReader>& device_reader : readers)
+    {
+        CaptureDeviceStats device_stats;
+        device_stats.captures = device_reader->captures;
+        device_stats.ring_drops = device_reader->ring_drops;
+        device_stats.sdk_drops = device_reader->sdk_drops;
+        stats.push_back(device_stats);
+    }
+    if (synchronizer)
+    {
+        SynchronizerStats synchronizer_stats = synchronizer->get_stats();
+        for (size_t i = 0; i < stats.size(); i++)
+        {
+            stats[i].unmatched = synchronizer_stats.discarded[i];
+        }
+    }
+    return stats;
+}
+
+// Reads the captures of one device as fast as it delivers them. Never waits for the consumer: when the ring is
+// full the new capture is dropped and counted, the queue of the SDK keeps being drained either way
+void MultiDeviceCapturer::reader(DeviceReader& device_reader)
+{
+    k4a::capture capture;
+    while (readers_running)
+    {
+        try
+        {
+            // Short timeout, so the thread notices when it is stopped
+            if (!device_reader.source->get_capture(&capture, std::chrono::milliseconds{ 100 }))
+            {
+                if (device_reader.source->is_finished())
+                {
+                    device_reader.finished = true;
+                    break;
+                }
+                continue;
+            }
+        }
+        catch (const k4a::error& e)
+        {
+            std::cerr << "Error reading capture: " << e.what() << std::endl;
+            break;
+        }
+        device_reader.captures++;
+
+        k4a::image image = capture.get_color_image();
+        if (!image)
+        {
+            image = capture.get_depth_image();
+        }
+        if (image && frame_period.count() > 0)
+        {
+            int64_t timestamp = image.get_device_timestamp().count();
+            if (device_reader.last_timestamp >= 0)
+            {
+                int64_t missing = (timestamp - device_reader.last_timestamp + frame_period.count() / 2) /
+                    frame_period.count() - 1;
+                if (missing > 0)
+                {
+                    device_reader.sdk_drops += missing;
+                }
+            }
+            device_reader.last_timestamp = timestamp;
+        }
+        image.reset();
+
+        if (!device_reader.ring.try_push(std::move(capture)))
+        {
+            device_reader.ring_drops++;
+        }
+        capture.reset();
+    }
+}
+
+// Drains the IMU queue of the SDK of one device, about 1.6 kHz
+void MultiDeviceCapturer::imu_reader(CaptureSource& source, ImuStreamWriter& imu_writer)
+{
+    k4a_imu_sample_t imu_sample;
+    while (imu_running)
+    {
+        try
+        {
+            if (source.get_imu_sample(&imu_sample, std::chrono::milliseconds{ 100 }))
+            {
+                imu_writer.push_sample(imu_sample);
+            }
+        }
+        catch (const k4a::error& e)
+        {
+            std::cerr << "Error reading IMU sample: " << e.what() << std::endl;
+            break;
+        }
+    }
+}
+
+// Moves the buffered captures into the synchronizer, one per device at a time, until it completes a set. The rest
+// stay in the rings, which hold more captures than the synchronizer window
+std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures_from_rings(
+    const k4a_device_configuration_t& sub_config, bool compare_sub_depth_instead_of_color)
+{
+    if (!synchronizer)
+    {
+        int64_t offset = sub_config.subordinate_delay_off_master_usec +
+            (compare_sub_depth_instead_of_color ? sub_config.depth_delay_off_color_usec : 0);
+        synchronizer = std::make_unique<CaptureSynchronizer>(std::vector<int64_t>(subordinate_sources.size(), offset),
+            compare_sub_depth_instead_of_color);
+    }
+
+    SynchronizedSet set;
+    auto next_set = [&] {
+        ScopedTimer timer(profiler, ProfileStage::SyncMatch);
+        return synchronizer->pop_synchronized_set(set);
+    };
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    while (!next_set())
+    {
+        // Read before popping from the rings, so a reader that finished has pushed all its captures
+        bool source_finished = false;
+        for (std::unique_ptr<DeviceReader>& device_reader : readers)
+        {
+            source_finished = source_finished || device_reader->finished;
+        }
+
+        bool added = false;
+        for (size_t i = 0; i < readers.size(); i++)
+        {
+            k4a::capture capture;
+            if (readers[i]->ring.try_pop(capture))
+            {
+                ScopedTimer timer(profiler, ProfileStage::SyncMatch);
+                synchronizer->add_capture(i, std::move(capture));
+                added = true;
+            }
+        }
+        if (added)
+        {
+            continue;
+        }
+        if (!readers_running)
+        {
+            return {};
+        }
+
+        // A recording that ended completes no more sets once its ring is empty
+        if (source_finished)
+        {
+            return {};
+        }
+
+        // Timeout if this is taking too long
+        int64_t duration_ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count();
+        if (duration_ms > WAIT_FOR_SYNCHRONIZED_CAPTURE_TIMEOUT)
+        {
+            throw CaptureError("Timedout waiting for synchronized captures");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+    return set.captures;
+}
+
+// Blocks until we have synchronized captures stored in the output. First is master, rest are subordinates.
+// Returns an empty vector if the reader threads are stopped while waiting
 std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures(const k4a_device_configuration_t& sub_config,
     bool compare_sub_depth_instead_of_color)
 {
+    if (!readers.empty())
+    {
+        return get_synchronized_captures_from_rings(sub_config, compare_sub_depth_instead_of_color);
+    }
+
     // Dealing with the synchronized cameras is complex. The Azure Kinect DK:
     //      (a) does not guarantee exactly equal timestamps between depth and color or between cameras (delays can
     //      be configured but timestamps will only be approximately the same)
@@ -87,18 +329,24 @@ std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures(const k
     // necessary because each time this loop runs we'll only update the older capture.
     // The captures are stored in a vector where the first element of the vector is the master capture and
     // subsequent elements are subordinate captures
-    std::vector<k4a::capture> captures(subordinate_devices.size() + 1); // add 1 for the master
+    std::vector<k4a::capture> captures(subordinate_sources.size() + 1); // add 1 for the master
     size_t current_index = 0;
-    master_device.get_capture(&captures[current_index], std::chrono::milliseconds{ K4A_WAIT_INFINITE });
+    if (!master_source->get_capture(&captures[current_index], std::chrono::milliseconds{ K4A_WAIT_INFINITE }))
+    {
+        return {};
+    }
     ++current_index;
-    for (k4a::device& d : subordinate_devices)
+    for (std::unique_ptr<CaptureSource>& s : subordinate_sources)
     {
-        d.get_capture(&captures[current_index], std::chrono::milliseconds{ K4A_WAIT_INFINITE });
+        if (!s->get_capture(&captures[current_index], std::chrono::milliseconds{ K4A_WAIT_INFINITE }))
+        {
+            return {};
+        }
         ++current_index;
     }
 
     // If there are no subordinate devices, just return captures which only has the master image
-    if (subordinate_devices.empty())
+    if (subordinate_sources.empty())
     {
         return captures;
     }
@@ -112,14 +360,13 @@ std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures(const k
             std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count();
         if (duration_ms > WAIT_FOR_SYNCHRONIZED_CAPTURE_TIMEOUT)
         {
-            std::cerr << "ERROR: Timedout waiting for synchronized captures\n";
-            exit(1);
+            throw CaptureError("Timedout waiting for synchronized captures");
         }
 
         k4a::image master_color_image = captures[0].get_color_image();
         std::chrono::microseconds master_color_image_time = master_color_image.get_device_timestamp();
 
-        for (size_t i = 0; i < subordinate_devices.size(); ++i)
+        for (size_t i = 0; i < subordinate_sources.size(); ++i)
         {
             k4a::image sub_image;
             if (compare_sub_depth_instead_of_color)
@@ -154,8 +401,11 @@ std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures(const k
                     // the subordinate camera image timestamp was earlier than it is allowed to be. This means the
                     // subordinate is lagging and we need to update the subordinate to get the subordinate caught up
                     log_lagging_time("sub", captures[0], captures[i + 1]);
-                    subordinate_devices[i].get_capture(&captures[i + 1],
-                        std::chrono::milliseconds{ K4A_WAIT_INFINITE });
+                    if (!subordinate_sources[i]->get_capture(&captures[i + 1],
+                        std::chrono::milliseconds{ K4A_WAIT_INFINITE }))
+                    {
+                        return {};
+                    }
                     break;
                 }
                 else if (sub_image_time_error > MAX_ALLOWABLE_TIME_OFFSET_ERROR_FOR_IMAGE_TIMESTAMP)
@@ -168,14 +418,17 @@ std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures(const k
                     // the subordinate camera image timestamp was later than it is allowed to be. This means the
                     // subordinate is ahead and we need to update the master to get the master caught up
                     log_lagging_time("master", captures[0], captures[i + 1]);
-                    master_device.get_capture(&captures[0], std::chrono::milliseconds{ K4A_WAIT_INFINITE });
+                    if (!master_source->get_capture(&captures[0], std::chrono::milliseconds{ K4A_WAIT_INFINITE }))
+                    {
+                        return {};
+                    }
                     break;
                 }
                 else
                 {
                     // These captures are sufficiently synchronized. If we've gotten to the end, then all are
                     // synchronized.
-                    if (i == subordinate_devices.size() - 1)
+                    if (i == subordinate_sources.size() - 1)
                     {
                         log_synced_image_time(captures[0], captures[i + 1]);
                         have_synced_images = true; // now we'll finish the for loop and then exit the while loop
@@ -185,14 +438,20 @@ std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures(const k
             else if (!master_color_image)
             {
                 std::cout << "Master image was bad!\n";
-                master_device.get_capture(&captures[0], std::chrono::milliseconds{ K4A_WAIT_INFINITE });
+                if (!master_source->get_capture(&captures[0], std::chrono::milliseconds{ K4A_WAIT_INFINITE }))
+                {
+                    return {};
+                }
                 break;
             }
             else if (!sub_image)
             {
                 std::cout << "Subordinate image was bad!" << std::endl;
-                subordinate_devices[i].get_capture(&captures[i + 1],
-                    std::chrono::milliseconds{ K4A_WAIT_INFINITE });
+                if (!subordinate_sources[i]->get_capture(&captures[i + 1],
+                    std::chrono::milliseconds{ K4A_WAIT_INFINITE }))
+                {
+                    return {};
+                }
                 break;
             }
         }
@@ -201,20 +460,24 @@ std::vector<k4a::capture> MultiDeviceCapturer::get_synchronized_captures(const k
     return captures;
 }
 
-const k4a::device& MultiDeviceCapturer::get_master_device() const
+void MultiDeviceCapturer::set_profiler(Profiler* profiler)
+{
+    this->profiler = profiler;
+}
+
+const CaptureSource& MultiDeviceCapturer::get_master_source() const
 {
-    return master_device;
+    return *master_source;
 }
 
-const k4a::device& MultiDeviceCapturer::get_subordinate_device_by_index(size_t i) const
+const CaptureSource& MultiDeviceCapturer::get_subordinate_source_by_index(size_t i) const
 {
     // devices[0] is the master. There are only devices.size() - 1 others. So, indices greater or equal are invalid
-    if (i >= subordinate_devices.size())
+    if (i >= subordinate_sources.size())
     {
-        std::cerr << "Subordinate index too large!\n ";
-        exit(1);
+        throw CaptureError("Subordinate index too large!");
     }
-    return subordinate_devices[i];
+    return *subordinate_sources[i];
 }
 
 
@@ -2,262 +2,187 @@
 
 namespace fs = std::filesystem;
 
+static int runOnlineExtraction(int recording_duration, const std::string& base_path,
+    std::vector<std::unique_ptr<CaptureSource>> sources, const PipelineConfig& config);
+
 // Extract online data from each camera sensor separately
 int onlineExtraction(
-    int recording_duration,     // Recording duration in seconds
-    std::string base_path,      // Path to save data
-    int num_devices) {          // Number of devices connected
+    int recording_duration,                         // Recording duration in seconds
+    std::string base_path,                          // Path to save data
+    int num_devices,                                // Number of devices connected
+    const PipelineConfig& config) {                 // Codecs, outputs and threads of the extraction
 
     int32_t color_exposure_usec = 8000;  // somewhat reasonable default exposure time
     int32_t powerline_freq = 2;          // default to a 60 Hz powerline
-    double calibration_timeout = 60.0; // default to timing out after 60s of trying to get calibrated
 
-    std::string depth_path = "\\depth";
-    std::string depth_images_path = depth_path + "\\images";
-    std::string depth_raw_matrices_path = depth_path + "\\raw_matrices";
-    std::string depth_point_cloud_path = depth_path + "\\point_clouds";
-    std::string depth_timestamps_path = depth_path + "\\timestamps.txt";
-    std::string color_path = "\\color";
-    std::string color_images_path = color_path + "\\images";
-    std::string color_timestamps_path = color_path + "\\timestamps.txt";
-    std::string ir_path = "\\ir";
-    std::string ir_images_path = ir_path + "\\images";
-    std::string ir_raw_matrices_path = ir_path + "\\raw_matrices";
-    std::string ir_timestamps_path = ir_path + "\\timestamps.txt";
-    std::string imu_path = "\\imu.json";
+    std::vector<std::unique_ptr<CaptureSource>> sources;
+    try {
+        sources = open_device_sources(num_devices, color_exposure_usec, powerline_freq);
+    }
+    catch (const k4a::error& e) {
+        std::cerr << "Error opening the devices: " << e.what() << std::endl;
+        return 1;
+    }
+    return onlineExtraction(recording_duration, base_path, std::move(sources), config);
+}
+
+int onlineExtraction(
+    int recording_duration,                         // Recording duration in seconds
+    std::string base_path,                          // Path to save data
+    std::vector<std::unique_ptr<CaptureSource>> sources, // Devices, paced recordings or synthetic devices
+    const PipelineConfig& config) {                 // Codecs, outputs and threads of the extraction
+
+    int num_devices = (int)sources.size();
+    double calibration_timeout = 60.0; // default to timing out after 60s of trying to get calibrated
 
     if (!fs::create_directories(base_path)) {
         std::cerr << "Error creating directory: " << base_path << std::endl;
-        return false;
+        return 1;
     }
 
     for (int i = 0; i < num_devices; i++)
     {
-        std::string device_path = base_path + "\\" + std::to_string(i);
-        if (!fs::create_directories(device_path)) {
-            std::cerr << "Error creating directory: " << device_path << std::endl;
-            return false;
-        }
-
-        if (!fs::create_directories(device_path + depth_path)) {
-            std::cerr << "Error creating directory: " << depth_path << std::endl;
-            return false;
-        }
-
-        if (!fs::create_directories(device_path + depth_images_path)) {
-            std::cerr << "Error creating directory: " << depth_images_path << std::endl;
-            return false;
-        }
-
-        if (!fs::create_directories(device_path + depth_raw_matrices_path)) {
-            std::cerr << "Error creating directory: " << depth_raw_matrices_path << std::endl;
-            return false;
-        }
-
-        if (!fs::create_directories(device_path + depth_point_cloud_path)) {
-            std::cerr << "Error creating directory: " << depth_point_cloud_path << std::endl;
-            return false;
-        }
-
-        if (!fs::create_directories(device_path + color_path)) {
-            std::cerr << "Error creating directory: " << color_path << std::endl;
-            return false;
+        if (!create_output_directories(OutputLayout(get_device_output_path(base_path, i)))) {
+            return 1;
         }
+    }
 
-        if (!fs::create_directories(device_path + color_images_path)) {
-            std::cerr << "Error creating directory: " << color_images_path << std::endl;
-            return false;
-        }
+    try {
+        return runOnlineExtraction(recording_duration, base_path, std::move(sources), config);
+    }
+    catch (const CaptureError& e) {
+        std::cerr << "Error capturing: " << e.what() << std::endl;
+        return 1;
+    }
+    catch (const k4a::error& e) {
+        std::cerr << "Error capturing: " << e.what() << std::endl;
+        return 1;
+    }
+}
 
-        if (!fs::create_directories(device_path + ir_path)) {
-            std::cerr << "Error creating directory: " << ir_path << std::endl;
-            return false;
-        }
+// The capture and extraction of onlineExtraction, into the directories it created
+static int runOnlineExtraction(int recording_duration, const std::string& base_path,
+    std::vector<std::unique_ptr<CaptureSource>> sources, const PipelineConfig& config) {
 
-        if (!fs::create_directories(device_path + ir_images_path)) {
-            std::cerr << "Error creating directory: " << ir_images_path << std::endl;
-            return false;
-        }
+    int num_devices = (int)sources.size();
 
-        if (!fs::create_directories(device_path + ir_raw_matrices_path)) {
-            std::cerr << "Error creating directory: " << ir_raw_matrices_path << std::endl;
-            return false;
-        }
+    // The profiler and IMU writers are used by the capturer's threads, so they are declared before the capturer:
+    // when a CaptureError unwinds this function, the capturer joins its threads before they are destroyed
+    SharedPipelineResources shared;
+    if (!open_shared_resources(config, shared))
+    {
+        return 1;
     }
-
-    // Note that the order of indices in device_indices is not necessarily
-    // preserved because MultiDeviceCapturer tries to find the master device based
-    // on which one has sync out plugged in. Start with just { 0 }, and add
-    // another if needed
-    std::vector<uint32_t> device_indices;
-    for (uint32_t i = 0; i < num_devices; i++)
+    const PipelineResources& resources = shared.resources;
+    std::vector<std::unique_ptr<ImuStreamWriter>> imu_writers;
+    std::vector<ImuStreamWriter*> imu_writer_pointers;
+
+    // Note that the order of the sources is not necessarily preserved because
+    // MultiDeviceCapturer tries to find the master device based on which one has
+    // sync out plugged in
+    MultiDeviceCapturer capturer(std::move(sources));
+    if (resources.profiler != nullptr)
     {
-        device_indices.push_back(i);
+        capturer.set_profiler(resources.profiler);
     }
 
-    // Set up a MultiDeviceCapturer to handle getting many synchronous captures
-    MultiDeviceCapturer capturer(device_indices, color_exposure_usec, powerline_freq);
-
     // Create configurations for devices
     k4a_device_configuration_t main_config = get_master_config();
     k4a_device_configuration_t secondary_config = get_subordinate_config();
 
-    // Construct all the things that we'll need whether or not we are running with 1 or more cameras
-    k4a::calibration main_calibration = capturer.get_master_device().get_calibration(main_config.depth_mode,
-        main_config.color_resolution);
+    // One pipeline per device, with the calibration of that device, all sharing one set of resources
+    PipelineConfig pipeline_config = config;
+    pipeline_config.show_progress = false;
+    std::vector<std::unique_ptr<ExtractionPipeline>> pipelines;
+    for (int i = 0; i < num_devices; i++)
+    {
+        const CaptureSource& source = i == 0 ? capturer.get_master_source() : capturer.get_subordinate_source_by_index(i - 1);
+        const k4a_device_configuration_t& device_config = i == 0 ? main_config : secondary_config;
+        k4a::calibration calibration = source.get_calibration(device_config.depth_mode, device_config.color_resolution);
+
+        OutputLayout layout(get_device_output_path(base_path, i));
+        std::string device_path = layout.base.string();
+        pipelines.push_back(std::make_unique<ExtractionPipeline>(calibration, device_path, pipeline_config, 0.0, resources));
+        if (!pipelines.back()->is_open()) {
+            std::cerr << "Error opening the timestamp files of: " << device_path << std::endl;
+            return 1;
+        }
+
+        if (!config.imu.enabled) {
+            continue;
+        }
+        imu_writers.push_back(std::make_unique<ImuStreamWriter>());
+        if (!imu_writers.back()->open(layout.imu(imu_extension(config.imu.format)).string(), config.imu.format)) {
+            return 1;
+        }
+        imu_writer_pointers.push_back(imu_writers.back().get());
+    }
 
     capturer.start_devices(main_config, secondary_config);
 
-    k4a::transformation transformation(main_calibration);
+    // The devices are read by their own threads, this thread only matches the captures and hands them to the
+    // pipelines. A slow disk stalls the pipelines and at worst fills the capture rings, the SDK never drops frames
+    capturer.start_reader_threads();
+
+    // The IMU samples are read and written by threads of their own. The frame loop only tells the IMU writers the
+    // index and timestamp of every frame it extracts, so they can tag each sample with its closest frame
+    capturer.start_imu_threads(imu_writer_pointers);
+    std::vector<int64_t> frame_counts(num_devices, 0);
 
     std::chrono::time_point<std::chrono::system_clock> start_time = std::chrono::system_clock::now();
     while (std::chrono::duration<double>(std::chrono::system_clock::now() - start_time).count() < recording_duration)
     {
-        std::vector<k4a::capture> captures;
-        captures = capturer.get_synchronized_captures(secondary_config, true);
+        std::vector<k4a::capture> captures = capturer.get_synchronized_captures(secondary_config, true);
+        if (captures.empty())
+        {
+            break;
+        }
 
         for (int i = 0; i < num_devices; i++) {
-
-            std::string device_path = base_path + "\\" + std::to_string(i);
-
-            std::ofstream depth_timestamps_file(device_path + depth_timestamps_path, std::ios::app);
-            if (!depth_timestamps_file.is_open()) {
-                std::cerr << "Error opening file: " << device_path + depth_timestamps_path << std::endl;
-                return false;
-            }
-
-            std::ofstream color_timestamps_file(device_path + color_timestamps_path, std::ios::app);
-            if (!color_timestamps_file.is_open()) {
-                std::cerr << "Error opening file: " << device_path + color_timestamps_path << std::endl;
-                return false;
-            }
-
-            std::ofstream ir_timestamps_file(device_path + ir_timestamps_path, std::ios::app);
-            if (!ir_timestamps_file.is_open()) {
-                std::cerr << "Error opening file: " << device_path + ir_timestamps_path << std::endl;
-                return false;
-            }
-
-            k4a::image depth_image = captures[i].get_depth_image();
             k4a::image color_image = captures[i].get_color_image();
-            k4a::image ir_image = captures[i].get_ir_image();
-
-            if (depth_image.is_valid() && color_image.is_valid() && ir_image.is_valid())
-            {
-                int32_t color_image_width_pixels = color_image.get_width_pixels();
-                int32_t color_image_height_pixels = color_image.get_height_pixels();
-
-                k4a::image transformed_depth_image = k4a::image::create(
-                    K4A_IMAGE_FORMAT_DEPTH16,
-                    color_image_width_pixels,
-                    color_image_height_pixels,
-                    color_image_width_pixels * (int)sizeof(uint16_t));
-                transformation.depth_image_to_color_camera(depth_image, &transformed_depth_image);
-
-                cv::Mat depth_image_opencv = get_mat(transformed_depth_image);
-
-                uint32_t depth_image_timestamp = depth_image.get_device_timestamp().count();
-                std::string depth_image_name = std::format("{:020}", depth_image_timestamp);
-
-                cv::imwrite((device_path + depth_raw_matrices_path + "\\" + depth_image_name + ".jpg").c_str(), depth_image_opencv);
-
-                // 3860mm is the max range of the depth sensor with NFOV_UNBINNED
-                depth_image_opencv /= (3860.0 / 255.0);
-                cv::imwrite((device_path + depth_images_path + "\\" + depth_image_name + ".jpg").c_str(), depth_image_opencv);
-                
-                /*
-                k4a::image xy_table = k4a::image::create(
-                    K4A_IMAGE_FORMAT_CUSTOM,
-                    color_image_width_pixels,
-                    color_image_height_pixels,
-                    color_image_width_pixels * (int)sizeof(k4a_float2_t));
-                create_xy_table(main_calibration, xy_table);
-                k4a::image point_cloud = k4a::image::create(
-                    K4A_IMAGE_FORMAT_CUSTOM,
-                    color_image_width_pixels,
-                    color_image_height_pixels,
-                    color_image_width_pixels * (int)sizeof(k4a_float3_t));
-                int point_count = 0;
-                generate_point_cloud(transformed_depth_image, xy_table, point_cloud, &point_count);
-                write_point_cloud((device_path + depth_point_cloud_path + "\\" + depth_image_name + ".ply").c_str(), point_cloud, point_count);
-                */
-
-                depth_timestamps_file << depth_image_timestamp << std::endl;
-
-                transformed_depth_image.reset();
-                //xy_table.reset();
-                //point_cloud.reset();
-                depth_timestamps_file.close();
-
-                uint32_t color_image_timestamp = color_image.get_device_timestamp().count();
-                std::string color_image_name = std::format("{:020}", color_image_timestamp);
-
-                cv::Mat color_image_opencv = get_mat(color_image);
-
-                cv::imwrite((device_path + color_images_path + "\\" + color_image_name + ".jpg").c_str(), color_image_opencv);
-
-                color_timestamps_file << color_image_timestamp << std::endl;
-                
-                color_timestamps_file.close();
-
-                int ir_image_width_pixels = ir_image.get_width_pixels();
-                int ir_image_height_pixels = ir_image.get_height_pixels();
-                int ir_image_stride_bytes = ir_image.get_stride_bytes();
-                uint8_t* ir_image_buffer = ir_image.get_buffer();
-                k4a::image custom_ir_image = k4a::image::create_from_buffer(
-                    K4A_IMAGE_FORMAT_CUSTOM16,
-                    ir_image_width_pixels,
-                    ir_image_height_pixels,
-                    ir_image_width_pixels * (int)sizeof(uint16_t),
-                    ir_image_buffer,
-                    ir_image_height_pixels * ir_image_stride_bytes,
-                    NULL, // Memory leak?
-                    NULL);
-
-                k4a::image transformed_ir_image = k4a::image::create(
-                    K4A_IMAGE_FORMAT_CUSTOM16,
-                    color_image_width_pixels,
-                    color_image_height_pixels,
-                    color_image_width_pixels * (int)sizeof(uint16_t));
-
-                k4a::image transformed_depth_image_reference = k4a::image::create(
-                    K4A_IMAGE_FORMAT_DEPTH16,
-                    color_image_width_pixels,
-                    color_image_height_pixels,
-                    color_image_width_pixels * (int)sizeof(uint16_t));
-
-                transformation.depth_image_to_color_camera_custom(
-                    depth_image,
-                    custom_ir_image,
-                    &transformed_depth_image_reference,
-                    &transformed_ir_image,
-                    K4A_TRANSFORMATION_INTERPOLATION_TYPE_NEAREST,
-                    0);
-
-                cv::Mat ir_image_opencv = get_mat(transformed_ir_image);
-
-                uint32_t ir_image_timestamp = ir_image.get_device_timestamp().count();
-                std::string ir_image_name = std::format("{:020}", ir_image_timestamp);
-
-                cv::imwrite((device_path + ir_raw_matrices_path + "\\" + ir_image_name + ".jpg").c_str(), ir_image_opencv);
-
-                // 1000 is the max range of the ir sensor
-                ir_image_opencv /= (1000.0 / 255.0);
-                cv::imwrite((device_path + ir_images_path + "\\" + ir_image_name + ".jpg").c_str(), ir_image_opencv);
-
-                ir_timestamps_file << color_image_timestamp << std::endl;
-
-                transformed_ir_image.reset();
-                transformed_depth_image_reference.reset();
-                ir_timestamps_file.close();
-            }
-            depth_image.reset();
+            int64_t timestamp = color_image ? color_image.get_device_timestamp().count() : 0;
             color_image.reset();
-            ir_image.reset();
+            if (pipelines[i]->push(captures[i]) && config.imu.enabled) {
+                imu_writers[i]->push_frame(ImuFrameTag{ frame_counts[i]++, timestamp });
+            }
             captures[i].reset();
         }
     }
-    transformation.destroy();
+
+    capturer.stop_reader_threads();
+    capturer.stop_imu_threads();
+    for (std::unique_ptr<ImuStreamWriter>& imu_writer : imu_writers)
+    {
+        imu_writer->close();
+    }
+    for (std::unique_ptr<ExtractionPipeline>& pipeline : pipelines)
+    {
+        pipeline->finish();
+    }
+
+    std::vector<CaptureDeviceStats> capture_stats = capturer.get_device_stats();
+    for (int i = 0; i < num_devices; i++)
+    {
+        ExtractionStats stats = pipelines[i]->get_stats();
+        FramePoolStats pool_stats = pipelines[i]->get_frame_pool_stats();
+        std::cout << "Device " << i << ": " << stats.frames << " frames written, "
+            << capture_stats[i].captures << " captured, "
+            << capture_stats[i].sdk_drops << " dropped by the device, "
+            << capture_stats[i].ring_drops << " dropped by the capture ring, "
+            << capture_stats[i].unmatched << " unmatched" << std::endl;
+        if (config.imu.enabled)
+        {
+            std::cout << "Device " << i << ": " << imu_writers[i]->get_sample_count() << " IMU samples written, "
+                << imu_writers[i]->get_dropped_sample_count() << " dropped" << std::endl;
+        }
+        std::cout << "Device " << i << " frame pool hit rate: " << 100.0 * pool_stats.hit_rate() << "% ("
+            << pool_stats.hits << " hits, " << pool_stats.misses << " misses)" << std::endl;
+    }
+
+    if (shared.profiler)
+    {
+        write_profile(*shared.profiler, base_path, config.profile.trace);
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,87 @@
+#include "../include/OutputLayout.hpp"
+
+namespace fs = std::filesystem;
+
+OutputLayout::OutputLayout(const fs::path& base)
+    : base(base),
+    depth(base / "depth"),
+    depth_images(depth / "images"),
+    depth_raw_matrices(depth / "raw_matrices"),
+    depth_point_clouds(depth / "point_clouds"),
+    color(base / "color"),
+    color_images(color / "images"),
+    ir(base / "ir"),
+    ir_images(ir / "images"),
+    ir_raw_matrices(ir / "raw_matrices"),
+    geometry(base / "geometry.json")
+{
+}
+
+fs::path OutputLayout::container() const
+{
+    return base / "frames.k4fc";
+}
+
+fs::path OutputLayout::point_cloud_stream() const
+{
+    return depth / "point_clouds.k4ps";
+}
+
+fs::path OutputLayout::journal() const
+{
+    return base / "extraction.journal";
+}
+
+fs::path OutputLayout::head_pose() const
+{
+    return color / "head_pose.csv";
+}
+
+fs::path OutputLayout::imu(const std::string& extension) const
+{
+    return base / ("imu" + extension);
+}
+
+bool create_output_directories(const OutputLayout& layout)
+{
+    for (const fs::path& path : { layout.base, layout.depth, layout.depth_images, layout.depth_raw_matrices,
+        layout.depth_point_clouds, layout.color, layout.color_images, layout.ir, layout.ir_images,
+        layout.ir_raw_matrices })
+    {
+        std::error_code error;
+        fs::create_directories(path, error);
+        if (error || !fs::is_directory(path)) {
+            std::cerr << "Error creating directory: " << path.string() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+fs::path get_output_path(const fs::path& input_path)
+{
+    return fs::path(input_path).replace_extension();
+}
+
+fs::path get_device_output_path(const fs::path& base, size_t device_index)
+{
+    return base / std::to_string(device_index);
+}
+
+fs::path get_ranges_path(const OutputLayout& layout)
+{
+    return layout.base / "ranges";
+}
+
+OutputLayout get_range_layout(const OutputLayout& layout, size_t range_index)
+{
+    OutputLayout range_layout(get_ranges_path(layout) / std::to_string(range_index));
+    range_layout.depth_images = layout.depth_images;
+    range_layout.depth_raw_matrices = layout.depth_raw_matrices;
+    range_layout.depth_point_clouds = layout.depth_point_clouds;
+    range_layout.color_images = layout.color_images;
+    range_layout.ir_images = layout.ir_images;
+    range_layout.ir_raw_matrices = layout.ir_raw_matrices;
+    range_layout.geometry.clear();
+    return range_layout;
+}
@@ -0,0 +1,817 @@
+#include "../include/Pipeline.hpp"
+
+void WaitGroup::add(size_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += count;
+}
+
+void WaitGroup::done()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending == 0)
+    {
+        all_done.notify_all();
+    }
+}
+
+void WaitGroup::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return pending == 0; });
+}
+
+WorkerPool::WorkerPool(unsigned int num_threads, size_t queue_depth) : tasks(queue_depth)
+{
+    for (unsigned int i = 0; i < std::max(num_threads, 1u); i++)
+    {
+        workers.emplace_back([this] {
+            std::function<void()> task;
+            while (tasks.pop(task))
+            {
+                task();
+            }
+        });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    tasks.close();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> task)
+{
+    tasks.push(std::move(task));
+}
+
+unsigned int WorkerPool::size() const
+{
+    return (unsigned int)workers.size();
+}
+
+std::string image_extension(ImageFormat format)
+{
+    switch (format)
+    {
+    case ImageFormat::Png:
+        return ".png";
+    case ImageFormat::Webp:
+        return ".webp";
+    default:
+        return ".jpg";
+    }
+}
+
+std::string image_geometry_name(ImageGeometry geometry)
+{
+    return geometry == ImageGeometry::Depth ? "depth" : "color";
+}
+
+bool open_shared_resources(const PipelineConfig& config, SharedPipelineResources& shared,
+    const PipelineResources& given)
+{
+    shared.resources = given;
+    if (shared.resources.encode_pool == nullptr)
+    {
+        shared.encode_pool = std::make_unique<WorkerPool>(config.encode_threads, config.queue_depth);
+        shared.resources.encode_pool = shared.encode_pool.get();
+    }
+    if (config.profile.enabled && shared.resources.profiler == nullptr)
+    {
+        shared.profiler = std::make_unique<Profiler>(config.profile.trace);
+        shared.resources.profiler = shared.profiler.get();
+    }
+    if (config.head_pose.enabled && shared.resources.head_pose == nullptr)
+    {
+        shared.head_pose = std::make_unique<HeadPoseEstimator>();
+        if (!shared.head_pose->open(config.head_pose, shared.resources.profiler))
+        {
+            return false;
+        }
+        shared.resources.head_pose = shared.head_pose.get();
+    }
+    return true;
+}
+
+ExtractionPipeline::ExtractionPipeline(const k4a::calibration& calibration, const std::string& base_path,
+    const PipelineConfig& config, double recording_length, const PipelineResources& resources)
+    : ExtractionPipeline(calibration, OutputLayout(base_path), config, recording_length, resources)
+{
+}
+
+ExtractionPipeline::ExtractionPipeline(const k4a::calibration& calibration, const OutputLayout& layout,
+    const PipelineConfig& config, double recording_length, const PipelineResources& resources)
+    : calibration(calibration),
+    config(config),
+    recording_length(recording_length),
+    layout(layout),
+    capture_queue(config.queue_depth),
+    write_queue(config.queue_depth),
+    encode_pool(resources.encode_pool),
+    io_slots(resources.io_slots),
+    profiler(resources.profiler),
+    head_pose(resources.head_pose)
+{
+    if (encode_pool == nullptr)
+    {
+        own_encode_pool = std::make_unique<WorkerPool>(config.encode_threads, config.queue_depth);
+        encode_pool = own_encode_pool.get();
+    }
+
+    // Before the logs open, so they append to the files as they were at the checkpoint
+    if (config.journal && config.output_mode == OutputMode::Files)
+    {
+        JournalState state = read_journal(layout.journal());
+        if (state.has_checkpoint)
+        {
+            resume_checkpoint = state.checkpoint;
+            for (const auto& [path, size] : resume_checkpoint.file_sizes)
+            {
+                std::error_code error;
+                if (std::filesystem::file_size(layout.base / path, error) > size && !error)
+                {
+                    std::filesystem::resize_file(layout.base / path, size, error);
+                }
+            }
+        }
+    }
+
+    if (config.head_pose.enabled)
+    {
+        if (head_pose == nullptr)
+        {
+            own_head_pose = std::make_unique<HeadPoseEstimator>();
+            own_head_pose->open(config.head_pose, profiler);
+            head_pose = own_head_pose.get();
+        }
+        head_pose_log.open(layout.head_pose());
+    }
+
+    bool transforms_color = config.geometry == ImageGeometry::Depth && needs_color_pixels();
+    bool transforms_depth = config.geometry == ImageGeometry::Color && writes_depth();
+    if (config.depth_transform == DepthTransform::Table && (transforms_depth || transforms_color))
+    {
+        reprojection_table = get_reprojection_table(calibration);
+        if (!reprojection_table->usable())
+        {
+            std::cerr << "The reprojection table is " << reprojection_table->max_projection_error
+                << " pixels off convert_3d_to_2d, transforming with the SDK" << std::endl;
+            reprojection_table.reset();
+        }
+    }
+
+    if (config.point_clouds)
+    {
+        // The depth images are in the camera of the geometry
+        xy_table = get_xy_table(calibration, config.geometry == ImageGeometry::Depth ? K4A_CALIBRATION_TYPE_DEPTH :
+            K4A_CALIBRATION_TYPE_COLOR);
+    }
+
+    // The time ranges of a recording share the geometry.json written before they start, see get_range_layout
+    geometry_written = layout.geometry.empty() || write_geometry(layout.geometry, calibration, config.geometry);
+
+    if (writes_depth())
+    {
+        depth_log.open(layout.depth);
+    }
+    if (config.streams.color)
+    {
+        color_log.open(layout.color);
+    }
+    if (writes_ir())
+    {
+        ir_log.open(layout.ir);
+    }
+
+    if (config.output_mode == OutputMode::Container)
+    {
+        container.open(layout.container().string());
+    }
+    else if (config.point_clouds && config.point_cloud.stream)
+    {
+        point_cloud_stream.open(layout.point_cloud_stream().string(), resume_checkpoint.frames > 0);
+    }
+
+    if (config.journal)
+    {
+        open_journal();
+    }
+
+    for (unsigned int i = 0; i < std::max(config.transform_threads, 1u); i++)
+    {
+        transform_threads.emplace_back(&ExtractionPipeline::transform_worker, this);
+    }
+    writer_thread = std::thread(&ExtractionPipeline::writer, this);
+}
+
+ExtractionPipeline::~ExtractionPipeline()
+{
+    finish();
+}
+
+bool ExtractionPipeline::is_open() const
+{
+    return geometry_written && (!writes_depth() || depth_log.is_open()) &&
+        (!config.streams.color || color_log.is_open()) &&
+        (!writes_ir() || ir_log.is_open()) &&
+        (!config.head_pose.enabled || (head_pose->is_open() && head_pose_log.is_open())) &&
+        (config.output_mode != OutputMode::Container || container.is_open()) &&
+        (!config.journal || journal.is_open()) &&
+        (config.output_mode != OutputMode::Files || !config.point_clouds || !config.point_cloud.stream ||
+            point_cloud_stream.is_open());
+}
+
+bool ExtractionPipeline::push(const k4a::capture& capture)
+{
+    // The color image gives the geometry depth and IR are transformed into, so it is read either way. The IR
+    // is transformed along with the depth. With ImageGeometry::Depth the depth maps the color pixels
+    bool needs_ir = needs_ir_pixels();
+    bool needs_depth = writes_depth() || needs_ir || (config.geometry == ImageGeometry::Depth && needs_color_pixels());
+
+    PipelineFrame frame;
+    frame.color_image = capture.get_color_image();
+    if (needs_depth)
+    {
+        frame.depth_image = capture.get_depth_image();
+    }
+    if (needs_ir)
+    {
+        frame.ir_image = capture.get_ir_image();
+    }
+
+    if (!frame.color_image.is_valid() || (needs_depth && !frame.depth_image.is_valid()) ||
+        (needs_ir && !frame.ir_image.is_valid()))
+    {
+        return false;
+    }
+
+    if (writes_depth())
+    {
+        frame.depth_metadata = get_frame_metadata(frame.depth_image);
+    }
+    if (config.streams.color)
+    {
+        frame.color_metadata = get_frame_metadata(frame.color_image);
+    }
+    if (writes_ir())
+    {
+        frame.ir_metadata = get_frame_metadata(frame.ir_image);
+    }
+
+    frame.index = next_index++;
+    ScopedTimer timer(profiler, ProfileStage::PipelinePush);
+    return capture_queue.push(std::move(frame));
+}
+
+void ExtractionPipeline::finish()
+{
+    if (finished)
+    {
+        return;
+    }
+    finished = true;
+
+    // Each stage is drained before the queue feeding the next one is closed
+    capture_queue.close();
+    for (std::thread& thread : transform_threads)
+    {
+        thread.join();
+    }
+    encode_tasks.wait();
+    write_queue.close();
+    writer_thread.join();
+
+    if (journal.is_open() && config.output_mode == OutputMode::Files)
+    {
+        write_checkpoint();
+    }
+    journal.close();
+
+    depth_log.close();
+    color_log.close();
+    ir_log.close();
+    head_pose_log.close();
+    point_cloud_stream.close();
+    if (!container.close())
+    {
+        std::cerr << "Error writing the frame container" << std::endl;
+    }
+}
+
+FramePoolStats ExtractionPipeline::get_frame_pool_stats() const
+{
+    return frame_pool.get_stats();
+}
+
+JournalCheckpoint ExtractionPipeline::get_resume_checkpoint() const
+{
+    return resume_checkpoint;
+}
+
+// geometry.json in the output directory:
+//
+//      { "geometry": "depth", "width": 640, "height": 576, "fx": ..., "fy": ..., "cx": ..., "cy": ... }
+bool write_geometry(const std::filesystem::path& path, const k4a::calibration& calibration, ImageGeometry geometry)
+{
+    const k4a_calibration_camera_t& camera = geometry == ImageGeometry::Depth ?
+        calibration.depth_camera_calibration : calibration.color_camera_calibration;
+    const k4a_calibration_intrinsic_parameters_t& intrinsics = camera.intrinsics.parameters;
+
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path.string() << std::endl;
+        return false;
+    }
+    file << std::format("{{\n    \"geometry\": \"{}\",\n    \"width\": {},\n    \"height\": {},\n"
+        "    \"fx\": {},\n    \"fy\": {},\n    \"cx\": {},\n    \"cy\": {}\n}}\n",
+        image_geometry_name(geometry), camera.resolution_width, camera.resolution_height,
+        intrinsics.param.fx, intrinsics.param.fy, intrinsics.param.cx, intrinsics.param.cy);
+    return file.good();
+}
+
+void ExtractionPipeline::open_journal()
+{
+    if (config.output_mode == OutputMode::Files)
+    {
+        auto add_log = [this](const std::filesystem::path& directory) {
+            for (const char* name : { "timestamps.txt", "metadata.csv" })
+            {
+                appended_files.push_back((directory / name).lexically_relative(layout.base).generic_string());
+            }
+        };
+        if (depth_log.is_open())
+        {
+            add_log(layout.depth);
+        }
+        if (color_log.is_open())
+        {
+            add_log(layout.color);
+        }
+        if (ir_log.is_open())
+        {
+            add_log(layout.ir);
+        }
+        if (head_pose_log.is_open())
+        {
+            appended_files.push_back(layout.head_pose().lexically_relative(layout.base).generic_string());
+        }
+        if (point_cloud_stream.is_open())
+        {
+            appended_files.push_back(layout.point_cloud_stream().lexically_relative(layout.base).generic_string());
+        }
+    }
+
+    checkpoint = resume_checkpoint;
+    last_checkpoint = std::chrono::steady_clock::now();
+    journal.open(layout.journal(), resume_checkpoint.frames > 0 ? &resume_checkpoint : nullptr);
+}
+
+void ExtractionPipeline::write_checkpoint()
+{
+    ScopedTimer timer(profiler, ProfileStage::TimestampWrite);
+    depth_log.flush();
+    color_log.flush();
+    ir_log.flush();
+    head_pose_log.flush();
+    point_cloud_stream.flush();
+
+    for (const std::string& path : appended_files)
+    {
+        std::error_code error;
+        checkpoint.file_sizes[path] = std::filesystem::file_size(layout.base / path, error);
+    }
+    if (!journal.append_checkpoint(checkpoint))
+    {
+        std::cerr << "Error writing the extraction journal" << std::endl;
+    }
+    frames_since_checkpoint = 0;
+    last_checkpoint = std::chrono::steady_clock::now();
+}
+
+ExtractionStats ExtractionPipeline::get_stats() const
+{
+    ExtractionStats stats;
+    stats.frames = frames_written;
+    stats.bytes_written = bytes_written;
+    return stats;
+}
+
+// Decodes the color image and maps depth and IR into the color camera geometry, or the color image into the depth
+// camera geometry
+void ExtractionPipeline::transform_worker()
+{
+    // k4a::transformation keeps per-call scratch buffers, so every thread needs its own
+    k4a::transformation transformation(calibration);
+
+    PipelineFrame frame;
+    while (capture_queue.pop(frame))
+    {
+        int32_t color_image_width_pixels = frame.color_image.get_width_pixels();
+        int32_t color_image_height_pixels = frame.color_image.get_height_pixels();
+
+        if (config.geometry == ImageGeometry::Depth)
+        {
+            // Depth and IR keep their geometry. The encoding scales the matrices in place, so it gets copies
+            // instead of the captured buffers
+            if (frame.depth_image)
+            {
+                frame.transformed_depth_image = copy_image(frame.depth_image, frame_pool);
+            }
+            if (frame.ir_image)
+            {
+                frame.transformed_ir_image = copy_image(frame.ir_image, frame_pool);
+            }
+        }
+        // The table is made for the color resolution of the calibration, other color images keep the SDK
+        else if (frame.depth_image && reprojection_table &&
+            color_image_width_pixels == reprojection_table->color_width &&
+            color_image_height_pixels == reprojection_table->color_height)
+        {
+            ScopedTimer timer(profiler, ProfileStage::DepthIrTransform);
+            reproject_depth_and_ir(*reprojection_table, frame.depth_image, frame.ir_image, frame_pool,
+                frame.transformed_depth_image, frame.transformed_ir_image, false);
+        }
+        else if (frame.ir_image)
+        {
+            ScopedTimer timer(profiler, ProfileStage::DepthIrTransform);
+            transform_depth_and_ir(transformation, frame.depth_image, frame.ir_image,
+                color_image_width_pixels, color_image_height_pixels, frame_pool,
+                frame.transformed_depth_image, frame.transformed_ir_image);
+        }
+        else if (frame.depth_image)
+        {
+            ScopedTimer timer(profiler, ProfileStage::DepthIrTransform);
+            transform_depth(transformation, frame.depth_image, color_image_width_pixels, color_image_height_pixels,
+                frame_pool, frame.transformed_depth_image);
+        }
+
+        if (frame.depth_image)
+        {
+            frame.depth_image_opencv = get_mat(frame.transformed_depth_image, false);
+            frame.depth_image_timestamp = frame.depth_image.get_device_timestamp().count();
+        }
+
+        frame.color_image_timestamp = frame.color_image.get_device_timestamp().count();
+        bool passthrough = config.color_passthrough && config.color_encoder.format == ImageFormat::Jpeg &&
+            !needs_color_pixels() && frame.color_image.get_format() == K4A_IMAGE_FORMAT_COLOR_MJPG;
+        if (!config.streams.color && !needs_color_pixels())
+        {
+            frame.color_image.reset();
+        }
+        else if (!passthrough)
+        {
+            ScopedTimer timer(profiler, ProfileStage::ColorDecode);
+            frame.color_image_opencv = get_mat(frame.color_image, frame_pool, frame.color_image_backing);
+            frame.color_image.reset();
+        }
+
+        // With the captured depth image, before it is released below. The table falls back to the SDK for color
+        // images of another resolution
+        if (config.geometry == ImageGeometry::Depth && !frame.color_image_opencv.empty())
+        {
+            ScopedTimer timer(profiler, ProfileStage::ColorTransform);
+            k4a::image transformed_color_image;
+            cv::Mat transformed_color;
+            if (reprojection_table)
+            {
+                transformed_color = reproject_color(*reprojection_table, frame.depth_image, frame.color_image_opencv,
+                    frame_pool, transformed_color_image);
+            }
+            if (transformed_color.empty())
+            {
+                transform_color(transformation, frame.depth_image, frame.color_image_opencv, frame_pool,
+                    transformed_color_image);
+                transformed_color = get_mat(transformed_color_image, false);
+            }
+            frame.color_image_opencv = transformed_color;
+            frame.color_image_backing = transformed_color_image;
+        }
+
+        if (frame.ir_image)
+        {
+            frame.ir_image_opencv = get_mat(frame.transformed_ir_image, false);
+            frame.ir_image_timestamp = frame.ir_image.get_device_timestamp().count();
+        }
+
+        // The captured images are not needed past this point, release them before the frame waits in the pool.
+        // The matrices reference the pooled transformed images, which are released once the frame is encoded
+        frame.depth_image.reset();
+        frame.ir_image.reset();
+
+        std::shared_ptr<PipelineFrame> task_frame = std::make_shared<PipelineFrame>(std::move(frame));
+        encode_tasks.add();
+        encode_pool->submit([this, task_frame] {
+            encode_frame(*task_frame);
+            write_queue.push(std::move(*task_frame));
+            encode_tasks.done();
+        });
+        frame = PipelineFrame();
+    }
+
+    transformation.destroy();
+}
+
+// True if a stage after the transformation reads the decoded color image, including the color transformation
+bool ExtractionPipeline::needs_color_pixels() const
+{
+    return (config.point_clouds && config.point_cloud.color) || config.head_pose.enabled ||
+        (config.geometry == ImageGeometry::Depth && config.streams.color);
+}
+
+// True if the IR image is transformed, for the IR outputs or the IR values of the points
+bool ExtractionPipeline::needs_ir_pixels() const
+{
+    return writes_ir() || (config.point_clouds && config.point_cloud.ir);
+}
+
+bool ExtractionPipeline::writes_depth() const
+{
+    return config.streams.depth_images || config.streams.depth_raw || config.point_clouds;
+}
+
+bool ExtractionPipeline::writes_ir() const
+{
+    return config.streams.ir_images || config.streams.ir_raw;
+}
+
+// Encodes an 8 bit image with the encoder of its stream
+static void encode_image(const cv::Mat& image, const ImageEncoderConfig& encoder, std::vector<uchar>& buffer)
+{
+    switch (encoder.format)
+    {
+    case ImageFormat::Png:
+        cv::imencode(".png", image, buffer, { cv::IMWRITE_PNG_COMPRESSION, encoder.png_compression });
+        break;
+    case ImageFormat::Webp:
+        cv::imencode(".webp", image, buffer, { cv::IMWRITE_WEBP_QUALITY, encoder.quality });
+        break;
+    default:
+        cv::imencode(".jpg", image, buffer, { cv::IMWRITE_JPEG_QUALITY, encoder.quality });
+        break;
+    }
+}
+
+// Encodes every image of the frame that is written into memory. The JPEGs are identical to the ones cv::imwrite
+// produces with the same quality, MJPG color images are copied as recorded with color passthrough
+void ExtractionPipeline::encode_frame(PipelineFrame& frame)
+{
+    std::vector<uchar> buffer;
+
+    std::string raw_extension = raw_frame_extension(config.raw_codec.codec);
+    std::string color_extension = image_extension(config.color_encoder.format);
+    std::string depth_ir_extension = image_extension(config.depth_ir_encoder.format);
+
+    // The faces are detected first, so the inference of their batch overlaps with the encoding below
+    if (config.head_pose.enabled)
+    {
+        ScopedTimer timer(profiler, ProfileStage::FaceDetect);
+        frame.head_poses = head_pose->estimate(frame.color_image_opencv);
+    }
+
+    if (config.streams.depth_raw)
+    {
+        {
+            ScopedTimer timer(profiler, ProfileStage::RawEncode);
+            encode_raw_frame(frame.depth_image_opencv, config.raw_codec, buffer);
+        }
+        add_file(frame, "depth/raw_matrices", layout.depth_raw_matrices, frame.depth_image_timestamp, raw_extension,
+            buffer);
+    }
+
+    if (config.point_clouds)
+    {
+        // The frames are already spread over the worker pool, so each point cloud is generated on one thread
+        {
+            ScopedTimer timer(profiler, ProfileStage::PointCloud);
+            PointCloud point_cloud;
+            generate_point_cloud(frame.transformed_depth_image, *xy_table, point_cloud, false);
+            add_point_attributes(point_cloud, config.point_cloud.color ? frame.color_image_opencv : cv::Mat(),
+                config.point_cloud.ir ? frame.ir_image_opencv : cv::Mat());
+            encode_point_cloud(point_cloud, config.point_cloud.format, buffer);
+        }
+        if (point_cloud_stream.is_open())
+        {
+            frame.point_cloud_stream_buffer = std::move(buffer);
+            buffer.clear();
+        }
+        else
+        {
+            add_file(frame, "depth/point_clouds", layout.depth_point_clouds, frame.depth_image_timestamp,
+                point_cloud_extension(config.point_cloud.format), buffer);
+        }
+    }
+
+    if (config.streams.depth_images)
+    {
+        frame.depth_image_opencv /= (config.depth_image_max_mm / 255.0);
+        {
+            ScopedTimer timer(profiler, ProfileStage::JpegEncode);
+            encode_image(frame.depth_image_opencv, config.depth_ir_encoder, buffer);
+        }
+        add_file(frame, "depth/images", layout.depth_images, frame.depth_image_timestamp, depth_ir_extension, buffer);
+    }
+
+    if (config.streams.color)
+    {
+        if (frame.color_image_opencv.empty())
+        {
+            // MJPG passthrough, the recorded frame already is a JPEG file
+            const uint8_t* jpeg = frame.color_image.get_buffer();
+            buffer.assign(jpeg, jpeg + frame.color_image.get_size());
+        }
+        else
+        {
+            ScopedTimer timer(profiler, ProfileStage::JpegEncode);
+            encode_image(frame.color_image_opencv, config.color_encoder, buffer);
+        }
+        add_file(frame, "color/images", layout.color_images, frame.color_image_timestamp, color_extension, buffer);
+    }
+
+    if (config.streams.ir_raw)
+    {
+        {
+            ScopedTimer timer(profiler, ProfileStage::RawEncode);
+            encode_raw_frame(frame.ir_image_opencv, config.raw_codec, buffer);
+        }
+        add_file(frame, "ir/raw_matrices", layout.ir_raw_matrices, frame.ir_image_timestamp, raw_extension, buffer);
+    }
+
+    if (config.streams.ir_images)
+    {
+        frame.ir_image_opencv /= (config.ir_image_max / 255.0);
+        {
+            ScopedTimer timer(profiler, ProfileStage::JpegEncode);
+            encode_image(frame.ir_image_opencv, config.depth_ir_encoder, buffer);
+        }
+        add_file(frame, "ir/images", layout.ir_images, frame.ir_image_timestamp, depth_ir_extension, buffer);
+    }
+
+    frame.depth_image_opencv.release();
+    frame.color_image_opencv.release();
+    frame.ir_image_opencv.release();
+    frame.color_image.reset();
+    frame.transformed_depth_image.reset();
+    frame.transformed_ir_image.reset();
+    frame.color_image_backing.reset();
+}
+
+// Images are named after their zero padded device timestamp
+void ExtractionPipeline::add_file(PipelineFrame& frame, const std::string& stream, const std::filesystem::path& directory,
+    int64_t timestamp, const std::string& extension, std::vector<uchar>& buffer)
+{
+    EncodedFile file;
+    file.stream = stream + extension;
+    file.path = (directory / (std::format("{:020}", timestamp) + extension)).string();
+    file.timestamp = timestamp;
+    file.buffer = std::move(buffer);
+    frame.files.push_back(std::move(file));
+    buffer.clear();
+}
+
+// Writes the encoded images either as separate files or into the container
+void ExtractionPipeline::write_files(PipelineFrame& frame)
+{
+    if (io_slots != nullptr)
+    {
+        io_slots->acquire();
+    }
+
+    uint64_t frame_bytes = 0;
+    if (config.output_mode == OutputMode::Container)
+    {
+        ScopedTimer timer(profiler, ProfileStage::FileWrite);
+        std::vector<ContainerImage> images;
+        for (const EncodedFile& file : frame.files)
+        {
+            ContainerImage image;
+            image.stream = file.stream;
+            image.timestamp_usec = file.timestamp;
+            image.data = file.buffer.data();
+            image.size = file.buffer.size();
+            images.push_back(image);
+            frame_bytes += file.buffer.size();
+        }
+        if (!container.append_frame(images))
+        {
+            std::cerr << "Error appending frame to the container" << std::endl;
+        }
+    }
+    else
+    {
+        for (const EncodedFile& file : frame.files)
+        {
+            ScopedTimer timer(profiler, ProfileStage::FileWrite);
+            std::ofstream output(file.path, std::ios::binary);
+            if (!output.is_open())
+            {
+                std::cerr << "Error opening file: " << file.path << std::endl;
+                continue;
+            }
+            output.write((const char*)file.buffer.data(), (std::streamsize)file.buffer.size());
+            frame_bytes += file.buffer.size();
+        }
+    }
+
+    if (io_slots != nullptr)
+    {
+        io_slots->release();
+    }
+    frame.files.clear();
+    bytes_written += frame_bytes;
+    frames_written++;
+    if (profiler != nullptr)
+    {
+        profiler->add_output(1, frame_bytes);
+    }
+}
+
+// Saves the encoded images and appends the timestamps in capture order
+void ExtractionPipeline::writer()
+{
+    // Frames that finished encoding before one of their predecessors, keyed by index
+    std::map<uint64_t, PipelineFrame> pending_frames;
+    uint64_t next_timestamp_index = 0;
+
+    PipelineFrame frame;
+    while (write_queue.pop(frame))
+    {
+        // The container is appended in capture order, separate files can be written right away
+        if (config.output_mode == OutputMode::Files)
+        {
+            write_files(frame);
+        }
+
+        pending_frames.emplace(frame.index, std::move(frame));
+        for (auto it = pending_frames.begin(); it != pending_frames.end() && it->first == next_timestamp_index;
+            it = pending_frames.erase(it), next_timestamp_index++)
+        {
+            if (config.output_mode == OutputMode::Container)
+            {
+                write_files(it->second);
+            }
+
+            {
+                ScopedTimer timer(profiler, ProfileStage::TimestampWrite);
+                if (depth_log.is_open())
+                {
+                    depth_log.append(it->second.depth_metadata);
+                }
+                if (color_log.is_open())
+                {
+                    color_log.append(it->second.color_metadata);
+                }
+                if (ir_log.is_open())
+                {
+                    ir_log.append(it->second.ir_metadata);
+                }
+            }
+
+            if (head_pose_log.is_open())
+            {
+                head_pose_log.append(it->second.color_image_timestamp, it->second.head_poses.get());
+            }
+
+            if (point_cloud_stream.is_open())
+            {
+                ScopedTimer timer(profiler, ProfileStage::FileWrite);
+                point_cloud_stream.append(it->second.depth_image_timestamp, it->second.point_cloud_stream_buffer);
+                bytes_written += it->second.point_cloud_stream_buffer.size();
+                if (profiler != nullptr)
+                {
+                    profiler->add_output(0, it->second.point_cloud_stream_buffer.size());
+                }
+            }
+
+            if (journal.is_open() && config.output_mode == OutputMode::Files)
+            {
+                const PipelineFrame& written = it->second;
+                checkpoint.frames++;
+                checkpoint.color_timestamp_usec = written.color_image_timestamp;
+                if (writes_depth())
+                {
+                    checkpoint.depth_timestamp_usec = written.depth_image_timestamp;
+                }
+                if (writes_ir())
+                {
+                    checkpoint.ir_timestamp_usec = written.ir_image_timestamp;
+                }
+                if (++frames_since_checkpoint >= JOURNAL_CHECKPOINT_FRAMES ||
+                    std::chrono::steady_clock::now() - last_checkpoint >= JOURNAL_CHECKPOINT_INTERVAL)
+                {
+                    write_checkpoint();
+                }
+            }
+
+            if (config.show_progress && recording_length > 0)
+            {
+                printProgress(it->second.color_image_timestamp / recording_length);
+            }
+        }
+    }
+}
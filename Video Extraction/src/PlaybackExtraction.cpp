@@ -1,271 +1,315 @@
 #include "../include/PlaybackExtraction.hpp"
 
 namespace fs = std::filesystem;
-using json = nlohmann::json;
 
-// Extract the recording data from each camera sensor separately
-int playbackExtraction(std::string input_path) {
-
-    auto start = std::chrono::high_resolution_clock::now();
+// Device time range of a recording one pipeline extracts, by the timestamp of the color images
+struct TimeRange
+{
+    int64_t begin_usec = std::numeric_limits<int64_t>::min();
+    int64_t end_usec = std::numeric_limits<int64_t>::max();
+};
+
+// Extract the captures of one time range through a playback handle and pipeline of its own. A range whose
+// journal is done is skipped, an interrupted one continues after its last checkpoint
+static int extract_range(const std::string& input_path, const OutputLayout& layout, const PipelineConfig& config,
+    const PipelineResources& resources, const TimeRange& range, ExtractionStats* stats) {
+
+    JournalState journal = read_journal(layout.journal());
+    if (journal.done) {
+        return 0;
+    }
 
-    std::string base_path = input_path.substr(0, input_path.find("."));
-    std::string depth_path = base_path + "\\depth";
-    std::string depth_images_path = depth_path + "\\images";
-    std::string depth_raw_matrices_path = depth_path + "\\raw_matrices";
-    std::string depth_point_cloud_path = depth_path + "\\point_clouds";
-    std::string depth_timestamps_path = depth_path + "\\timestamps.txt";
-    std::string color_path = base_path + "\\color";
-    std::string color_images_path = color_path + "\\images";
-    std::string color_timestamps_path = color_path + "\\timestamps.txt";
-    std::string ir_path = base_path + "\\ir";
-    std::string ir_images_path = ir_path + "\\images";
-    std::string ir_raw_matrices_path = ir_path + "\\raw_matrices";
-    std::string ir_timestamps_path = ir_path + "\\timestamps.txt";
-    std::string imu_path = base_path + "\\imu.json";
+    k4a::playback playback = k4a::playback::open(input_path.c_str());
+    double recording_length = config.show_progress ? (double)playback.get_recording_length().count() : 0.0;
 
-    if (!fs::create_directories(base_path)) {
-        std::cerr << "Error creating directory: " << base_path << std::endl;
+    // The playback is read on this thread, the remaining stages run on the pipeline's threads
+    ExtractionPipeline pipeline(playback.get_calibration(), layout, config, recording_length, resources);
+    if (!pipeline.is_open()) {
+        std::cerr << "Error opening timestamp files in: " << layout.base.string() << std::endl;
         return 1;
     }
 
-    if (!fs::create_directories(depth_path)) {
-        std::cerr << "Error creating directory: " << depth_path << std::endl;
-        return 1;
+    // The captures up to the checkpoint are extracted. The seek lands on the first capture with an image at or
+    // after the start, the ones left before it are skipped one by one
+    JournalCheckpoint resumed = pipeline.get_resume_checkpoint();
+    int64_t first_usec = range.begin_usec;
+    if (resumed.frames > 0) {
+        std::cout << "Resuming " << input_path << " after " << resumed.frames << " frames" << std::endl;
+        first_usec = std::max(first_usec, resumed.color_timestamp_usec + 1);
     }
-
-    if (!fs::create_directories(depth_images_path)) {
-        std::cerr << "Error creating directory: " << depth_images_path << std::endl;
-        return 1;
+    if (first_usec != std::numeric_limits<int64_t>::min()) {
+        playback.seek_timestamp(std::chrono::microseconds(first_usec), K4A_PLAYBACK_SEEK_DEVICE_TIME);
     }
 
-    if (!fs::create_directories(depth_raw_matrices_path)) {
-        std::cerr << "Error creating directory: " << depth_raw_matrices_path << std::endl;
-        return 1;
+    k4a::capture capture;
+    auto next_capture = [&] {
+        ScopedTimer timer(resources.profiler, ProfileStage::CaptureRead);
+        return playback.get_next_capture(&capture);
+    };
+    while (next_capture())
+    {
+        // Captures without color are skipped by the pipeline anyway
+        k4a::image color_image = capture.get_color_image();
+        if (color_image) {
+            int64_t timestamp = color_image.get_device_timestamp().count();
+            if (timestamp >= range.end_usec) {
+                break;
+            }
+            if (timestamp >= first_usec) {
+                pipeline.push(capture);
+            }
+        }
+        capture.reset();
     }
+    pipeline.finish();
+    playback.close();
 
-    if (!fs::create_directories(depth_point_cloud_path)) {
-        std::cerr << "Error creating directory: " << depth_point_cloud_path << std::endl;
-        return 1;
-    }
+    FramePoolStats pool_stats = pipeline.get_frame_pool_stats();
+    std::cout << std::endl << "Frame pool hit rate: " << 100.0 * pool_stats.hit_rate() << "% ("
+        << pool_stats.hits << " hits, " << pool_stats.misses << " misses)" << std::endl;
 
-    std::ofstream depth_timestamps_file(depth_timestamps_path, std::ios::app);
-    if (!depth_timestamps_file.is_open()) {
-        std::cerr << "Error opening file: " << depth_timestamps_path << std::endl;
-        return 1;
+    if (stats != nullptr) {
+        *stats = pipeline.get_stats();
     }
+    return 0;
+}
 
-    if (!fs::create_directories(color_path)) {
-        std::cerr << "Error creating directory: " << color_path << std::endl;
-        return 1;
-    }
+// Appends the files every range appended to onto the ones of the layout, range by range. The header line of the
+// csv files is only kept from the first range that has one
+static bool stitch_ranges(const OutputLayout& layout, unsigned int num_ranges) {
 
-    if (!fs::create_directories(color_images_path)) {
-        std::cerr << "Error creating directory: " << color_images_path << std::endl;
-        return 1;
+    std::set<std::string> files;
+    for (unsigned int i = 0; i < num_ranges; i++)
+    {
+        for (const auto& [path, size] : read_journal(get_range_layout(layout, i).journal()).checkpoint.file_sizes)
+        {
+            files.insert(path);
+        }
     }
 
-    std::ofstream color_timestamps_file(color_timestamps_path, std::ios::app);
-    if (!color_timestamps_file.is_open()) {
-        std::cerr << "Error opening file: " << color_timestamps_path << std::endl;
-        return 1;
-    }
+    for (const std::string& file : files)
+    {
+        fs::path output_path = layout.base / file;
+        std::ofstream output(output_path, std::ios::binary | std::ios::trunc);
+        if (!output.is_open()) {
+            std::cerr << "Error opening file: " << output_path.string() << std::endl;
+            return false;
+        }
 
-    if (!fs::create_directories(ir_path)) {
-        std::cerr << "Error creating directory: " << ir_path << std::endl;
-        return 1;
+        bool csv = fs::path(file).extension() == ".csv";
+        bool has_header = false;
+        for (unsigned int i = 0; i < num_ranges; i++)
+        {
+            std::ifstream input(get_range_layout(layout, i).base / file, std::ios::binary);
+            if (!input.is_open()) {
+                continue;
+            }
+            if (csv && has_header) {
+                std::string header;
+                std::getline(input, header);
+            }
+            has_header = has_header || csv;
+            if (input.peek() != std::ifstream::traits_type::eof()) {
+                output << input.rdbuf();
+            }
+        }
+        if (!output.good()) {
+            std::cerr << "Error writing file: " << output_path.string() << std::endl;
+            return false;
+        }
     }
+    return true;
+}
 
-    if (!fs::create_directories(ir_images_path)) {
-        std::cerr << "Error creating directory: " << ir_images_path << std::endl;
-        return 1;
+// Extract the recording data from each camera sensor separately
+int playbackExtraction(std::string input_path, const PipelineConfig& config,
+    const PipelineResources& resources, ExtractionStats* stats) {
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // The output directory has the name of the recording file without extension
+    OutputLayout layout(get_output_path(input_path));
+    std::string base_path = layout.base.string();
+
+    // Every range writes its own timestamps and journal, which cannot be merged into one container
+    unsigned int num_ranges = std::max(config.playback_ranges, 1u);
+    if (num_ranges > 1 && config.output_mode == OutputMode::Container) {
+        std::cout << "The container output is extracted as one range" << std::endl;
+        num_ranges = 1;
     }
 
-    if (!fs::create_directories(ir_raw_matrices_path)) {
-        std::cerr << "Error creating directory: " << ir_raw_matrices_path << std::endl;
-        return 1;
+    // An output directory with a journal belongs to an earlier run of this extraction: skip it when that run
+    // finished, continue it from its last checkpoints, or start over when it cannot be resumed. A run split into a
+    // different number of ranges cannot be resumed. Directories without a journal are left alone
+    JournalState journal = read_journal(layout.journal());
+    if (journal.done) {
+        std::cout << "Skipping " << input_path << ", already extracted." << std::endl;
+        if (stats != nullptr) {
+            *stats = ExtractionStats();
+        }
+        return 0;
     }
-    
-    std::ofstream ir_timestamps_file(ir_timestamps_path, std::ios::app);
-    if (!ir_timestamps_file.is_open()) {
-        std::cerr << "Error opening file: " << ir_timestamps_path << std::endl;
+    if (fs::exists(layout.base) && !journal.exists) {
+        std::cerr << "Error: " << base_path << " exists without " << layout.journal().filename().string()
+            << ", remove it to extract " << input_path << " again" << std::endl;
         return 1;
     }
+    fs::path ranges_path = get_ranges_path(layout);
+    bool same_ranges = num_ranges == 1 ? !fs::exists(ranges_path) :
+        fs::exists(ranges_path / std::to_string(num_ranges - 1)) &&
+        !fs::exists(ranges_path / std::to_string(num_ranges));
+    bool resumable = config.output_mode == OutputMode::Files && same_ranges &&
+        (num_ranges > 1 || journal.has_checkpoint);
+    if (journal.exists && !resumable) {
+        std::cout << "Removing partial output of interrupted extraction: " << base_path << std::endl;
+        std::error_code error;
+        fs::remove_all(layout.base, error);
+        if (error) {
+            std::cerr << "Error removing directory: " << base_path << std::endl;
+            return 1;
+        }
+    }
 
-    std::ofstream imu_file(imu_path, std::ios::app);
-    if (!imu_file.is_open()) {
-        std::cerr << "Error opening file: " << imu_path << std::endl;
+    if (!create_output_directories(layout)) {
         return 1;
     }
 
-    k4a::playback playback = k4a::playback::open(input_path.c_str());
-
-    k4a::calibration calibration = playback.get_calibration();
-
-    k4a::transformation transformation(calibration);
-
-    k4a::capture capture;
+    std::vector<OutputLayout> range_layouts;
+    if (num_ranges == 1) {
+        range_layouts.push_back(layout);
+    }
+    else {
+        // The journal of the recording marks the folder as an extraction until the ranges are stitched
+        if (!fs::exists(layout.journal()) && !ExtractionJournal().open(layout.journal())) {
+            return 1;
+        }
+        for (unsigned int i = 0; i < num_ranges; i++)
+        {
+            range_layouts.push_back(get_range_layout(layout, i));
+            if (!create_output_directories(range_layouts.back())) {
+                return 1;
+            }
+        }
+    }
 
-    k4a_image_t depth_image = NULL;
-    k4a_image_t color_image = NULL;
-    k4a_image_t ir_image = NULL;
-    double recording_length = playback.get_recording_length().count();
-    while (playback.get_next_capture(&capture))
+    // The ranges split the recording evenly by device time
+    std::vector<TimeRange> ranges(num_ranges);
     {
-        k4a::image depth_image = capture.get_depth_image();
-        k4a::image color_image = capture.get_color_image();
-        k4a::image ir_image = capture.get_ir_image();
-
-        if (depth_image.is_valid() && color_image.is_valid() && ir_image.is_valid())
+        k4a::playback playback = k4a::playback::open(input_path.c_str());
+        int64_t first_usec = playback.get_record_configuration().start_timestamp_offset_usec;
+        int64_t length_usec = playback.get_recording_length().count();
+        bool geometry_written = num_ranges == 1 ||
+            write_geometry(layout.geometry, playback.get_calibration(), config.geometry);
+        playback.close();
+        if (!geometry_written) {
+            return 1;
+        }
+        for (unsigned int i = 1; i < num_ranges; i++)
         {
-            int32_t color_image_width_pixels = color_image.get_width_pixels();
-            int32_t color_image_height_pixels = color_image.get_height_pixels();
-
-            k4a::image transformed_depth_image = k4a::image::create(
-                K4A_IMAGE_FORMAT_DEPTH16,
-                color_image_width_pixels,
-                color_image_height_pixels,
-                color_image_width_pixels * (int)sizeof(uint16_t));
-            transformation.depth_image_to_color_camera(depth_image, &transformed_depth_image);
-
-            cv::Mat depth_image_opencv = get_mat(transformed_depth_image);
-
-            int depth_image_timestamp = depth_image.get_device_timestamp().count();
-            std::string depth_image_name = std::format("{:020}", depth_image_timestamp);
-
-            cv::imwrite((depth_raw_matrices_path + "\\" + depth_image_name + ".jpg").c_str(), depth_image_opencv);
-
-            // 3860mm is the max range of the depth sensor with NFOV_UNBINNED
-            depth_image_opencv /= (3860.0 / 255.0);
-            cv::imwrite((depth_images_path + "\\" + depth_image_name + ".jpg").c_str(), depth_image_opencv);
-            /*
-            k4a::image xy_table = k4a::image::create(
-                K4A_IMAGE_FORMAT_CUSTOM,
-                color_image_width_pixels,
-                color_image_height_pixels,
-                color_image_width_pixels * (int)sizeof(k4a_float2_t));
-            create_xy_table(calibration, xy_table);
-            k4a::image point_cloud = k4a::image::create(
-                K4A_IMAGE_FORMAT_CUSTOM,
-                color_image_width_pixels,
-                color_image_height_pixels,
-                color_image_width_pixels * (int)sizeof(k4a_float3_t));
-            int point_count = 0;
-            generate_point_cloud(transformed_depth_image, xy_table, point_cloud, &point_count);
-            write_point_cloud((depth_point_cloud_path + "\\" + depth_image_name + ".ply").c_str(), point_cloud, point_count);
-            */
-
-            depth_timestamps_file << depth_image_timestamp << std::endl;
-
-            transformed_depth_image.reset();
-            //xy_table.reset();
-            //point_cloud.reset();
-
-            int color_image_timestamp = color_image.get_device_timestamp().count();
-            std::string color_image_name = std::format("{:020}", color_image_timestamp);
-
-            cv::Mat color_image_opencv = get_mat(color_image);
-
-            cv::imwrite((color_images_path + "\\" + color_image_name + ".jpg").c_str(), color_image_opencv);
-
-            color_timestamps_file << color_image_timestamp << std::endl;
-
-            int ir_image_width_pixels = ir_image.get_width_pixels();
-            int ir_image_height_pixels = ir_image.get_height_pixels();
-            int ir_image_stride_bytes = ir_image.get_stride_bytes();
-            uint8_t* ir_image_buffer = ir_image.get_buffer();
-            k4a::image custom_ir_image = k4a::image::create_from_buffer(
-                K4A_IMAGE_FORMAT_CUSTOM16,
-                ir_image_width_pixels,
-                ir_image_height_pixels,
-                ir_image_width_pixels * (int)sizeof(uint16_t),
-                ir_image_buffer,
-                ir_image_height_pixels * ir_image_stride_bytes,
-                NULL, // memory leak?
-                NULL);
-
-            k4a::image transformed_ir_image = k4a::image::create(
-                K4A_IMAGE_FORMAT_CUSTOM16,
-                color_image_width_pixels,
-                color_image_height_pixels,
-                color_image_width_pixels * (int)sizeof(uint16_t));
-
-            k4a::image transformed_depth_image_reference = k4a::image::create(
-                K4A_IMAGE_FORMAT_DEPTH16,
-                color_image_width_pixels,
-                color_image_height_pixels,
-                color_image_width_pixels * (int)sizeof(uint16_t));
-
-            transformation.depth_image_to_color_camera_custom(
-                depth_image,
-                custom_ir_image,
-                &transformed_depth_image_reference,
-                &transformed_ir_image,
-                K4A_TRANSFORMATION_INTERPOLATION_TYPE_NEAREST,
-                0);
-
-            cv::Mat ir_image_opencv = get_mat(transformed_ir_image);
-
-            int ir_image_timestamp = ir_image.get_device_timestamp().count();
-            std::string ir_image_name = std::format("{:020}", ir_image_timestamp);
-
-            cv::imwrite((ir_raw_matrices_path + "\\" + ir_image_name + ".jpg").c_str(), ir_image_opencv);
-
-            // 1000 is the max range of the ir sensor
-            ir_image_opencv /= (1000.0 / 255.0);
-            cv::imwrite((ir_images_path + "\\" + ir_image_name + ".jpg").c_str(), ir_image_opencv);
-
-            ir_timestamps_file << ir_image_timestamp << std::endl;
-
-            custom_ir_image.reset();
-            transformed_ir_image.reset();
-            transformed_depth_image_reference.reset();
-
-            printProgress(depth_image_timestamp / recording_length);
+            ranges[i].begin_usec = first_usec + length_usec * i / num_ranges;
+            ranges[i - 1].end_usec = ranges[i].begin_usec;
         }
-        depth_image.reset();
-        color_image.reset();
-        ir_image.reset();
-        capture.reset();
     }
-    transformation.destroy();
-
-    depth_timestamps_file.close();
-    color_timestamps_file.close();
-    ir_timestamps_file.close();
 
-    k4a_imu_sample_t imu_sample;
+    PipelineConfig pipeline_config = config;
+    pipeline_config.journal = true;
+    pipeline_config.show_progress = config.show_progress && num_ranges == 1;
 
-    auto imu_data_array = json::array();
+    // A batch may hand in its own profiler, encode pool and head pose model, otherwise the ranges of the recording
+    // share theirs
+    SharedPipelineResources shared;
+    if (!open_shared_resources(config, shared, resources)) {
+        return 1;
+    }
+    const PipelineResources& pipeline_resources = shared.resources;
 
-    while (playback.get_next_imu_sample(&imu_sample))
+    // The IMU samples are read with a handle of their own while the ranges read the captures
+    std::string imu_path = layout.imu(imu_extension(config.imu.format)).string();
+    bool imu_ok = true;
+    std::thread imu_thread;
+    if (config.imu.enabled && config.imu.thread)
     {
-        json imu_json = json::object();
-        imu_json["data"] = json::object();
-        imu_json["data"]["acc_sample"] = json::object();
-        imu_json["data"]["acc_sample"]["x"] = imu_sample.acc_sample.xyz.x;
-        imu_json["data"]["acc_sample"]["y"] = imu_sample.acc_sample.xyz.y;
-        imu_json["data"]["acc_sample"]["z"] = imu_sample.acc_sample.xyz.z;
-        imu_json["data"]["acc_timestamp_usec"] = imu_sample.acc_timestamp_usec;
-        imu_json["data"]["gyro_sample"] = json::object();
-        imu_json["data"]["gyro_sample"]["x"] = imu_sample.gyro_sample.xyz.x;
-        imu_json["data"]["gyro_sample"]["y"] = imu_sample.gyro_sample.xyz.y;
-        imu_json["data"]["gyro_sample"]["z"] = imu_sample.gyro_sample.xyz.z;
-        imu_json["data"]["gyro_timestamp_usec"] = imu_sample.gyro_timestamp_usec;
+        imu_thread = std::thread([&] {
+            try
+            {
+                imu_ok = extract_imu(input_path, imu_path, config.imu.format);
+            }
+            catch (const k4a::error& e)
+            {
+                std::cerr << "Error reading the IMU samples of " << input_path << ": " << e.what() << std::endl;
+                imu_ok = false;
+            }
+        });
+    }
 
-        imu_data_array.push_back(imu_json);
+    // Every range but the last runs on a thread of its own, each with its own playback, transformations and writer
+    std::vector<ExtractionStats> range_stats(num_ranges);
+    std::vector<int> results(num_ranges, 1);
+    auto run_range = [&](unsigned int i) {
+        try
+        {
+            results[i] = extract_range(input_path, range_layouts[i], pipeline_config, pipeline_resources, ranges[i],
+                &range_stats[i]);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error extracting " << input_path << ": " << e.what() << std::endl;
+        }
+        if (results[i] == 0 && num_ranges > 1 && !ExtractionJournal::mark_done(range_layouts[i].journal())) {
+            results[i] = 1;
+        }
+    };
+    std::vector<std::thread> range_threads;
+    for (unsigned int i = 0; i + 1 < num_ranges; i++)
+    {
+        range_threads.emplace_back(run_range, i);
+    }
+    run_range(num_ranges - 1);
+    for (std::thread& thread : range_threads)
+    {
+        thread.join();
     }
 
-    json imu_data = json::object();
-    imu_data["data"] = imu_data_array;
+    if (imu_thread.joinable()) {
+        imu_thread.join();
+    }
+    else if (config.imu.enabled) {
+        imu_ok = extract_imu(input_path, imu_path, config.imu.format);
+    }
+    if (!imu_ok || !std::all_of(results.begin(), results.end(), [](int result) { return result == 0; })) {
+        return 1;
+    }
 
-    imu_file << imu_data.dump(4) << std::endl;
+    if (num_ranges > 1) {
+        if (!stitch_ranges(layout, num_ranges)) {
+            return 1;
+        }
+        std::error_code error;
+        fs::remove_all(ranges_path, error);
+    }
 
-    playback.close();
-    imu_file.close();
+    // The IMU file is rewritten by every run, so the outputs are complete once it is
+    if (!ExtractionJournal::mark_done(layout.journal())) {
+        return 1;
+    }
 
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> duration = end - start;
+    if (stats != nullptr)
+    {
+        *stats = ExtractionStats();
+        for (const ExtractionStats& range : range_stats)
+        {
+            stats->frames += range.frames;
+            stats->bytes_written += range.bytes_written;
+        }
+        stats->seconds = duration.count();
+    }
+    if (shared.profiler)
+    {
+        write_profile(*shared.profiler, base_path, config.profile.trace);
+    }
     std::cout << std::endl << input_path + " concluded in " << duration.count() << " seconds." << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
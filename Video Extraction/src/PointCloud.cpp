@@ -0,0 +1,423 @@
+#include "../include/PointCloud.hpp"
+
+// Rows handled by one stripe of the parallel kernels
+static const int POINT_CLOUD_STRIPE_ROWS = 32;
+
+static const char POINT_CLOUD_FRAME_MAGIC[4] = { 'K', '4', 'P', 'F' };
+
+size_t PointCloud::size() const
+{
+    return z.size();
+}
+
+void PointCloud::resize(size_t point_count)
+{
+    x.resize(point_count);
+    y.resize(point_count);
+    z.resize(point_count);
+    pixel_index.resize(point_count);
+    red.clear();
+    green.clear();
+    blue.clear();
+    ir.clear();
+    has_color = false;
+    has_ir = false;
+}
+
+// Precomputes a lookup table by storing x- and y-scale factors for every pixel
+XYTable create_xy_table(const k4a::calibration& calibration, k4a_calibration_type_t camera)
+{
+    const k4a_calibration_camera_t& camera_calibration = camera == K4A_CALIBRATION_TYPE_COLOR
+        ? calibration.color_camera_calibration : calibration.depth_camera_calibration;
+
+    XYTable xy_table;
+    xy_table.width = camera_calibration.resolution_width;
+    xy_table.height = camera_calibration.resolution_height;
+    size_t pixel_count = (size_t)xy_table.width * xy_table.height;
+    xy_table.x.resize(pixel_count);
+    xy_table.y.resize(pixel_count);
+    xy_table.valid.resize(pixel_count);
+
+    // convert_2d_to_3d only reads the calibration, so the rows can be filled in parallel
+    cv::parallel_for_(cv::Range(0, xy_table.height), [&](const cv::Range& rows) {
+        k4a_float2_t p;
+        k4a_float3_t ray;
+        for (int y = rows.start; y < rows.end; y++)
+        {
+            p.xy.y = (float)y;
+            for (int x = 0, idx = y * xy_table.width; x < xy_table.width; x++, idx++)
+            {
+                p.xy.x = (float)x;
+
+                bool valid = calibration.convert_2d_to_3d(p, 1.f, camera, camera, &ray) &&
+                    !std::isnan(ray.xyz.x) && !std::isnan(ray.xyz.y);
+
+                xy_table.x[idx] = valid ? ray.xyz.x : 0.f;
+                xy_table.y[idx] = valid ? ray.xyz.y : 0.f;
+                xy_table.valid[idx] = valid ? 1 : 0;
+            }
+        }
+    });
+
+    return xy_table;
+}
+
+std::shared_ptr<const XYTable> get_xy_table(const k4a::calibration& calibration, k4a_calibration_type_t camera)
+{
+    static std::mutex cache_mutex;
+    static std::map<std::string, std::shared_ptr<const XYTable>> cache;
+
+    // The intrinsics, extrinsics and resolution of the camera identify the table
+    const k4a_calibration_camera_t& camera_calibration = camera == K4A_CALIBRATION_TYPE_COLOR
+        ? calibration.color_camera_calibration : calibration.depth_camera_calibration;
+    std::string key((const char*)&camera, sizeof(camera));
+    key.append((const char*)&camera_calibration, sizeof(camera_calibration));
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(key);
+    if (it == cache.end())
+    {
+        it = cache.emplace(key, std::make_shared<const XYTable>(create_xy_table(calibration, camera))).first;
+    }
+    return it->second;
+}
+
+// 3d X-coordinate of a pixel in millimeters is derived by multiplying the pixel's depth value
+// with the corresponding x-scale factor. The 3d Y-coordinate is obtained by multiplying with
+// the y-scale factor.
+//
+// The image is split into stripes of rows. A first pass counts the valid pixels of every stripe, which gives each
+// stripe the offset of its first point, and a second pass writes the points of every stripe from that offset.
+bool generate_point_cloud(const k4a::image& depth_image, const XYTable& xy_table, PointCloud& point_cloud,
+    bool parallel)
+{
+    if (depth_image.get_width_pixels() != xy_table.width || depth_image.get_height_pixels() != xy_table.height)
+    {
+        std::cerr << "Depth image and xy table have different resolutions" << std::endl;
+        return false;
+    }
+
+    const int width = xy_table.width;
+    const int height = xy_table.height;
+    const int stride = depth_image.get_stride_bytes() / (int)sizeof(uint16_t);
+    const uint16_t* depth_data = (const uint16_t*)(const void*)depth_image.get_buffer();
+    const float* table_x = xy_table.x.data();
+    const float* table_y = xy_table.y.data();
+    const uint8_t* table_valid = xy_table.valid.data();
+
+    const int stripe_count = (height + POINT_CLOUD_STRIPE_ROWS - 1) / POINT_CLOUD_STRIPE_ROWS;
+    std::vector<size_t> stripe_offsets(stripe_count + 1, 0);
+
+    auto for_each_stripe = [&](const std::function<void(const cv::Range&)>& body) {
+        if (parallel)
+        {
+            cv::parallel_for_(cv::Range(0, stripe_count), body);
+        }
+        else
+        {
+            body(cv::Range(0, stripe_count));
+        }
+    };
+
+    // Branchless count, the compiler vectorizes the inner loop
+    for_each_stripe([&](const cv::Range& stripes) {
+        for (int stripe = stripes.start; stripe < stripes.end; stripe++)
+        {
+            size_t count = 0;
+            int last_row = std::min(height, (stripe + 1) * POINT_CLOUD_STRIPE_ROWS);
+            for (int y = stripe * POINT_CLOUD_STRIPE_ROWS; y < last_row; y++)
+            {
+                const uint16_t* depth_row = depth_data + (size_t)y * stride;
+                const uint8_t* valid_row = table_valid + (size_t)y * width;
+                uint32_t row_count = 0;
+                for (int x = 0; x < width; x++)
+                {
+                    row_count += (uint32_t)((depth_row[x] != 0) & valid_row[x]);
+                }
+                count += row_count;
+            }
+            stripe_offsets[stripe + 1] = count;
+        }
+    });
+
+    for (int stripe = 0; stripe < stripe_count; stripe++)
+    {
+        stripe_offsets[stripe + 1] += stripe_offsets[stripe];
+    }
+    point_cloud.resize(stripe_offsets[stripe_count]);
+
+    float* points_x = point_cloud.x.data();
+    float* points_y = point_cloud.y.data();
+    float* points_z = point_cloud.z.data();
+    uint32_t* pixel_index = point_cloud.pixel_index.data();
+
+    for_each_stripe([&](const cv::Range& stripes) {
+        for (int stripe = stripes.start; stripe < stripes.end; stripe++)
+        {
+            size_t point = stripe_offsets[stripe];
+            int last_row = std::min(height, (stripe + 1) * POINT_CLOUD_STRIPE_ROWS);
+            for (int y = stripe * POINT_CLOUD_STRIPE_ROWS; y < last_row; y++)
+            {
+                const uint16_t* depth_row = depth_data + (size_t)y * stride;
+                size_t idx = (size_t)y * width;
+                for (int x = 0; x < width; x++, idx++)
+                {
+                    if ((depth_row[x] != 0) & table_valid[idx])
+                    {
+                        float z = (float)depth_row[x];
+                        points_x[point] = table_x[idx] * z;
+                        points_y[point] = table_y[idx] * z;
+                        points_z[point] = z;
+                        pixel_index[point] = (uint32_t)idx;
+                        point++;
+                    }
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+void add_point_attributes(PointCloud& point_cloud, const cv::Mat& color_image, const cv::Mat& ir_image)
+{
+    size_t point_count = point_cloud.size();
+
+    if (!color_image.empty())
+    {
+        point_cloud.red.resize(point_count);
+        point_cloud.green.resize(point_count);
+        point_cloud.blue.resize(point_count);
+        point_cloud.has_color = true;
+        int channels = color_image.channels();
+        for (size_t i = 0; i < point_count; i++)
+        {
+            uint32_t idx = point_cloud.pixel_index[i];
+            const uint8_t* pixel = color_image.ptr<uint8_t>((int)(idx / color_image.cols)) + (idx % color_image.cols) * channels;
+            point_cloud.blue[i] = pixel[0];
+            point_cloud.green[i] = pixel[1];
+            point_cloud.red[i] = pixel[2];
+        }
+    }
+
+    if (!ir_image.empty())
+    {
+        point_cloud.ir.resize(point_count);
+        point_cloud.has_ir = true;
+        for (size_t i = 0; i < point_count; i++)
+        {
+            uint32_t idx = point_cloud.pixel_index[i];
+            point_cloud.ir[i] = ir_image.ptr<uint16_t>((int)(idx / ir_image.cols))[idx % ir_image.cols];
+        }
+    }
+}
+
+std::string point_cloud_extension(PointCloudFormat format)
+{
+    switch (format)
+    {
+    case PointCloudFormat::Bin:
+        return ".bin";
+    case PointCloudFormat::Pcd:
+        return ".pcd";
+    default:
+        return ".ply";
+    }
+}
+
+// The header of the text and binary ply files
+static std::string ply_header(const PointCloud& point_cloud, bool binary, bool color, bool ir)
+{
+    std::string header = std::string("ply\nformat ") + (binary ? "binary_little_endian" : "ascii") +
+        " 1.0\nelement vertex " + std::to_string(point_cloud.size()) +
+        "\nproperty float x\nproperty float y\nproperty float z\n";
+    if (color)
+    {
+        header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    }
+    if (ir)
+    {
+        header += "property ushort ir\n";
+    }
+    return header + "end_header\n";
+}
+
+static std::string pcd_header(const PointCloud& point_cloud, bool color, bool ir)
+{
+    std::string fields = "x y z";
+    std::string sizes = "4 4 4";
+    std::string types = "F F F";
+    std::string counts = "1 1 1";
+    if (color)
+    {
+        fields += " rgb";
+        sizes += " 4";
+        types += " U";
+        counts += " 1";
+    }
+    if (ir)
+    {
+        fields += " intensity";
+        sizes += " 2";
+        types += " U";
+        counts += " 1";
+    }
+    std::string point_count = std::to_string(point_cloud.size());
+    return "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\nFIELDS " + fields + "\nSIZE " + sizes +
+        "\nTYPE " + types + "\nCOUNT " + counts + "\nWIDTH " + point_count +
+        "\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS " + point_count + "\nDATA binary\n";
+}
+
+// The points are stored as arrays of each coordinate, the files expect one record per point. The buffer is sized
+// once and every record is copied into place, which the ply, bin and pcd files share up to the color field.
+void encode_point_cloud(const PointCloud& point_cloud, PointCloudFormat format, std::vector<uchar>& buffer)
+{
+    bool color = point_cloud.has_color;
+    bool ir = point_cloud.has_ir;
+    size_t point_count = point_cloud.size();
+
+    if (format == PointCloudFormat::AsciiPly)
+    {
+        std::string header = ply_header(point_cloud, false, color, ir);
+        buffer.assign(header.begin(), header.end());
+
+        char line[96];
+        for (size_t i = 0; i < point_count; i++)
+        {
+            int length = std::snprintf(line, sizeof(line), "%g %g %g",
+                point_cloud.x[i], point_cloud.y[i], point_cloud.z[i]);
+            if (color)
+            {
+                length += std::snprintf(line + length, sizeof(line) - length, " %u %u %u",
+                    point_cloud.red[i], point_cloud.green[i], point_cloud.blue[i]);
+            }
+            if (ir)
+            {
+                length += std::snprintf(line + length, sizeof(line) - length, " %u", point_cloud.ir[i]);
+            }
+            line[length++] = '\n';
+            buffer.insert(buffer.end(), line, line + length);
+        }
+        return;
+    }
+
+    std::string header;
+    if (format == PointCloudFormat::BinaryPly)
+    {
+        header = ply_header(point_cloud, true, color, ir);
+    }
+    else if (format == PointCloudFormat::Pcd)
+    {
+        header = pcd_header(point_cloud, color, ir);
+    }
+
+    // pcd packs the color into one uint32
+    size_t color_size = color ? (format == PointCloudFormat::Pcd ? 4 : 3) : 0;
+    size_t record_size = 3 * sizeof(float) + color_size + (ir ? sizeof(uint16_t) : 0);
+
+    buffer.resize(header.size() + point_count * record_size);
+    std::memcpy(buffer.data(), header.data(), header.size());
+
+    uchar* record = buffer.data() + header.size();
+    for (size_t i = 0; i < point_count; i++, record += record_size)
+    {
+        std::memcpy(record, &point_cloud.x[i], sizeof(float));
+        std::memcpy(record + 4, &point_cloud.y[i], sizeof(float));
+        std::memcpy(record + 8, &point_cloud.z[i], sizeof(float));
+        uchar* attributes = record + 12;
+        if (color_size == 4)
+        {
+            uint32_t rgb = ((uint32_t)point_cloud.red[i] << 16) | ((uint32_t)point_cloud.green[i] << 8) | point_cloud.blue[i];
+            std::memcpy(attributes, &rgb, sizeof(rgb));
+        }
+        else if (color_size == 3)
+        {
+            attributes[0] = point_cloud.red[i];
+            attributes[1] = point_cloud.green[i];
+            attributes[2] = point_cloud.blue[i];
+        }
+        if (ir)
+        {
+            std::memcpy(attributes + color_size, &point_cloud.ir[i], sizeof(uint16_t));
+        }
+    }
+}
+
+// Create point cloud file
+bool write_point_cloud(const std::string& file_name, const PointCloud& point_cloud, PointCloudFormat format)
+{
+    std::vector<uchar> buffer;
+    encode_point_cloud(point_cloud, format, buffer);
+
+    std::ofstream file(file_name, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << file_name << std::endl;
+        return false;
+    }
+    file.write((const char*)buffer.data(), (std::streamsize)buffer.size());
+    return file.good();
+}
+
+bool PointCloudStreamWriter::open(const std::string& path, bool append)
+{
+    file.open(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PointCloudStreamWriter::append(int64_t timestamp_usec, const std::vector<uchar>& encoded_point_cloud)
+{
+    uint64_t size = encoded_point_cloud.size();
+    file.write(POINT_CLOUD_FRAME_MAGIC, sizeof(POINT_CLOUD_FRAME_MAGIC));
+    file.write((const char*)&timestamp_usec, sizeof(timestamp_usec));
+    file.write((const char*)&size, sizeof(size));
+    file.write((const char*)encoded_point_cloud.data(), (std::streamsize)size);
+    return file.good();
+}
+
+void PointCloudStreamWriter::flush()
+{
+    file.flush();
+}
+
+void PointCloudStreamWriter::close()
+{
+    file.close();
+}
+
+bool PointCloudStreamWriter::is_open() const
+{
+    return file.is_open();
+}
+
+bool PointCloudStreamReader::open(const std::string& path)
+{
+    file.open(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PointCloudStreamReader::next(int64_t& timestamp_usec, std::vector<uchar>& encoded_point_cloud)
+{
+    char magic[4];
+    uint64_t size = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&timestamp_usec, sizeof(timestamp_usec));
+    file.read((char*)&size, sizeof(size));
+    if (!file || std::memcmp(magic, POINT_CLOUD_FRAME_MAGIC, sizeof(magic)) != 0)
+    {
+        return false;
+    }
+    encoded_point_cloud.resize((size_t)size);
+    file.read((char*)encoded_point_cloud.data(), (std::streamsize)size);
+    return (bool)file;
+}
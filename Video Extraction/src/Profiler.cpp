@@ -0,0 +1,260 @@
+#include "../include/Profiler.hpp"
+
+const char* profile_stage_name(ProfileStage stage)
+{
+    switch (stage)
+    {
+    case ProfileStage::CaptureRead:
+        return "capture_read";
+    case ProfileStage::PipelinePush:
+        return "pipeline_push";
+    case ProfileStage::ColorDecode:
+        return "color_decode";
+    case ProfileStage::DepthIrTransform:
+        return "depth_ir_transform";
+    case ProfileStage::ColorTransform:
+        return "color_transform";
+    case ProfileStage::PointCloud:
+        return "point_cloud";
+    case ProfileStage::RawEncode:
+        return "raw_encode";
+    case ProfileStage::JpegEncode:
+        return "jpeg_encode";
+    case ProfileStage::FileWrite:
+        return "file_write";
+    case ProfileStage::TimestampWrite:
+        return "timestamp_write";
+    case ProfileStage::SyncMatch:
+        return "sync_match";
+    case ProfileStage::FaceDetect:
+        return "face_detect";
+    case ProfileStage::HeadPoseInference:
+        return "head_pose_inference";
+    default:
+        return "unknown";
+    }
+}
+
+// Small number naming the calling thread in the trace
+static uint32_t trace_thread_id()
+{
+    static std::atomic<uint32_t> next_id = 0;
+    thread_local uint32_t id = next_id++;
+    return id;
+}
+
+Profiler::Profiler(bool trace) : start_time(std::chrono::steady_clock::now()), trace(trace)
+{
+}
+
+// Durations below 16 us have a bucket each, above every power of two is split into PROFILER_SUB_BUCKETS buckets
+size_t Profiler::bucket_index(uint64_t usec)
+{
+    if (usec < PROFILER_SUB_BUCKETS)
+    {
+        return (size_t)usec;
+    }
+    size_t exponent = 63 - (size_t)std::countl_zero(usec);
+    size_t sub_bucket = (size_t)(usec >> (exponent - 4)) & (PROFILER_SUB_BUCKETS - 1);
+    return std::min((exponent - 3) * PROFILER_SUB_BUCKETS + sub_bucket, PROFILER_BUCKETS - 1);
+}
+
+uint64_t Profiler::bucket_lower_bound(size_t index)
+{
+    if (index < PROFILER_SUB_BUCKETS)
+    {
+        return index;
+    }
+    size_t exponent = index / PROFILER_SUB_BUCKETS + 3;
+    return (PROFILER_SUB_BUCKETS + index % PROFILER_SUB_BUCKETS) << (exponent - 4);
+}
+
+void Profiler::record(ProfileStage stage, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+    uint64_t usec = (uint64_t)std::max<int64_t>(0,
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    StageHistogram& histogram = stages[(size_t)stage];
+    histogram.buckets[bucket_index(usec)].fetch_add(1, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.total_usec.fetch_add(usec, std::memory_order_relaxed);
+    uint64_t max_usec = histogram.max_usec.load(std::memory_order_relaxed);
+    while (usec > max_usec && !histogram.max_usec.compare_exchange_weak(max_usec, usec, std::memory_order_relaxed))
+    {
+    }
+
+    if (trace)
+    {
+        TraceEvent event;
+        event.stage = stage;
+        event.thread = trace_thread_id();
+        event.start_usec = std::chrono::duration_cast<std::chrono::microseconds>(start - start_time).count();
+        event.duration_usec = (int64_t)usec;
+
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        if (trace_events.size() < PROFILER_MAX_TRACE_EVENTS)
+        {
+            trace_events.push_back(event);
+        }
+    }
+}
+
+void Profiler::add_output(uint64_t frames, uint64_t bytes)
+{
+    this->frames += frames;
+    this->bytes += bytes;
+}
+
+// Middle of the bucket holding the percentile, the exact value for durations below 16 us
+double Profiler::percentile(const StageHistogram& histogram, double fraction) const
+{
+    uint64_t count = histogram.count.load();
+    if (count == 0)
+    {
+        return 0.0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(fraction * count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < PROFILER_BUCKETS; i++)
+    {
+        seen += histogram.buckets[i].load();
+        if (seen >= rank)
+        {
+            double lower = (double)bucket_lower_bound(i);
+            double upper = i + 1 < PROFILER_BUCKETS ? (double)bucket_lower_bound(i + 1) : lower;
+            double value = i < PROFILER_SUB_BUCKETS ? lower : (lower + upper) / 2.0;
+            return std::min(value, (double)histogram.max_usec.load());
+        }
+    }
+    return (double)histogram.max_usec.load();
+}
+
+StageSummary Profiler::get_stage_summary(ProfileStage stage) const
+{
+    const StageHistogram& histogram = stages[(size_t)stage];
+    StageSummary summary;
+    summary.count = histogram.count;
+    summary.total_ms = histogram.total_usec / 1000.0;
+    summary.mean_us = summary.count == 0 ? 0.0 : (double)histogram.total_usec / summary.count;
+    summary.p50_us = percentile(histogram, 0.50);
+    summary.p95_us = percentile(histogram, 0.95);
+    summary.p99_us = percentile(histogram, 0.99);
+    summary.max_us = (double)histogram.max_usec;
+    return summary;
+}
+
+double Profiler::get_elapsed_seconds() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+bool Profiler::write_summary(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    double seconds = std::max(get_elapsed_seconds(), 1e-9);
+    char line[512];
+    std::snprintf(line, sizeof(line),
+        "{\n    \"seconds\": %.6f,\n    \"frames\": %llu,\n    \"frames_per_second\": %.3f,\n"
+        "    \"bytes_written\": %llu,\n    \"megabytes_per_second\": %.3f,\n    \"stages\": {\n",
+        seconds, (unsigned long long)frames.load(), frames / seconds, (unsigned long long)bytes.load(),
+        bytes / 1e6 / seconds);
+    file << line;
+
+    bool first = true;
+    for (size_t i = 0; i < (size_t)ProfileStage::Count; i++)
+    {
+        StageSummary summary = get_stage_summary((ProfileStage)i);
+        if (summary.count == 0)
+        {
+            continue;
+        }
+        std::snprintf(line, sizeof(line),
+            "%s        \"%s\": { \"count\": %llu, \"total_ms\": %.3f, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+            "\"p95_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f }",
+            first ? "" : ",\n", profile_stage_name((ProfileStage)i), (unsigned long long)summary.count,
+            summary.total_ms, summary.mean_us, summary.p50_us, summary.p95_us, summary.p99_us, summary.max_us);
+        file << line;
+        first = false;
+    }
+    file << "\n    }\n}\n";
+    return true;
+}
+
+bool Profiler::write_trace(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[256];
+    for (size_t i = 0; i < trace_events.size(); i++)
+    {
+        const TraceEvent& event = trace_events[i];
+        std::snprintf(line, sizeof(line),
+            "{\"name\":\"%s\",\"cat\":\"extraction\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%lld,\"dur\":%lld}%s\n",
+            profile_stage_name(event.stage), event.thread, (long long)event.start_usec,
+            (long long)event.duration_usec, i + 1 < trace_events.size() ? "," : "");
+        file << line;
+    }
+    file << "]}\n";
+    return true;
+}
+
+void Profiler::print_summary() const
+{
+    double seconds = std::max(get_elapsed_seconds(), 1e-9);
+    std::cout << "Profile: " << frames << " frames in " << seconds << " seconds (" << frames / seconds
+        << " frames/s, " << bytes / 1e6 / seconds << " MB/s)" << std::endl;
+    for (size_t i = 0; i < (size_t)ProfileStage::Count; i++)
+    {
+        StageSummary summary = get_stage_summary((ProfileStage)i);
+        if (summary.count == 0)
+        {
+            continue;
+        }
+        std::cout << std::setw(18) << profile_stage_name((ProfileStage)i)
+            << " | count " << std::setw(8) << summary.count
+            << " | total " << std::setw(10) << summary.total_ms << " ms"
+            << " | p50 " << std::setw(8) << summary.p50_us << " us"
+            << " | p95 " << std::setw(8) << summary.p95_us << " us"
+            << " | p99 " << std::setw(8) << summary.p99_us << " us" << std::endl;
+    }
+}
+
+void write_profile(const Profiler& profiler, const std::string& directory, bool trace)
+{
+    profiler.print_summary();
+    profiler.write_summary((std::filesystem::path(directory) / "profile.json").string());
+    if (trace)
+    {
+        profiler.write_trace((std::filesystem::path(directory) / "profile_trace.json").string());
+    }
+}
+
+ScopedTimer::ScopedTimer(Profiler* profiler, ProfileStage stage) : profiler(profiler), stage(stage)
+{
+    if (profiler != nullptr)
+    {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    if (profiler != nullptr)
+    {
+        profiler->record(stage, start, std::chrono::steady_clock::now());
+    }
+}
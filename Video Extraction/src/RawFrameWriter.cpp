@@ -0,0 +1,231 @@
+#include "../include/RawFrameWriter.hpp"
+
+static const char RAW_FRAME_MAGIC[4] = { 'K', '4', 'R', 'F' };
+
+std::string raw_frame_extension(RawCodec codec)
+{
+    switch (codec)
+    {
+    case RawCodec::Uncompressed:
+        return ".raw";
+    case RawCodec::Png:
+        return ".png";
+    case RawCodec::DeltaZstd:
+        return ".rawz";
+    }
+    return ".raw";
+}
+
+static void write_header(RawCodec codec, const cv::Mat& frame, std::vector<uchar>& buffer)
+{
+    RawFrameHeader header;
+    std::memcpy(header.magic, RAW_FRAME_MAGIC, sizeof(header.magic));
+    header.codec = (uint32_t)codec;
+    header.width = (uint32_t)frame.cols;
+    header.height = (uint32_t)frame.rows;
+    buffer.resize(sizeof(RawFrameHeader));
+    std::memcpy(buffer.data(), &header, sizeof(RawFrameHeader));
+}
+
+bool encode_raw_frame(const cv::Mat& frame, const RawCodecConfig& config, std::vector<uchar>& buffer)
+{
+    if (frame.type() != CV_16UC1)
+    {
+        std::cerr << "Raw frames must be CV_16UC1 matrices" << std::endl;
+        return false;
+    }
+
+    size_t row_bytes = frame.cols * sizeof(uint16_t);
+    size_t pixel_count = (size_t)frame.rows * frame.cols;
+
+    switch (config.codec)
+    {
+    case RawCodec::Uncompressed:
+    {
+        write_header(config.codec, frame, buffer);
+        buffer.resize(sizeof(RawFrameHeader) + pixel_count * sizeof(uint16_t));
+        uchar* pixels = buffer.data() + sizeof(RawFrameHeader);
+        for (int y = 0; y < frame.rows; y++)
+        {
+            std::memcpy(pixels + y * row_bytes, frame.ptr<uint16_t>(y), row_bytes);
+        }
+        return true;
+    }
+    case RawCodec::Png:
+    {
+        return cv::imencode(".png", frame, buffer, { cv::IMWRITE_PNG_COMPRESSION, config.png_compression });
+    }
+    case RawCodec::DeltaZstd:
+    {
+        // Neighbouring depth and IR values are close, so the difference to the previous pixel of the row is
+        // small. Storing the low and high bytes of the differences in separate planes leaves zstd with a
+        // plane that is almost constant.
+        std::vector<uint8_t> planes(pixel_count * 2);
+        uint8_t* low_bytes = planes.data();
+        uint8_t* high_bytes = planes.data() + pixel_count;
+        for (int y = 0, idx = 0; y < frame.rows; y++)
+        {
+            const uint16_t* row = frame.ptr<uint16_t>(y);
+            uint16_t previous = 0;
+            for (int x = 0; x < frame.cols; x++, idx++)
+            {
+                uint16_t delta = (uint16_t)(row[x] - previous);
+                previous = row[x];
+                low_bytes[idx] = (uint8_t)(delta & 0xFF);
+                high_bytes[idx] = (uint8_t)(delta >> 8);
+            }
+        }
+
+        write_header(config.codec, frame, buffer);
+        size_t bound = ZSTD_compressBound(planes.size());
+        buffer.resize(sizeof(RawFrameHeader) + bound);
+        size_t compressed_size = ZSTD_compress(buffer.data() + sizeof(RawFrameHeader), bound,
+            planes.data(), planes.size(), config.zstd_level);
+        if (ZSTD_isError(compressed_size))
+        {
+            std::cerr << "Failed to compress raw frame: " << ZSTD_getErrorName(compressed_size) << std::endl;
+            return false;
+        }
+        buffer.resize(sizeof(RawFrameHeader) + compressed_size);
+        return true;
+    }
+    }
+    return false;
+}
+
+cv::Mat decode_raw_frame(const std::vector<uchar>& buffer)
+{
+    RawFrameHeader header;
+    if (buffer.size() < sizeof(RawFrameHeader) ||
+        std::memcmp(buffer.data(), RAW_FRAME_MAGIC, sizeof(RAW_FRAME_MAGIC)) != 0)
+    {
+        // Not one of our headers, it must be a PNG
+        return cv::imdecode(buffer, cv::IMREAD_ANYDEPTH);
+    }
+    std::memcpy(&header, buffer.data(), sizeof(RawFrameHeader));
+
+    cv::Mat frame((int)header.height, (int)header.width, CV_16UC1);
+    size_t pixel_count = (size_t)header.width * header.height;
+    const uchar* payload = buffer.data() + sizeof(RawFrameHeader);
+    size_t payload_size = buffer.size() - sizeof(RawFrameHeader);
+
+    switch ((RawCodec)header.codec)
+    {
+    case RawCodec::Uncompressed:
+    {
+        if (payload_size != pixel_count * sizeof(uint16_t))
+        {
+            std::cerr << "Truncated raw frame" << std::endl;
+            return cv::Mat();
+        }
+        std::memcpy(frame.data, payload, payload_size);
+        return frame;
+    }
+    case RawCodec::DeltaZstd:
+    {
+        std::vector<uint8_t> planes(pixel_count * 2);
+        size_t size = ZSTD_decompress(planes.data(), planes.size(), payload, payload_size);
+        if (ZSTD_isError(size) || size != planes.size())
+        {
+            std::cerr << "Failed to decompress raw frame" << std::endl;
+            return cv::Mat();
+        }
+        const uint8_t* low_bytes = planes.data();
+        const uint8_t* high_bytes = planes.data() + pixel_count;
+        for (int y = 0, idx = 0; y < frame.rows; y++)
+        {
+            uint16_t* row = frame.ptr<uint16_t>(y);
+            uint16_t previous = 0;
+            for (int x = 0; x < frame.cols; x++, idx++)
+            {
+                previous = (uint16_t)(previous + (low_bytes[idx] | (high_bytes[idx] << 8)));
+                row[x] = previous;
+            }
+        }
+        return frame;
+    }
+    default:
+        std::cerr << "Unknown raw frame codec: " << header.codec << std::endl;
+        return cv::Mat();
+    }
+}
+
+bool write_raw_frame(const std::string& path, const cv::Mat& frame, const RawCodecConfig& config)
+{
+    std::vector<uchar> buffer;
+    if (!encode_raw_frame(frame, config, buffer))
+    {
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return false;
+    }
+    file.write((const char*)buffer.data(), (std::streamsize)buffer.size());
+    return file.good();
+}
+
+cv::Mat read_raw_frame(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file: " << path << std::endl;
+        return cv::Mat();
+    }
+    std::vector<uchar> buffer((size_t)file.tellg());
+    file.seekg(0);
+    file.read((char*)buffer.data(), (std::streamsize)buffer.size());
+    return decode_raw_frame(buffer);
+}
+
+// Print encode/decode speed and size of every codec for the given frame
+void benchmarkRawCodecs(const cv::Mat& frame, int iterations)
+{
+    struct Candidate
+    {
+        std::string name;
+        RawCodecConfig config;
+    };
+    std::vector<Candidate> candidates;
+    candidates.push_back({ "uncompressed", { RawCodec::Uncompressed } });
+    for (int level : { 1, 3, 6, 9 })
+    {
+        candidates.push_back({ "png level " + std::to_string(level), { RawCodec::Png, level } });
+    }
+    for (int level : { 1, 3, 9 })
+    {
+        candidates.push_back({ "delta + zstd level " + std::to_string(level), { RawCodec::DeltaZstd, 1, level } });
+    }
+
+    double frame_megabytes = frame.total() * frame.elemSize() / 1e6;
+    std::vector<uchar> buffer;
+    for (const Candidate& candidate : candidates)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            encode_raw_frame(frame, candidate.config, buffer);
+        }
+        auto middle = std::chrono::high_resolution_clock::now();
+        cv::Mat decoded;
+        for (int i = 0; i < iterations; i++)
+        {
+            decoded = decode_raw_frame(buffer);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double encode_seconds = std::chrono::duration<double>(middle - start).count();
+        double decode_seconds = std::chrono::duration<double>(end - middle).count();
+        bool lossless = !decoded.empty() && cv::norm(frame, decoded, cv::NORM_INF) == 0;
+
+        std::cout << std::setw(22) << candidate.name
+            << " | encode " << std::setw(8) << frame_megabytes * iterations / encode_seconds << " MB/s"
+            << " | decode " << std::setw(8) << frame_megabytes * iterations / decode_seconds << " MB/s"
+            << " | size " << std::setw(6) << 100.0 * buffer.size() / (frame_megabytes * 1e6) << " %"
+            << (lossless ? "" : " | NOT LOSSLESS") << std::endl;
+    }
+}
@@ -0,0 +1,488 @@
+#include "../include/Reprojection.hpp"
+
+// Rows of depth pixels handled by one stripe of the parallel splat
+static const int REPROJECTION_STRIPE_ROWS = 16;
+
+// Depth at which the footprints are measured. The footprint of a depth pixel barely changes with its depth, only
+// the translation along the optical axis, a few millimeters, moves it
+static const float REPROJECTION_FOOTPRINT_DEPTH_MM = 1000.f;
+
+// Empty color pixel of the depth buffer, farther than any depth
+static const uint32_t REPROJECTION_EMPTY = std::numeric_limits<uint32_t>::max();
+
+bool ReprojectionTable::usable() const
+{
+    return !valid.empty() && max_projection_error <= REPROJECTION_MAX_ERROR_PIXELS;
+}
+
+// Projects the color camera points of a row of depth pixels, the projection of transformation_project_internal
+// of the SDK. Without branches or selects on floats, which keep the compiler from vectorizing the loop unless
+// built with -fno-trapping-math, so the divisions run for every pixel. The pixels that land behind the camera,
+// beyond the metric radius or on a pole of the radial distortion get a zero ok, and their u and v are not read.
+// The outputs are restrict so the compiler does not have to check them against every table array
+static void project_row(const ReprojectionTable& table, size_t first, int count, const uint16_t* depth_row,
+    float* __restrict u, float* __restrict v, float* __restrict z, uint8_t* __restrict ok)
+{
+    const float* ray_x = table.ray_x.data() + first;
+    const float* ray_y = table.ray_y.data() + first;
+    const float* ray_z = table.ray_z.data() + first;
+    const uint8_t* valid = table.valid.data() + first;
+
+    const float tx = table.translation[0], ty = table.translation[1], tz = table.translation[2];
+    const float cx = table.cx, cy = table.cy, fx = table.fx, fy = table.fy;
+    const float k1 = table.k1, k2 = table.k2, k3 = table.k3, k4 = table.k4, k5 = table.k5, k6 = table.k6;
+    const float codx = table.codx, cody = table.cody, p1 = table.p1, p2 = table.p2;
+    const float tangential_scale = table.tangential_scale;
+    const float max_radius_squared = table.max_radius_squared;
+
+    for (int x = 0; x < count; x++)
+    {
+        float depth = (float)depth_row[x];
+        float px = depth * ray_x[x] + tx;
+        float py = depth * ray_y[x] + ty;
+        float pz = depth * ray_z[x] + tz;
+        float inv_z = 1.f / pz;
+
+        float xp = px * inv_z - codx;
+        float yp = py * inv_z - cody;
+        float xp2 = xp * xp;
+        float yp2 = yp * yp;
+        float xyp = xp * yp;
+        float rs = xp2 + yp2;
+        float rss = rs * rs;
+        float rsc = rss * rs;
+        float a = 1.f + k1 * rs + k2 * rss + k3 * rsc;
+        float b = 1.f + k4 * rs + k5 * rss + k6 * rsc;
+        float radial = a / b;
+
+        float xp_d = xp * radial + (rs + 2.f * xp2) * p2 + tangential_scale * xyp * p1;
+        float yp_d = yp * radial + (rs + 2.f * yp2) * p1 + tangential_scale * xyp * p2;
+
+        u[x] = (xp_d + codx) * fx + cx;
+        v[x] = (yp_d + cody) * fy + cy;
+        z[x] = pz;
+        ok[x] = (uint8_t)((depth_row[x] != 0) & valid[x] & (pz > 0.f) & (rs <= max_radius_squared) & (b != 0.f));
+    }
+}
+
+// Keeps the smaller of the depth buffer value and value. Depth sits in the upper 16 bits, so the nearest depth
+// pixel wins together with its IR value
+template <bool Atomic>
+static inline void store_nearest(uint32_t& cell, uint32_t value)
+{
+    if constexpr (Atomic)
+    {
+        std::atomic_ref<uint32_t> atomic_cell(cell);
+        uint32_t current = atomic_cell.load(std::memory_order_relaxed);
+        while (value < current && !atomic_cell.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+    else
+    {
+        cell = std::min(cell, value);
+    }
+}
+
+// Splats the depth rows [first_row, last_row) into the depth buffer. Stripes running in parallel can land on the
+// same color pixels and need Atomic
+template <bool Atomic>
+static void splat_rows(const ReprojectionTable& table, const uint16_t* depth_data, int depth_stride,
+    const uint16_t* ir_data, int ir_stride, int first_row, int last_row, uint32_t* depth_buffer)
+{
+    const int width = table.depth_width;
+    const float color_width = (float)table.color_width;
+    const float color_height = (float)table.color_height;
+    std::vector<float> u(width), v(width), z(width);
+    std::vector<uint8_t> ok(width);
+
+    for (int y = first_row; y < last_row; y++)
+    {
+        size_t first = (size_t)y * width;
+        const uint16_t* depth_row = depth_data + (size_t)y * depth_stride;
+        const uint16_t* ir_row = ir_data != nullptr ? ir_data + (size_t)y * ir_stride : nullptr;
+        project_row(table, first, width, depth_row, u.data(), v.data(), z.data(), ok.data());
+
+        for (int x = 0; x < width; x++)
+        {
+            if (!ok[x])
+            {
+                continue;
+            }
+
+            // The color pixels whose centers lie in the footprint
+            float half_width = table.half_width[first + x];
+            float half_height = table.half_height[first + x];
+            int x_begin = (int)std::clamp(std::ceil(u[x] - half_width), 0.f, color_width);
+            int x_end = (int)std::clamp(std::ceil(u[x] + half_width), 0.f, color_width);
+            int y_begin = (int)std::clamp(std::ceil(v[x] - half_height), 0.f, color_height);
+            int y_end = (int)std::clamp(std::ceil(v[x] + half_height), 0.f, color_height);
+
+            uint32_t depth = (uint32_t)std::min(z[x] + 0.5f, 65535.f);
+            uint32_t value = (depth << 16) | (ir_row != nullptr ? ir_row[x] : 0);
+            for (int color_y = y_begin; color_y < y_end; color_y++)
+            {
+                uint32_t* buffer_row = depth_buffer + (size_t)color_y * table.color_width;
+                for (int color_x = x_begin; color_x < x_end; color_x++)
+                {
+                    store_nearest<Atomic>(buffer_row[color_x], value);
+                }
+            }
+        }
+    }
+}
+
+ReprojectionTable create_reprojection_table(const k4a::calibration& calibration)
+{
+    const k4a_calibration_camera_t& color_calibration = calibration.color_camera_calibration;
+    const k4a_calibration_intrinsic_parameters_t& intrinsics = color_calibration.intrinsics.parameters;
+    const k4a_calibration_extrinsics_t& extrinsics =
+        calibration.extrinsics[K4A_CALIBRATION_TYPE_DEPTH][K4A_CALIBRATION_TYPE_COLOR];
+    std::shared_ptr<const XYTable> xy_table = get_xy_table(calibration, K4A_CALIBRATION_TYPE_DEPTH);
+
+    ReprojectionTable table;
+    table.depth_width = xy_table->width;
+    table.depth_height = xy_table->height;
+    table.color_width = color_calibration.resolution_width;
+    table.color_height = color_calibration.resolution_height;
+
+    table.cx = intrinsics.param.cx;
+    table.cy = intrinsics.param.cy;
+    table.fx = intrinsics.param.fx;
+    table.fy = intrinsics.param.fy;
+    table.k1 = intrinsics.param.k1;
+    table.k2 = intrinsics.param.k2;
+    table.k3 = intrinsics.param.k3;
+    table.k4 = intrinsics.param.k4;
+    table.k5 = intrinsics.param.k5;
+    table.k6 = intrinsics.param.k6;
+    table.codx = intrinsics.param.codx;
+    table.cody = intrinsics.param.cody;
+    table.p1 = intrinsics.param.p1;
+    table.p2 = intrinsics.param.p2;
+    table.tangential_scale =
+        color_calibration.intrinsics.type == K4A_CALIBRATION_LENS_DISTORTION_MODEL_RATIONAL_6KT ? 1.f : 2.f;
+    if (color_calibration.metric_radius > 0.f)
+    {
+        table.max_radius_squared = color_calibration.metric_radius * color_calibration.metric_radius;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        table.translation[i] = extrinsics.translation[i];
+    }
+
+    const float* rotation = extrinsics.rotation;
+    size_t pixel_count = (size_t)table.depth_width * table.depth_height;
+    table.ray_x.resize(pixel_count);
+    table.ray_y.resize(pixel_count);
+    table.ray_z.resize(pixel_count);
+    table.half_width.resize(pixel_count);
+    table.half_height.resize(pixel_count);
+    table.valid = xy_table->valid;
+    for (size_t idx = 0; idx < pixel_count; idx++)
+    {
+        float x = xy_table->x[idx];
+        float y = xy_table->y[idx];
+        table.ray_x[idx] = rotation[0] * x + rotation[1] * y + rotation[2];
+        table.ray_y[idx] = rotation[3] * x + rotation[4] * y + rotation[5];
+        table.ray_z[idx] = rotation[6] * x + rotation[7] * y + rotation[8];
+    }
+
+    // The footprint is the bounding box of the depth pixel mapped by the derivatives of its projection, taken from
+    // the projections of its neighbors. Pixels without a valid neighbor on an axis fall back to the ratio of the
+    // focal lengths
+    std::vector<float> u(pixel_count), v(pixel_count), z(pixel_count);
+    std::vector<uint8_t> ok(pixel_count);
+    std::vector<uint16_t> footprint_depth(table.depth_width, (uint16_t)REPROJECTION_FOOTPRINT_DEPTH_MM);
+    for (int y = 0; y < table.depth_height; y++)
+    {
+        size_t first = (size_t)y * table.depth_width;
+        project_row(table, first, table.depth_width, footprint_depth.data(), u.data() + first, v.data() + first,
+            z.data() + first, ok.data() + first);
+    }
+
+    const k4a_calibration_intrinsic_parameters_t& depth_intrinsics =
+        calibration.depth_camera_calibration.intrinsics.parameters;
+    float scale_x = depth_intrinsics.param.fx != 0.f ? table.fx / depth_intrinsics.param.fx : 1.f;
+    float scale_y = depth_intrinsics.param.fy != 0.f ? table.fy / depth_intrinsics.param.fy : 1.f;
+
+    // Derivative of u and v along one axis, from the neighbors at offset -step and +step
+    auto derivative = [&](size_t idx, bool has_previous, bool has_next, size_t step, float& du, float& dv) {
+        bool previous = has_previous && ok[idx - step];
+        bool next = has_next && ok[idx + step];
+        if (!previous && !next)
+        {
+            return false;
+        }
+        size_t from = previous ? idx - step : idx;
+        size_t to = next ? idx + step : idx;
+        float distance = (float)(previous + next);
+        du = (u[to] - u[from]) / distance;
+        dv = (v[to] - v[from]) / distance;
+        return true;
+    };
+
+    for (int y = 0; y < table.depth_height; y++)
+    {
+        for (int x = 0; x < table.depth_width; x++)
+        {
+            size_t idx = (size_t)y * table.depth_width + x;
+            float du_dx = scale_x, dv_dx = 0.f;
+            float du_dy = 0.f, dv_dy = scale_y;
+            if (ok[idx])
+            {
+                derivative(idx, x > 0, x + 1 < table.depth_width, 1, du_dx, dv_dx);
+                derivative(idx, y > 0, y + 1 < table.depth_height, table.depth_width, du_dy, dv_dy);
+            }
+            table.half_width[idx] = 0.5f * (std::abs(du_dx) + std::abs(du_dy));
+            table.half_height[idx] = 0.5f * (std::abs(dv_dx) + std::abs(dv_dy));
+        }
+    }
+
+    // Check the projection against the SDK on a grid of depth pixels, near, in the middle and far
+    bool supported_model =
+        color_calibration.intrinsics.type == K4A_CALIBRATION_LENS_DISTORTION_MODEL_BROWN_CONRADY ||
+        color_calibration.intrinsics.type == K4A_CALIBRATION_LENS_DISTORTION_MODEL_RATIONAL_6KT;
+    table.max_projection_error = supported_model ? 0.f : std::numeric_limits<float>::infinity();
+    for (uint16_t depth : { (uint16_t)500, (uint16_t)1500, (uint16_t)4000 })
+    {
+        for (int y = 0; y < table.depth_height && supported_model; y += 8)
+        {
+            size_t first = (size_t)y * table.depth_width;
+            std::vector<uint16_t> depth_row(table.depth_width, depth);
+            project_row(table, first, table.depth_width, depth_row.data(), u.data(), v.data(), z.data(), ok.data());
+            for (int x = 0; x < table.depth_width; x += 8)
+            {
+                k4a_float3_t point;
+                point.xyz.x = xy_table->x[first + x] * depth;
+                point.xyz.y = xy_table->y[first + x] * depth;
+                point.xyz.z = depth;
+                k4a_float2_t pixel;
+                if (!ok[x] || !calibration.convert_3d_to_2d(point, K4A_CALIBRATION_TYPE_DEPTH,
+                    K4A_CALIBRATION_TYPE_COLOR, &pixel))
+                {
+                    continue;
+                }
+                float error = std::hypot(u[x] - pixel.xy.x, v[x] - pixel.xy.y);
+                table.max_projection_error = std::max(table.max_projection_error, error);
+            }
+        }
+    }
+
+    return table;
+}
+
+std::shared_ptr<const ReprojectionTable> get_reprojection_table(const k4a::calibration& calibration)
+{
+    static std::mutex cache_mutex;
+    static std::map<std::string, std::shared_ptr<const ReprojectionTable>> cache;
+
+    // Both cameras and the extrinsics between them identify the table
+    std::string key((const char*)&calibration.depth_camera_calibration, sizeof(k4a_calibration_camera_t));
+    key.append((const char*)&calibration.color_camera_calibration, sizeof(k4a_calibration_camera_t));
+    key.append((const char*)&calibration.extrinsics[K4A_CALIBRATION_TYPE_DEPTH][K4A_CALIBRATION_TYPE_COLOR],
+        sizeof(k4a_calibration_extrinsics_t));
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(key);
+    if (it == cache.end())
+    {
+        it = cache.emplace(key, std::make_shared<const ReprojectionTable>(create_reprojection_table(calibration))).first;
+    }
+    return it->second;
+}
+
+bool reproject_depth_and_ir(
+    const ReprojectionTable& table,
+    const k4a::image& depth_image,
+    const k4a::image& ir_image,
+    FramePool& pool,
+    k4a::image& transformed_depth_image,
+    k4a::image& transformed_ir_image,
+    bool parallel)
+{
+    if (depth_image.get_width_pixels() != table.depth_width || depth_image.get_height_pixels() != table.depth_height ||
+        (ir_image.is_valid() && (ir_image.get_width_pixels() != table.depth_width ||
+            ir_image.get_height_pixels() != table.depth_height)))
+    {
+        std::cerr << "Depth image and reprojection table have different resolutions" << std::endl;
+        return false;
+    }
+
+    const uint16_t* depth_data = (const uint16_t*)(const void*)depth_image.get_buffer();
+    int depth_stride = depth_image.get_stride_bytes() / (int)sizeof(uint16_t);
+    const uint16_t* ir_data = ir_image.is_valid() ? (const uint16_t*)(const void*)ir_image.get_buffer() : nullptr;
+    int ir_stride = ir_image.is_valid() ? ir_image.get_stride_bytes() / (int)sizeof(uint16_t) : 0;
+
+    // Depth and IR of the nearest depth pixel of every color pixel, reused by the frames of the thread
+    thread_local std::vector<uint32_t> depth_buffer;
+    size_t color_pixel_count = (size_t)table.color_width * table.color_height;
+    depth_buffer.assign(color_pixel_count, REPROJECTION_EMPTY);
+    uint32_t* buffer = depth_buffer.data();
+
+    if (parallel)
+    {
+        int stripe_count = (table.depth_height + REPROJECTION_STRIPE_ROWS - 1) / REPROJECTION_STRIPE_ROWS;
+        cv::parallel_for_(cv::Range(0, stripe_count), [&](const cv::Range& stripes) {
+            splat_rows<true>(table, depth_data, depth_stride, ir_data, ir_stride,
+                stripes.start * REPROJECTION_STRIPE_ROWS,
+                std::min(table.depth_height, stripes.end * REPROJECTION_STRIPE_ROWS), buffer);
+        });
+    }
+    else
+    {
+        splat_rows<false>(table, depth_data, depth_stride, ir_data, ir_stride, 0, table.depth_height, buffer);
+    }
+
+    int stride_bytes = table.color_width * (int)sizeof(uint16_t);
+    transformed_depth_image = pool.create_image(K4A_IMAGE_FORMAT_DEPTH16, table.color_width, table.color_height,
+        stride_bytes);
+    uint16_t* depth_output = (uint16_t*)(void*)transformed_depth_image.get_buffer();
+    if (ir_data != nullptr)
+    {
+        transformed_ir_image = pool.create_image(K4A_IMAGE_FORMAT_CUSTOM16, table.color_width, table.color_height,
+            stride_bytes);
+        uint16_t* ir_output = (uint16_t*)(void*)transformed_ir_image.get_buffer();
+        for (size_t i = 0; i < color_pixel_count; i++)
+        {
+            uint32_t value = buffer[i] != REPROJECTION_EMPTY ? buffer[i] : 0;
+            depth_output[i] = (uint16_t)(value >> 16);
+            ir_output[i] = (uint16_t)(value & 0xFFFF);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < color_pixel_count; i++)
+        {
+            depth_output[i] = (uint16_t)(buffer[i] != REPROJECTION_EMPTY ? buffer[i] >> 16 : 0);
+        }
+    }
+
+    return true;
+}
+
+// Bilinear color samples of the projections of a row, Channels bytes per pixel
+template <int Channels>
+static void sample_row(const cv::Mat& color_image, int count, const float* u, const float* v, const uint8_t* ok,
+    uint8_t* output_row)
+{
+    const float max_x = (float)(color_image.cols - 1);
+    const float max_y = (float)(color_image.rows - 1);
+    for (int x = 0; x < count; x++)
+    {
+        uint8_t* pixel = output_row + x * Channels;
+        if (!ok[x] || !(u[x] >= 0.f && u[x] <= max_x && v[x] >= 0.f && v[x] <= max_y))
+        {
+            std::fill(pixel, pixel + Channels, (uint8_t)0);
+            continue;
+        }
+
+        int x0 = std::min((int)u[x], color_image.cols - 2);
+        int y0 = std::min((int)v[x], color_image.rows - 2);
+        float ax = u[x] - (float)x0;
+        float ay = v[x] - (float)y0;
+        const uint8_t* top = color_image.ptr<uint8_t>(y0) + x0 * Channels;
+        const uint8_t* bottom = color_image.ptr<uint8_t>(y0 + 1) + x0 * Channels;
+        for (int c = 0; c < Channels; c++)
+        {
+            float upper = top[c] + ax * (top[c + Channels] - top[c]);
+            float lower = bottom[c] + ax * (bottom[c + Channels] - bottom[c]);
+            pixel[c] = (uint8_t)(upper + ay * (lower - upper) + 0.5f);
+        }
+    }
+}
+
+cv::Mat reproject_color(
+    const ReprojectionTable& table,
+    const k4a::image& depth_image,
+    const cv::Mat& color_image,
+    FramePool& pool,
+    k4a::image& backing)
+{
+    if (depth_image.get_width_pixels() != table.depth_width || depth_image.get_height_pixels() != table.depth_height ||
+        color_image.cols != table.color_width || color_image.rows != table.color_height ||
+        (color_image.type() != CV_8UC3 && color_image.type() != CV_8UC4))
+    {
+        return cv::Mat();
+    }
+
+    const uint16_t* depth_data = (const uint16_t*)(const void*)depth_image.get_buffer();
+    int depth_stride = depth_image.get_stride_bytes() / (int)sizeof(uint16_t);
+    cv::Mat output = pool.create_mat(table.depth_height, table.depth_width, color_image.type(), backing);
+
+    int width = table.depth_width;
+    std::vector<float> u(width), v(width), z(width);
+    std::vector<uint8_t> ok(width);
+    for (int y = 0; y < table.depth_height; y++)
+    {
+        project_row(table, (size_t)y * width, width, depth_data + (size_t)y * depth_stride, u.data(), v.data(),
+            z.data(), ok.data());
+        if (color_image.channels() == 3)
+        {
+            sample_row<3>(color_image, width, u.data(), v.data(), ok.data(), output.ptr<uint8_t>(y));
+        }
+        else
+        {
+            sample_row<4>(color_image, width, u.data(), v.data(), ok.data(), output.ptr<uint8_t>(y));
+        }
+    }
+
+    return output;
+}
+
+void benchmarkReprojection(const k4a::calibration& calibration, const k4a::capture& capture, int iterations)
+{
+    k4a::image depth_image = capture.get_depth_image();
+    k4a::image ir_image = capture.get_ir_image();
+    if (!depth_image.is_valid() || !ir_image.is_valid())
+    {
+        std::cerr << "The benchmark needs a capture with depth and IR images" << std::endl;
+        return;
+    }
+
+    auto build_start = std::chrono::high_resolution_clock::now();
+    ReprojectionTable table = create_reprojection_table(calibration);
+    auto build_end = std::chrono::high_resolution_clock::now();
+    std::cout << "Reprojection table built in " << std::chrono::duration<double, std::milli>(build_end - build_start).count()
+        << " ms, projection error against convert_3d_to_2d " << table.max_projection_error << " pixels" << std::endl;
+
+    int width = table.color_width;
+    int height = table.color_height;
+    k4a::transformation transformation(calibration);
+    FramePool pool;
+    k4a::image sdk_depth_image;
+    k4a::image table_depth_image;
+    k4a::image transformed_ir_image;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        transform_depth_and_ir(transformation, depth_image, ir_image, width, height, pool,
+            sdk_depth_image, transformed_ir_image);
+    }
+    auto middle = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        reproject_depth_and_ir(table, depth_image, ir_image, pool, table_depth_image, transformed_ir_image, false);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double sdk_ms = std::chrono::duration<double, std::milli>(middle - start).count() / iterations;
+    double table_ms = std::chrono::duration<double, std::milli>(end - middle).count() / iterations;
+
+    cv::Mat sdk_depth(height, width, CV_16UC1, sdk_depth_image.get_buffer());
+    cv::Mat table_depth(height, width, CV_16UC1, table_depth_image.get_buffer());
+    cv::Mat both = (sdk_depth != 0) & (table_depth != 0);
+    int only_sdk = cv::countNonZero((sdk_depth != 0) & (table_depth == 0));
+    int only_table = cv::countNonZero((table_depth != 0) & (sdk_depth == 0));
+    cv::Mat difference;
+    cv::absdiff(sdk_depth, table_depth, difference);
+    double mean_difference = cv::mean(difference, both)[0];
+
+    std::cout << width << "x" << height << " color: SDK " << sdk_ms << " ms/frame, table " << table_ms
+        << " ms/frame (" << 100.0 * (1.0 - table_ms / sdk_ms) << "% saved), " << only_sdk
+        << " pixels only filled by the SDK, " << only_table << " only by the table, mean depth difference "
+        << mean_difference << " mm over " << cv::countNonZero(both) << " pixels" << std::endl;
+
+    transformation.destroy();
+}
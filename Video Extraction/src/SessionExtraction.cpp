@@ -0,0 +1,244 @@
+#include "../include/SessionExtraction.hpp"
+
+namespace fs = std::filesystem;
+
+// Device timestamp of the color image, or of the depth image for captures without color
+static int64_t capture_timestamp(const k4a::capture& capture)
+{
+    k4a::image image = capture.get_color_image();
+    if (!image)
+    {
+        image = capture.get_depth_image();
+    }
+    return image ? image.get_device_timestamp().count() : 0;
+}
+
+// Extract the recordings of a session, one folder per device
+int sessionExtraction(const std::vector<std::string>& input_paths, const std::string& base_path,
+    const PipelineConfig& config) {
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<k4a::playback> playbacks;
+    std::vector<std::string> paths;
+    if (!open_session_recordings(input_paths, playbacks, paths)) {
+        return 1;
+    }
+    size_t num_devices = playbacks.size();
+
+    if (!fs::create_directories(base_path)) {
+        std::cerr << "Error creating directory: " << base_path << std::endl;
+        return 1;
+    }
+
+    std::string index_path = (fs::path(base_path) / "sync_index.csv").string();
+    std::ofstream index_file(index_path);
+    if (!index_file.is_open()) {
+        std::cerr << "Error opening file: " << index_path << std::endl;
+        return 1;
+    }
+    index_file << "set";
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        index_file << "," << i << "_color_timestamp," << i << "_depth_timestamp," << i << "_error_usec";
+    }
+    index_file << std::endl;
+
+    // One pipeline per device with the calibration of its recording, all sharing one set of resources
+    PipelineConfig pipeline_config = config;
+    pipeline_config.show_progress = false;
+    SharedPipelineResources shared;
+    if (!open_shared_resources(config, shared))
+    {
+        return 1;
+    }
+    const PipelineResources& resources = shared.resources;
+
+    std::vector<std::unique_ptr<ExtractionPipeline>> pipelines;
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        OutputLayout layout(get_device_output_path(base_path, i));
+        std::string device_path = layout.base.string();
+        if (!create_output_directories(layout)) {
+            return 1;
+        }
+        pipelines.push_back(std::make_unique<ExtractionPipeline>(playbacks[i].get_calibration(), device_path,
+            pipeline_config, 0.0, resources));
+        if (!pipelines.back()->is_open()) {
+            std::cerr << "Error opening timestamp files in: " << device_path << std::endl;
+            return 1;
+        }
+        std::cout << i << ": " << paths[i] << std::endl;
+    }
+
+    // Every recording is read by its own thread. Unlike the live capture nothing may be dropped, so a reader
+    // waits while its queue is full
+    std::vector<std::unique_ptr<BoundedQueue<k4a::capture>>> queues;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        queues.push_back(std::make_unique<BoundedQueue<k4a::capture>>(SESSION_READ_AHEAD));
+    }
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        readers.emplace_back([&playbacks, &queues, &resources, i] {
+            k4a::capture capture;
+            auto next_capture = [&] {
+                ScopedTimer timer(resources.profiler, ProfileStage::CaptureRead);
+                return playbacks[i].get_next_capture(&capture);
+            };
+            while (next_capture())
+            {
+                if (!queues[i]->push(std::move(capture)))
+                {
+                    break;
+                }
+                capture.reset();
+            }
+            queues[i]->close();
+        });
+    }
+
+    // The IMU samples of every recording are read with handles of their own while the captures are extracted
+    std::vector<std::string> imu_paths;
+    std::vector<std::thread> imu_threads;
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        imu_paths.push_back(OutputLayout(get_device_output_path(base_path, i)).imu(imu_extension(config.imu.format)).string());
+        if (config.imu.enabled && config.imu.thread)
+        {
+            // The paths are copied, imu_paths grows while the earlier threads run
+            imu_threads.emplace_back([path = paths[i], imu_path = imu_paths.back(), format = config.imu.format] {
+                try
+                {
+                    extract_imu(path, imu_path, format);
+                }
+                catch (const k4a::error& e)
+                {
+                    std::cerr << "Error reading the IMU samples of " << path << ": " << e.what() << std::endl;
+                }
+            });
+        }
+    }
+
+    // The captures enter the synchronizer in the order the devices took them, the master's color image being
+    // the reference and every subordinate delayed by its offset
+    std::vector<int64_t> offsets = recording_offsets(playbacks, false);
+    CaptureSynchronizer synchronizer(offsets);
+
+    std::vector<k4a::capture> next_captures(num_devices);
+    std::vector<bool> has_capture(num_devices);
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        has_capture[i] = queues[i]->pop(next_captures[i]);
+    }
+
+    double recording_length = (double)playbacks[0].get_recording_length().count();
+    int64_t first_timestamp = -1;
+    uint64_t set_index = 0;
+    SynchronizedSet set;
+    while (true)
+    {
+        int next_device = -1;
+        int64_t next_time = 0;
+        for (size_t i = 0; i < num_devices; i++)
+        {
+            if (!has_capture[i])
+            {
+                continue;
+            }
+            int64_t time = capture_timestamp(next_captures[i]) - (i == 0 ? 0 : offsets[i - 1]);
+            if (next_device < 0 || time < next_time)
+            {
+                next_device = (int)i;
+                next_time = time;
+            }
+        }
+        if (next_device < 0)
+        {
+            break;
+        }
+
+        auto next_set = [&] {
+            ScopedTimer timer(resources.profiler, ProfileStage::SyncMatch);
+            return synchronizer.pop_synchronized_set(set);
+        };
+        {
+            ScopedTimer timer(resources.profiler, ProfileStage::SyncMatch);
+            synchronizer.add_capture(next_device, std::move(next_captures[next_device]));
+        }
+        next_captures[next_device].reset();
+        has_capture[next_device] = queues[next_device]->pop(next_captures[next_device]);
+
+        while (next_set())
+        {
+            index_file << set_index++;
+            for (size_t i = 0; i < num_devices; i++)
+            {
+                k4a::image depth_image = set.captures[i].get_depth_image();
+                index_file << "," << set.timestamps_usec[i] << ","
+                    << (depth_image ? depth_image.get_device_timestamp().count() : 0) << "," << set.errors_usec[i];
+                depth_image.reset();
+
+                pipelines[i]->push(set.captures[i]);
+                set.captures[i].reset();
+            }
+            index_file << "\n";
+
+            if (config.show_progress && recording_length > 0)
+            {
+                if (first_timestamp < 0)
+                {
+                    first_timestamp = set.timestamps_usec[0];
+                }
+                printProgress(std::min(1.0, (set.timestamps_usec[0] - first_timestamp) / recording_length));
+            }
+        }
+    }
+
+    for (std::thread& reader : readers)
+    {
+        reader.join();
+    }
+    for (std::unique_ptr<ExtractionPipeline>& pipeline : pipelines)
+    {
+        pipeline->finish();
+    }
+    index_file.close();
+
+    for (std::thread& imu_thread : imu_threads)
+    {
+        imu_thread.join();
+    }
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        if (config.imu.enabled && !config.imu.thread)
+        {
+            extract_imu(playbacks[i], imu_paths[i], config.imu.format);
+        }
+        playbacks[i].close();
+    }
+
+    SynchronizerStats sync_stats = synchronizer.get_stats();
+    std::cout << std::endl << "Synchronized sets: " << sync_stats.sets << ", frame yield "
+        << 100.0 * sync_stats.frame_yield() << "%" << std::endl;
+    for (size_t i = 0; i < num_devices; i++)
+    {
+        ExtractionStats stats = pipelines[i]->get_stats();
+        std::cout << "Device " << i << ": " << stats.frames << " frames written, "
+            << sync_stats.captures[i] << " read, " << sync_stats.discarded[i] << " unmatched, "
+            << "mean sync error " << sync_stats.mean_abs_error_usec[i] << " us, "
+            << "max " << sync_stats.max_abs_error_usec[i] << " us" << std::endl;
+    }
+
+    if (shared.profiler)
+    {
+        write_profile(*shared.profiler, base_path, config.profile.trace);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;
+    std::cout << base_path + " concluded in " << duration.count() << " seconds." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include "../include/SyntheticCapture.hpp"
+
+void get_color_resolution_size(k4a_color_resolution_t resolution, int& width, int& height)
+{
+    switch (resolution)
+    {
+    case K4A_COLOR_RESOLUTION_720P:
+        width = 1280; height = 720;
+        break;
+    case K4A_COLOR_RESOLUTION_1080P:
+        width = 1920; height = 1080;
+        break;
+    case K4A_COLOR_RESOLUTION_1440P:
+        width = 2560; height = 1440;
+        break;
+    case K4A_COLOR_RESOLUTION_1536P:
+        width = 2048; height = 1536;
+        break;
+    case K4A_COLOR_RESOLUTION_2160P:
+        width = 3840; height = 2160;
+        break;
+    case K4A_COLOR_RESOLUTION_3072P:
+        width = 4096; height = 3072;
+        break;
+    default:
+        width = 0; height = 0;
+        break;
+    }
+}
+
+void get_depth_mode_size(k4a_depth_mode_t depth_mode, int& width, int& height)
+{
+    switch (depth_mode)
+    {
+    case K4A_DEPTH_MODE_NFOV_2X2BINNED:
+        width = 320; height = 288;
+        break;
+    case K4A_DEPTH_MODE_NFOV_UNBINNED:
+        width = 640; height = 576;
+        break;
+    case K4A_DEPTH_MODE_WFOV_2X2BINNED:
+        width = 512; height = 512;
+        break;
+    case K4A_DEPTH_MODE_WFOV_UNBINNED:
+    case K4A_DEPTH_MODE_PASSIVE_IR:
+        width = 1024; height = 1024;
+        break;
+    default:
+        width = 0; height = 0;
+        break;
+    }
+}
+
+std::chrono::microseconds get_frame_period(k4a_fps_t camera_fps)
+{
+    switch (camera_fps)
+    {
+    case K4A_FRAMES_PER_SECOND_5:
+        return std::chrono::microseconds{ 200000 };
+    case K4A_FRAMES_PER_SECOND_15:
+        return std::chrono::microseconds{ 66667 };
+    default:
+        return std::chrono::microseconds{ 33333 };
+    }
+}
+
+static void set_pinhole_camera(k4a_calibration_camera_t& camera, int width, int height, float focal_length)
+{
+    camera.resolution_width = width;
+    camera.resolution_height = height;
+    camera.metric_radius = 1.7f;
+    camera.intrinsics.type = K4A_CALIBRATION_LENS_DISTORTION_MODEL_BROWN_CONRADY;
+    camera.intrinsics.parameter_count = 14;
+    std::memset(&camera.intrinsics.parameters, 0, sizeof(camera.intrinsics.parameters));
+    camera.intrinsics.parameters.param.cx = width / 2.0f;
+    camera.intrinsics.parameters.param.cy = height / 2.0f;
+    camera.intrinsics.parameters.param.fx = focal_length;
+    camera.intrinsics.parameters.param.fy = focal_length;
+    camera.intrinsics.parameters.param.metric_radius = 1.7f;
+}
+
+static k4a_calibration_extrinsics_t translation_extrinsics(float x)
+{
+    k4a_calibration_extrinsics_t extrinsics{};
+    extrinsics.rotation[0] = extrinsics.rotation[4] = extrinsics.rotation[8] = 1.0f;
+    extrinsics.translation[0] = x;
+    return extrinsics;
+}
+
+k4a::calibration create_synthetic_calibration(k4a_depth_mode_t depth_mode, k4a_color_resolution_t color_resolution)
+{
+    k4a::calibration calibration;
+    std::memset(static_cast<k4a_calibration_t*>(&calibration), 0, sizeof(k4a_calibration_t));
+    calibration.depth_mode = depth_mode;
+    calibration.color_resolution = color_resolution;
+
+    // The depth sensor has the same pixel pitch in every mode, the binned modes halve it. The color camera has a
+    // horizontal field of view of about 90 degrees
+    int depth_width, depth_height, color_width, color_height;
+    get_depth_mode_size(depth_mode, depth_width, depth_height);
+    get_color_resolution_size(color_resolution, color_width, color_height);
+    bool binned = depth_mode == K4A_DEPTH_MODE_NFOV_2X2BINNED || depth_mode == K4A_DEPTH_MODE_WFOV_2X2BINNED;
+    set_pinhole_camera(calibration.depth_camera_calibration, depth_width, depth_height, binned ? 252.0f : 504.0f);
+    set_pinhole_camera(calibration.color_camera_calibration, color_width, color_height, 0.4755f * color_width);
+
+    // Millimeters, points in the depth camera are 32 mm to the left in the color camera
+    for (int source = 0; source < K4A_CALIBRATION_TYPE_NUM; source++)
+    {
+        for (int target = 0; target < K4A_CALIBRATION_TYPE_NUM; target++)
+        {
+            float x = 0.0f;
+            if (source != K4A_CALIBRATION_TYPE_COLOR && target == K4A_CALIBRATION_TYPE_COLOR)
+            {
+                x = -32.0f;
+            }
+            else if (source == K4A_CALIBRATION_TYPE_COLOR && target != K4A_CALIBRATION_TYPE_COLOR)
+            {
+                x = 32.0f;
+            }
+            calibration.extrinsics[source][target] = translation_extrinsics(x);
+        }
+    }
+    calibration.depth_camera_calibration.extrinsics = calibration.extrinsics[K4A_CALIBRATION_TYPE_DEPTH][K4A_CALIBRATION_TYPE_DEPTH];
+    calibration.color_camera_calibration.extrinsics = calibration.extrinsics[K4A_CALIBRATION_TYPE_DEPTH][K4A_CALIBRATION_TYPE_COLOR];
+    return calibration;
+}
+
+// Millimeters along the ray (a, b, 1) to a sphere, 0 if it misses
+static float ray_sphere_depth(float a, float b, float center_x, float center_z, float radius)
+{
+    // |t (a, b, 1) - c|^2 = r^2 with c = (center_x, 0, center_z)
+    float dd = a * a + b * b + 1.0f;
+    float dc = a * center_x + center_z;
+    float cc = center_x * center_x + center_z * center_z - radius * radius;
+    float discriminant = dc * dc - dd * cc;
+    if (discriminant < 0.0f)
+    {
+        return 0.0f;
+    }
+    return (dc - std::sqrt(discriminant)) / dd;
+}
+
+SyntheticCaptureGenerator::SyntheticCaptureGenerator(const SyntheticCaptureConfig& config)
+    : config(config),
+    calibration(create_synthetic_calibration(config.depth_mode, config.color_resolution)),
+    frame_period(get_frame_period(config.camera_fps))
+{
+    get_color_resolution_size(config.color_resolution, color_width, color_height);
+    get_depth_mode_size(config.depth_mode, depth_width, depth_height);
+
+    const k4a_calibration_intrinsic_parameters_t& depth_intrinsics =
+        calibration.depth_camera_calibration.intrinsics.parameters;
+    const k4a_calibration_intrinsic_parameters_t& color_intrinsics =
+        calibration.color_camera_calibration.intrinsics.parameters;
+    float sphere_radius = 300.0f;
+    float sphere_z = 1500.0f;
+
+    // Pixels further from the center than this, in normalized coordinates, are invalid like the corners of NFOV
+    float max_a = depth_width / 2.0f / depth_intrinsics.param.fx;
+    float valid_radius = 0.9f * max_a;
+
+    for (size_t s = 0; s < SYNTHETIC_SCENE_COUNT; s++)
+    {
+        Scene scene;
+        float sphere_x = -400.0f + 800.0f * s / (SYNTHETIC_SCENE_COUNT - 1);
+
+        scene.depth.resize((size_t)depth_width * depth_height);
+        scene.ir.resize((size_t)depth_width * depth_height);
+        for (int v = 0; v < depth_height; v++)
+        {
+            float b = (v - depth_intrinsics.param.cy) / depth_intrinsics.param.fy;
+            for (int u = 0; u < depth_width; u++)
+            {
+                float a = (u - depth_intrinsics.param.cx) / depth_intrinsics.param.fx;
+                size_t i = (size_t)v * depth_width + u;
+                if (a * a + b * b > valid_radius * valid_radius)
+                {
+                    scene.depth[i] = 0;
+                    scene.ir[i] = 0;
+                    continue;
+                }
+
+                // Wall 2.5 m away, 600 mm further at the bottom than at the top
+                float depth = 2500.0f + 600.0f * ((float)v / depth_height - 0.5f);
+                float sphere_depth = ray_sphere_depth(a, b, sphere_x, sphere_z, sphere_radius);
+                if (sphere_depth > 0.0f && sphere_depth < depth)
+                {
+                    depth = sphere_depth;
+                }
+                scene.depth[i] = (uint16_t)depth;
+                scene.ir[i] = (uint16_t)std::min(1000.0f, 600.0f * (1500.0f / depth) * (1500.0f / depth) + (u ^ v) % 16);
+            }
+        }
+
+        // Gradient with noise, so the JPEGs are about as large as camera images, and the sphere
+        cv::Mat color(color_height, color_width, CV_8UC3);
+        for (int v = 0; v < color_height; v++)
+        {
+            cv::Vec3b* row = color.ptr<cv::Vec3b>(v);
+            for (int u = 0; u < color_width; u++)
+            {
+                row[u] = cv::Vec3b((uchar)(255 * u / color_width), (uchar)(255 * v / color_height), 128);
+            }
+        }
+        cv::Mat noise(color_height, color_width, CV_8UC3);
+        cv::theRNG().state = s + 1;
+        cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(24));
+        color += noise;
+        cv::Point center((int)(color_intrinsics.param.cx + color_intrinsics.param.fx * (sphere_x - 32.0f) / sphere_z),
+            (int)color_intrinsics.param.cy);
+        cv::circle(color, center, (int)(color_intrinsics.param.fx * sphere_radius / sphere_z), cv::Scalar(40, 60, 200), cv::FILLED);
+
+        if (config.color_format == K4A_IMAGE_FORMAT_COLOR_MJPG)
+        {
+            std::vector<uchar> jpeg;
+            cv::imencode(".jpg", color, jpeg, { cv::IMWRITE_JPEG_QUALITY, config.jpeg_quality });
+            scene.color.assign(jpeg.begin(), jpeg.end());
+        }
+        else
+        {
+            cv::Mat bgra;
+            cv::cvtColor(color, bgra, cv::COLOR_BGR2BGRA);
+            scene.color.assign(bgra.data, bgra.data + bgra.total() * bgra.elemSize());
+        }
+        scenes.push_back(std::move(scene));
+    }
+}
+
+const k4a::calibration& SyntheticCaptureGenerator::get_calibration() const
+{
+    return calibration;
+}
+
+const SyntheticCaptureConfig& SyntheticCaptureGenerator::get_config() const
+{
+    return config;
+}
+
+uint64_t SyntheticCaptureGenerator::get_frame_count() const
+{
+    return frame_count;
+}
+
+// New image owning a copy of the data
+static k4a::image copy_image(k4a_image_format_t format, int width, int height, int stride, const void* data,
+    size_t size, std::chrono::microseconds timestamp)
+{
+    uint8_t* buffer = new uint8_t[size];
+    std::memcpy(buffer, data, size);
+    k4a::image image = k4a::image::create_from_buffer(format, width, height, stride, buffer, size,
+        [](void* buffer, void*) { delete[] (uint8_t*)buffer; }, nullptr);
+    image.set_timestamp(timestamp);
+    return image;
+}
+
+k4a::capture SyntheticCaptureGenerator::next_capture()
+{
+    const Scene& scene = scenes[frame_count % scenes.size()];
+
+    std::chrono::microseconds timestamp = config.start_timestamp + frame_count * frame_period;
+    std::chrono::microseconds depth_timestamp = timestamp + std::chrono::microseconds{ config.depth_delay_off_color_usec };
+    frame_count++;
+
+    int color_stride = config.color_format == K4A_IMAGE_FORMAT_COLOR_MJPG ? 0 : color_width * 4;
+    k4a::capture capture = k4a::capture::create();
+    capture.set_color_image(copy_image(config.color_format, color_width, color_height, color_stride,
+        scene.color.data(), scene.color.size(), timestamp));
+    capture.set_depth_image(copy_image(K4A_IMAGE_FORMAT_DEPTH16, depth_width, depth_height,
+        depth_width * (int)sizeof(uint16_t), scene.depth.data(), scene.depth.size() * sizeof(uint16_t), depth_timestamp));
+    capture.set_ir_image(copy_image(K4A_IMAGE_FORMAT_IR16, depth_width, depth_height,
+        depth_width * (int)sizeof(uint16_t), scene.ir.data(), scene.ir.size() * sizeof(uint16_t), depth_timestamp));
+    return capture;
+}
+
+void SyntheticCaptureGenerator::skip(uint64_t frames)
+{
+    frame_count += frames;
+}
@@ -1,22 +1,22 @@
 #include "../include/OnlineExtraction.hpp"
 #include "../include/PlaybackExtraction.hpp"
+#include "../include/BatchExtraction.hpp"
+#include "../include/SessionExtraction.hpp"
+#include "../include/CommandLine.hpp"
 
-int main() {
+int main(int argc, char** argv) {
 
-	// Online settings
-	
-	//int recording_duration = 15;
-	//std::string base_path = "C:\\Users\\zenob\\Desktop\\output";
-	//int num_devices = 2;
-	//onlineExtraction(recording_duration, base_path, num_devices);
-
-	// Playback settings
-
-	std::ifstream filein("C:\\Users\\zenob\\Desktop\\files.txt");
-	for (std::string input_path; std::getline(filein, input_path); )
+	CommandLineOptions options;
+	if (!parse_command_line(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+	if (options.help)
 	{
-		playbackExtraction(input_path);
+		printUsage(argv[0]);
+		return 0;
 	}
 
-	return 0;
+	return run_command_line(options);
 }
\ No newline at end of file